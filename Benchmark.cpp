@@ -0,0 +1,394 @@
+#include "CityManager.h"
+#include "ConcurrentCityManager.h"
+#include "DatasetGenerator.h"
+#include "Distance.h"
+#include <iostream>
+#include <iomanip>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace
+{
+/**
+ * Stream buffer that discards everything, used to silence command output while timing.
+ */
+class NullBuffer : public streambuf
+{
+protected:
+    int overflow(int c) override
+    {
+        return c;
+    }
+
+    streamsize xsputn(const char *, streamsize count) override
+    {
+        return count;
+    }
+};
+
+/**
+ * Redirects cout to a null buffer for as long as it exists.
+ */
+class QuietOutput
+{
+private:
+    NullBuffer sink;
+    streambuf *saved;
+
+public:
+    QuietOutput() : saved(cout.rdbuf(&sink)) {}
+    ~QuietOutput()
+    {
+        cout.rdbuf(saved);
+    }
+};
+
+/**
+ * Timings of one benchmark: the latency of each repetition and the items it processed.
+ */
+struct BenchmarkResult
+{
+    string name;
+    size_t itemsPerRepetition;
+    vector<double> latencies; // Seconds per repetition
+    long peakRssKb;
+};
+
+/**
+ * Returns the peak resident set size of the process in KB.
+ */
+long peakRssKb()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+/**
+ * Returns the value at fraction q of sorted latencies.
+ */
+double percentile(const vector<double> &sorted, double q)
+{
+    size_t index = static_cast<size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[min(index, sorted.size() - 1)];
+}
+
+/**
+ * Runs operation(i) for i in [0, repetitions) with output silenced, timing each call.
+ */
+template <typename Operation>
+BenchmarkResult measure(const string &name, size_t repetitions, size_t itemsPerRepetition, Operation operation)
+{
+    BenchmarkResult result{name, itemsPerRepetition, {}, 0};
+    result.latencies.reserve(repetitions);
+    {
+        QuietOutput quiet;
+        for (size_t i = 0; i < repetitions; ++i)
+        {
+            auto start = chrono::steady_clock::now();
+            operation(i);
+            auto end = chrono::steady_clock::now();
+            result.latencies.push_back(chrono::duration<double>(end - start).count());
+        }
+    }
+    result.peakRssKb = peakRssKb();
+    return result;
+}
+
+/**
+ * Prints a table row: throughput in items per second and latency percentiles per repetition.
+ */
+void report(BenchmarkResult result)
+{
+    vector<double> &latencies = result.latencies;
+    if (latencies.empty())
+        return;
+    double total = 0.0;
+    for (double latency : latencies)
+        total += latency;
+    sort(latencies.begin(), latencies.end());
+    double items = static_cast<double>(result.itemsPerRepetition) * static_cast<double>(latencies.size());
+    cout << left << setw(34) << result.name << right
+         << setw(8) << latencies.size()
+         << setw(14) << fixed << setprecision(0) << items / total
+         << setw(12) << setprecision(2) << percentile(latencies, 0.50) * 1e6
+         << setw(12) << percentile(latencies, 0.99) * 1e6
+         << setw(10) << result.peakRssKb / 1024 << endl;
+}
+
+/**
+ * Prints the usage message.
+ */
+void usage()
+{
+    cout << "Usage: 5004_CW_bench [rows] [--seed <n>] [--generate <file>]" << endl;
+    cout << "  rows               number of synthetic cities (default 100000)" << endl;
+    cout << "  --seed <n>         seed of the dataset generator (default 5004)" << endl;
+    cout << "  --generate <file>  only write a dataset of that size to file" << endl;
+}
+} // namespace
+
+/**
+ * Benchmarks every CityManager operation on a synthetic dataset.
+ */
+int main(int argc, char *argv[])
+{
+    size_t rows = 100000;
+    uint64_t seed = 5004;
+    string generateOnly;
+    for (int i = 1; i < argc; ++i)
+    {
+        string argument = argv[i];
+        if (argument == "--seed" && i + 1 < argc)
+            seed = strtoull(argv[++i], nullptr, 10);
+        else if (argument == "--generate" && i + 1 < argc)
+            generateOnly = argv[++i];
+        else if (!argument.empty() && isdigit(static_cast<unsigned char>(argument[0])))
+            rows = strtoull(argument.c_str(), nullptr, 10);
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (rows == 0)
+    {
+        usage();
+        return 1;
+    }
+
+    string error;
+    if (!generateOnly.empty())
+    {
+        DatasetGenerator generator(seed);
+        if (!generator.writeFile(generateOnly, rows, error))
+        {
+            cerr << "Error: " << error << endl;
+            return 1;
+        }
+        cout << "Wrote " << rows << " cities to " << generateOnly << endl;
+        return 0;
+    }
+
+    // Write the dataset and keep its records for choosing lookup keys
+    filesystem::path directory = filesystem::temp_directory_path() / ("5004_CW_bench_" + to_string(getpid()));
+    filesystem::create_directories(directory);
+    const string csvFile = (directory / "cities.txt").string();
+    const string snapFile = (directory / "cities.snap").string();
+    const string saveFile = (directory / "saved.txt").string();
+    const string journalFile = (directory / "journaled.txt").string();
+    {
+        DatasetGenerator generator(seed);
+        if (!generator.writeFile(csvFile, rows, error))
+        {
+            cerr << "Error: " << error << endl;
+            return 1;
+        }
+    }
+    DatasetGenerator generator(seed);
+    vector<CityRecord> records;
+    generator.generate(rows, records);
+
+    const size_t lookups = min<size_t>(100000, rows * 10);
+    const size_t queries = min<size_t>(2000, rows);
+    const size_t scans = 5;
+    const size_t changes = min<size_t>(10000, rows);
+    mt19937_64 random(seed);
+    auto anyRecord = [&records, &random]() -> const CityRecord &
+    { return records[random() % records.size()]; };
+
+    cout << "Benchmarking " << rows << " cities (seed " << seed << ")" << endl;
+    cout << left << setw(34) << "operation" << right << setw(8) << "reps" << setw(14) << "items/sec"
+         << setw(12) << "p50 us" << setw(12) << "p99 us" << setw(10) << "peak MB" << endl;
+
+    // Loading
+    report(measure("load csv", 3, rows, [&csvFile](size_t)
+                   { CityManager manager; manager.loadFromFile(csvFile); }));
+    CityManager manager;
+    {
+        QuietOutput quiet;
+        manager.loadFromFile(csvFile);
+    }
+    report(measure("snapshot save", 3, rows, [&manager, &snapFile](size_t)
+                   { manager.saveSnapshot(snapFile); }));
+    report(measure("load snapshot", 3, rows, [&snapFile](size_t)
+                   { CityManager loaded; loaded.loadFromFile(snapFile); }));
+
+    // Point lookups
+    report(measure("find (hit)", lookups, 1, [&manager, &anyRecord](size_t)
+                   { const CityRecord &record = anyRecord(); manager.findCity(record.name, record.region); }));
+    report(measure("find (miss)", lookups, 1, [&manager, &anyRecord](size_t)
+                   { const CityRecord &record = anyRecord(); manager.findCity(record.name + "x", record.region); }));
+    report(measure("display city", lookups, 1, [&manager, &anyRecord](size_t)
+                   { const CityRecord &record = anyRecord(); manager.displayCity(record.name, record.region); }));
+    report(measure("search attribute", lookups, 1, [&manager, &anyRecord](size_t)
+                   { const CityRecord &record = anyRecord(); manager.searchCityAttribute(record.name, record.region, "population"); }));
+
+    // Top-k before any index is built: one pass over the columns with a bounded heap
+    CityQuery largest;
+    largest.orderBy = "population";
+    largest.descending = true;
+    largest.limit = 20;
+    report(measure("top 20 by population (no index)", scans, rows, [&manager, &largest](size_t)
+                   { manager.runQuery(largest); }));
+
+    // Listings; the first repetition of each sort includes building its index
+    report(measure("display all", scans, rows, [&manager](size_t)
+                   { manager.displayCities(); }));
+    for (const string attribute : {"name", "population", "year", "latitude", "longitude"})
+    {
+        report(measure("sort " + attribute + " + display", scans, rows, [&manager, &attribute](size_t)
+                       { manager.sortCities(attribute); manager.displayCities(); }));
+    }
+    // Every repetition radix sorts the normalized keys again
+    const vector<SortKey> byRegion = {{"region"}, {"population", true}, {"name"}};
+    report(measure("sort region, pop desc, name + display", scans, rows, [&manager, &byRegion](size_t)
+                   { manager.sortCities(byRegion); manager.displayCities(); }));
+    {
+        QuietOutput quiet;
+        manager.sortCities("none");
+    }
+
+    // Filters and statistics
+    report(measure("filter population (10%)", scans, rows, [&manager](size_t)
+                   { manager.filterCitiesByPopulation(1000, 2700); }));
+    report(measure("filter region (largest)", scans, rows, [&manager, &generator](size_t)
+                   { manager.filterCitiesByRegion(generator.regionName(0)); }));
+    report(measure("filter region (smallest)", scans, rows, [&manager, &generator](size_t)
+                   { manager.filterCitiesByRegion(generator.regionName(generator.regionCount() - 1)); }));
+    report(measure("stats", scans, rows, [&manager](size_t)
+                   { manager.showStatistics(); }));
+    report(measure("stats by region", scans, rows, [&manager](size_t)
+                   { manager.showGroupStatistics("region"); }));
+    report(measure("stats by year", scans, rows, [&manager](size_t)
+                   { manager.showGroupStatistics("year"); }));
+
+    // Compound queries: one selective index plus a residual test, and an ordered walk with a limit
+    CityQuery compound;
+    string queryError;
+    CityQuery::parse("population between 1000 and 2700 and region = \"" + generator.regionName(generator.regionCount() - 1) + "\"",
+                     compound, queryError);
+    report(measure("query population and region", scans, rows, [&manager, &compound](size_t)
+                   { manager.runQuery(compound); }));
+    CityQuery topCities;
+    CityQuery::parse("year >= 1900 order by population desc limit 10", topCities, queryError);
+    report(measure("query top 10 by population", scans, rows, [&manager, &topCities](size_t)
+                   { manager.runQuery(topCities); }));
+
+    // Text search: a rare word, a phrase of common words, and a prefix restricted to one field
+    TextQuery rareWord, phrase, prefix;
+    const string &mayorName = anyRecord().mayorName;
+    TextQuery::parse("shipyards mayor:" + mayorName.substr(0, mayorName.find(' ')), rareWord, queryError);
+    TextQuery::parse("\"the old salt road\"", phrase, queryError);
+    TextQuery::parse("address:haupt*", prefix, queryError);
+    report(measure("text search (rare word)", scans, rows, [&manager, &rareWord](size_t)
+                   { manager.searchText(rareWord); }));
+    report(measure("text search (phrase)", scans, rows, [&manager, &phrase](size_t)
+                   { manager.searchText(phrase); }));
+    report(measure("text search (prefix)", scans, rows, [&manager, &prefix](size_t)
+                   { manager.searchText(prefix); }));
+
+    // Name suggestions: completions of a short prefix, and a misspelt name with two letters swapped
+    report(measure("suggest (prefix)", queries, 1, [&manager, &anyRecord](size_t)
+                   { manager.suggestCities(anyRecord().name.substr(0, 3), 10); }));
+    report(measure("suggest (typo)", queries, 1, [&manager, &anyRecord](size_t)
+                   {
+                       string name = anyRecord().name;
+                       if (name.size() > 3)
+                           swap(name[1], name[2]);
+                       manager.suggestCities(name, 10);
+                   }));
+
+    // Distances: one pair, then one city to all others scalar and batched
+    report(measure("distance (pair)", lookups, 1, [&manager, &anyRecord](size_t)
+                   {
+                       const CityRecord &first = anyRecord();
+                       const CityRecord &second = anyRecord();
+                       manager.calculateDistance(first.name, first.region, second.name, second.region);
+                   }));
+    report(measure("distances scalar haversine", scans, rows, [&records](size_t i)
+                   {
+                       const CityRecord &origin = records[i % records.size()];
+                       volatile double sum = 0.0;
+                       for (const CityRecord &record : records)
+                           sum = sum + haversineDistance(origin.latitude, origin.longitude, record.latitude, record.longitude);
+                   }));
+    vector<CityDistance> distances;
+    report(measure("distances batched", scans, rows, [&manager, &records, &distances](size_t i)
+                   {
+                       const CityRecord &origin = records[i % records.size()];
+                       manager.distancesFrom(origin.name, origin.region, distances);
+                   }));
+    report(measure("distances batched (500 km)", scans, rows, [&manager, &records, &distances](size_t i)
+                   {
+                       const CityRecord &origin = records[i % records.size()];
+                       manager.distancesFrom(origin.name, origin.region, distances, 500.0);
+                   }));
+
+    // Spatial queries
+    report(measure("nearest 10", queries, 1, [&manager, &anyRecord, &distances](size_t)
+                   { const CityRecord &record = anyRecord(); manager.nearestTo(record.latitude, record.longitude, 10, distances); }));
+    report(measure("within 100 km", queries, 1, [&manager, &anyRecord, &distances](size_t)
+                   { const CityRecord &record = anyRecord(); manager.withinRadius(record.latitude, record.longitude, 100.0, distances); }));
+
+    // Changes, without and with a journal synced after every change
+    report(measure("add", changes, 1, [&manager](size_t i)
+                   { manager.addCity("bench city " + to_string(i), "bench", 1000, 2000, "mayor", "address", "history", 10.0, 20.0); }));
+    report(measure("modify population", changes, 1, [&manager](size_t i)
+                   { manager.setCityAttribute("bench city " + to_string(i), "bench", "population", to_string(2000 + i)); }));
+    report(measure("delete", changes, 1, [&manager](size_t i)
+                   { manager.deleteCity("bench city " + to_string(i), "bench"); }));
+    report(measure("save csv", 3, rows, [&manager, &saveFile](size_t)
+                   { manager.saveToFile(saveFile); }));
+    {
+        CityManager journaled;
+        {
+            QuietOutput quiet;
+            journaled.loadFromFile(csvFile);
+            journaled.saveToFile(journalFile);
+            journaled.openJournal(journalFile);
+        }
+        const size_t commits = min<size_t>(200, changes);
+        report(measure("add + journal commit", commits, 1, [&journaled](size_t i)
+                       {
+                           journaled.addCity("bench city " + to_string(i), "bench", 1000, 2000, "mayor", "address", "history", 10.0, 20.0);
+                           journaled.commitJournal();
+                       }));
+        report(measure("checkpoint", 1, rows, [&journaled](size_t)
+                       { journaled.checkpoint(); }));
+    }
+
+    // Shared access through the two-copy concurrent manager, from one thread
+    {
+        ConcurrentCityManager shared;
+        {
+            QuietOutput quiet;
+            shared.setQuiet(true);
+            shared.loadFromFile(csvFile);
+        }
+        report(measure("concurrent find", lookups, 1, [&shared, &anyRecord](size_t)
+                       {
+                           const CityRecord &record = anyRecord();
+                           shared.read([&record](const CityManager &cities)
+                                       { return cities.findCity(record.name, record.region); });
+                       }));
+        report(measure("concurrent modify population", changes, 1, [&shared, &records](size_t i)
+                       {
+                           const CityRecord &record = records[i % records.size()];
+                           shared.setCityAttribute(record.name, record.region, "population", to_string(1000 + i));
+                       }));
+    }
+
+    cout << "Peak RSS: " << peakRssKb() / 1024 << " MB" << endl;
+    filesystem::remove_all(directory);
+    return 0;
+}
@@ -1,30 +1,48 @@
 #ifndef CITY_H
 #define CITY_H
 #include <string>
+#include <cstdint>
 using namespace std;
 /**
- * Class representing a city with various attributes.
+ * Class representing a city's string attributes.
+ * Numeric attributes are kept in the CityStore columns under the city's record ID.
  */
 class City
 {
 public:
     string name;
-    string region;
-    int population;
-    int year;
+    const string *region; // Region name, stored once in the region dictionary
     string mayorName;
     string mayorAddress;
     string history;
-    double latitude;
-    double longitude;
 
+    uint32_t id;       // Record ID of this city in the CityStore columns
+    uint32_t regionId; // Dictionary ID of the region; equal regions have equal IDs
+
+    City *prev; // Pointer to the previous City in the linked list
     City *next; // Pointer to the next City in the linked list
 
     /**
      * Constructor to initialize a City object.
      */
-    City(string name, string region, int population, int year, string mayorName, string mayorAddress,
-         string history, double latitude, double longitude);
+    City(string name, const string *region, uint32_t regionId, string mayorName, string mayorAddress,
+         string history);
+};
+
+/**
+ * A single parsed row of the data file, prior to insertion.
+ */
+struct CityRecord
+{
+    string name;
+    string region;
+    int population = 0;
+    int year = 0;
+    string mayorName;
+    string mayorAddress;
+    string history;
+    double latitude = 0.0;
+    double longitude = 0.0;
 };
 
 #endif
@@ -0,0 +1,68 @@
+#include "CityArena.h"
+#include <new>
+#include <utility>
+
+/**
+ * Constructor creates an arena with no slabs.
+ */
+CityArena::CityArena() : slabUsed(SLAB_CITIES) {}
+
+/**
+ * Destructor releases every slab. Live cities must have been destroyed first.
+ */
+CityArena::~CityArena()
+{
+    for (City *slab : slabs)
+    {
+        ::operator delete(slab);
+    }
+}
+
+/**
+ * Constructs a City in arena storage.
+ */
+City *CityArena::create(string name, const string *region, uint32_t regionId, string mayorName, string mayorAddress,
+                        string history)
+{
+    City *node;
+    if (!freeNodes.empty())
+    {
+        node = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    else
+    {
+        if (slabUsed == SLAB_CITIES)
+        {
+            slabs.push_back(static_cast<City *>(::operator new(sizeof(City) * SLAB_CITIES)));
+            slabUsed = 0;
+        }
+        node = slabs.back() + slabUsed++;
+    }
+    return new (node) City(move(name), region, regionId, move(mayorName), move(mayorAddress), move(history));
+}
+
+/**
+ * Destroys a City and recycles its node.
+ */
+void CityArena::destroy(City *city)
+{
+    city->~City();
+    freeNodes.push_back(city);
+}
+
+/**
+ * Returns the number of slabs allocated.
+ */
+size_t CityArena::slabCount() const
+{
+    return slabs.size();
+}
+
+/**
+ * Returns the bytes reserved for City nodes across all slabs.
+ */
+size_t CityArena::reservedBytes() const
+{
+    return slabs.size() * SLAB_CITIES * sizeof(City);
+}
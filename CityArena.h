@@ -0,0 +1,60 @@
+#ifndef CITYARENA_H
+#define CITYARENA_H
+
+#include "City.h"
+#include <vector>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Slab allocator for City nodes.
+ * Nodes are carved out of fixed-size slabs and recycled through a free list, so adding
+ * a city needs no allocator call for the node itself and teardown releases whole slabs.
+ */
+class CityArena
+{
+private:
+    static const size_t SLAB_CITIES = 4096; // City nodes per slab
+
+    vector<City *> slabs;     // Raw storage for SLAB_CITIES nodes each
+    size_t slabUsed;          // Nodes handed out from the newest slab
+    vector<City *> freeNodes; // Destroyed nodes available for reuse
+
+public:
+    /**
+     * Constructor creates an arena with no slabs.
+     */
+    CityArena();
+
+    /**
+     * Destructor releases every slab. Live cities must have been destroyed first.
+     */
+    ~CityArena();
+
+    CityArena(const CityArena &) = delete;
+    CityArena &operator=(const CityArena &) = delete;
+
+    /**
+     * Constructs a City in arena storage.
+     */
+    City *create(string name, const string *region, uint32_t regionId, string mayorName, string mayorAddress,
+                 string history);
+
+    /**
+     * Destroys a City and recycles its node.
+     */
+    void destroy(City *city);
+
+    /**
+     * Returns the number of slabs allocated.
+     */
+    size_t slabCount() const;
+
+    /**
+     * Returns the bytes reserved for City nodes across all slabs.
+     */
+    size_t reservedBytes() const;
+};
+
+#endif // CITYARENA_H
@@ -0,0 +1,189 @@
+#ifndef CITYFIELDS_H
+#define CITYFIELDS_H
+
+#include "City.h"
+#include "CityStore.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <iterator>
+#include <utility>
+#include <type_traits>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * The attributes of a city, in the order they are displayed. CITY_FIELDS lists them in the same order.
+ */
+enum class CityField : uint8_t
+{
+    Name,
+    Region,
+    Population,
+    Year,
+    MayorName,
+    MayorAddress,
+    History,
+    Latitude,
+    Longitude
+};
+
+/**
+ * Where the value of a field lives: text in the City node, or an integer or real column of the CityStore.
+ */
+enum class FieldType : uint8_t
+{
+    Text,
+    Integer,
+    Real
+};
+
+/**
+ * Compile-time description of one city attribute: its names, how it is stored and the
+ * values it accepts. Commands look a field up by name once; code that runs per city then
+ * reads it through visitField, which turns the field into a template argument so each
+ * access compiles down to a direct column or member load.
+ */
+struct FieldDescriptor
+{
+    CityField field;
+    string_view name;                 // Lowercase attribute name used by commands and queries
+    string_view heading;              // Label printed before the value
+    string_view description;          // Subject of messages about the field
+    string_view prompt;               // Asks for a new value
+    FieldType type;
+    bool ordered;                     // True if the field has an ordered secondary index
+    double minimum;                   // Integer and Real: accepted values
+    double maximum;
+    vector<int> CityStore::*integers; // Integer: column holding the values
+    vector<double> CityStore::*reals; // Real: column holding the values
+    string City::*text;               // Text: member holding the value (nullptr for the region, kept in the dictionary)
+};
+
+/**
+ * Every attribute of a city. Adding an attribute starts with an entry here.
+ */
+inline constexpr FieldDescriptor CITY_FIELDS[] = {
+    {CityField::Name, "name", "Name", "Name", "Enter the new name: ", FieldType::Text, true, 0.0, 0.0, nullptr,
+     nullptr, &City::name},
+    {CityField::Region, "region", "Region", "Region", "Enter the new region: ", FieldType::Text, false, 0.0, 0.0,
+     nullptr, nullptr, nullptr},
+    {CityField::Population, "population", "Population", "Population", "Enter the new population: ",
+     FieldType::Integer, true, 1.0, 40000000.0, &CityStore::population, nullptr, nullptr},
+    {CityField::Year, "year", "Year", "Year", "Enter the new year (4-digit year): ", FieldType::Integer, true, 1980.0,
+     2024.0, &CityStore::year, nullptr, nullptr},
+    {CityField::MayorName, "mayorname", "Mayor's Name", "Mayor's name", "Enter the new mayor's name: ",
+     FieldType::Text, false, 0.0, 0.0, nullptr, nullptr, &City::mayorName},
+    {CityField::MayorAddress, "mayoraddress", "Mayor's Address", "Mayor's address",
+     "Enter the new mayor's address: ", FieldType::Text, false, 0.0, 0.0, nullptr, nullptr, &City::mayorAddress},
+    {CityField::History, "history", "History", "History", "Enter the new history: ", FieldType::Text, false, 0.0,
+     0.0, nullptr, nullptr, &City::history},
+    {CityField::Latitude, "latitude", "Latitude", "Latitude", "Enter the new latitude (between -90 and 90): ",
+     FieldType::Real, true, -90.0, 90.0, nullptr, &CityStore::latitude, nullptr},
+    {CityField::Longitude, "longitude", "Longitude", "Longitude", "Enter the new longitude (between -180 and 180): ",
+     FieldType::Real, true, -180.0, 180.0, nullptr, &CityStore::longitude, nullptr},
+};
+
+/**
+ * Returns true if every entry of CITY_FIELDS sits at the position of its CityField.
+ */
+constexpr bool fieldsInOrder()
+{
+    for (size_t i = 0; i < size(CITY_FIELDS); ++i)
+    {
+        if (static_cast<size_t>(CITY_FIELDS[i].field) != i)
+            return false;
+    }
+    return true;
+}
+
+static_assert(fieldsInOrder(), "CITY_FIELDS must list the fields in CityField order");
+
+/**
+ * Returns the descriptor of a field.
+ */
+constexpr const FieldDescriptor &describeField(CityField field)
+{
+    return CITY_FIELDS[static_cast<size_t>(field)];
+}
+
+/**
+ * Returns the descriptor of the field with a lowercase attribute name, or nullptr if there is none.
+ */
+constexpr const FieldDescriptor *findField(string_view name)
+{
+    for (const FieldDescriptor &field : CITY_FIELDS)
+    {
+        if (field.name == name)
+            return &field;
+    }
+    return nullptr;
+}
+
+/**
+ * Calls visit once with the position of a field in CITY_FIELDS as an integral_constant, so
+ * the visitor is compiled for each field and can test the descriptor with if constexpr.
+ */
+template <size_t I = 0, typename Visitor>
+void visitField(CityField field, Visitor &&visit)
+{
+    if constexpr (I < size(CITY_FIELDS))
+    {
+        if (static_cast<size_t>(field) == I)
+            visit(integral_constant<size_t, I>());
+        else
+            visitField<I + 1>(field, forward<Visitor>(visit));
+    }
+}
+
+// Calls visit with each of the positions I
+template <typename Visitor, size_t... I>
+void visitFields(Visitor &visit, index_sequence<I...>)
+{
+    (visit(integral_constant<size_t, I>()), ...);
+}
+
+/**
+ * Calls visit with the position of every field in CITY_FIELDS, in order.
+ */
+template <typename Visitor>
+void forEachField(Visitor &&visit)
+{
+    visitFields(visit, make_index_sequence<size(CITY_FIELDS)>());
+}
+
+/**
+ * Returns the value of field I for a stored record: an int or a double read from its
+ * column, or a view of its text.
+ */
+template <size_t I>
+auto fieldValue(const CityStore &store, uint32_t id)
+{
+    constexpr const FieldDescriptor &field = CITY_FIELDS[I];
+    if constexpr (field.type == FieldType::Integer)
+        return (store.*field.integers)[id];
+    else if constexpr (field.type == FieldType::Real)
+        return (store.*field.reals)[id];
+    else if constexpr (field.field == CityField::Region)
+        return string_view(*store.rows[id]->region);
+    else
+        return string_view(store.rows[id]->*field.text);
+}
+
+/**
+ * Returns the value of a numeric field for a stored record as a double (0 for text fields).
+ */
+inline double numericValue(CityField field, const CityStore &store, uint32_t id)
+{
+    double value = 0.0;
+    visitField(field, [&](auto index)
+               {
+                   if constexpr (CITY_FIELDS[index].type != FieldType::Text)
+                       value = fieldValue<index>(store, id);
+               });
+    return value;
+}
+
+#endif // CITYFIELDS_H
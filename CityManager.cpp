@@ -1,130 +1,410 @@
 #include "CityManager.h"
 #include "Utilities.h"
 #include "InputHandler.h"
+#include "Distance.h"
+#include "Snapshot.h"
+#include "NormalizedKeys.h"
 #include <iostream>
 #include <sstream>
+#include <iomanip>
 #include <fstream>
 #include <cmath>
 #include <limits>
+#include <vector>
+#include <charconv>
+#include <algorithm>
+#include <sys/stat.h>
+#include <type_traits>
+#include <thread>
+#include <atomic>
 
 using namespace std;
 
 /**
  * Constructor initializes the head to nullptr.
  */
-CityManager::CityManager() : head(nullptr) {}
+CityManager::CityManager() : head(nullptr), tail(nullptr), nextSequence(0), listingSorted(false), baseFileBytes(0), quiet(false),
+                             changeLog(nullptr) {}
 
 /**
  * Destructor to free all dynamically allocated memory.
+ * Cities are destroyed by walking the contiguous record array; the arena then
+ * releases their nodes a slab at a time.
  */
 CityManager::~CityManager()
 {
-    City *current = head;
-    while (current != nullptr)
+    for (City *city : store.rows)
     {
-        City *toDelete = current;
-        current = current->next;
-        delete toDelete;
+        if (city != nullptr)
+            arena.destroy(city);
     }
 }
 
 /**
- * Splits the linked list into two halves for merge sort.
+ * Returns the stream for status messages: cout, or a discarding stream when quiet.
  */
-void CityManager::splitList(City *source, City **frontRef, City **backRef)
+ostream &CityManager::status() const
 {
-    City *slow = source;
-    City *fast = source->next;
+    // Writing to the discarding stream still sets its state, so each thread has its own
+    thread_local ostream discard(nullptr);
+    return quiet ? discard : cout;
+}
+
+/**
+ * Turns status messages such as "City deleted successfully!" off or on.
+ */
+void CityManager::setQuiet(bool enabled)
+{
+    quiet = enabled;
+}
+
+/**
+ * Copies every change made from now on, including journal replay, into log (nullptr to stop).
+ */
+void CityManager::recordChanges(vector<JournalEntry> *log)
+{
+    changeLog = log;
+}
 
-    // Advance 'fast' two nodes, and 'slow' one node
-    while (fast != nullptr)
+/**
+ * Applies changes recorded by another manager, quietly and without journaling them.
+ */
+void CityManager::replayChanges(vector<JournalEntry> &entries)
+{
+    for (JournalEntry &entry : entries)
     {
-        fast = fast->next;
-        if (fast != nullptr)
-        {
-            slow = slow->next;
-            fast = fast->next;
-        }
+        applyJournalEntry(entry);
     }
+}
 
-    // 'slow' is before the midpoint in the list, so split it in two at that point
-    *frontRef = source;
-    *backRef = slow->next;
-    slow->next = nullptr;
+/**
+ * Builds every secondary index and sorts every region posting list, so that const
+ * methods no longer change any state.
+ */
+void CityManager::buildIndexes() const
+{
+    for (const FieldDescriptor &field : CITY_FIELDS)
+    {
+        if (field.ordered)
+            orderedBy(string(field.name));
+    }
+    regions.sortPostings();
+    textIndexed().sortWords();
+    namesIndexed();
+    bool reversed;
+    listingIds(reversed);
 }
 
 /**
- * Merges two sorted linked lists based on the sort attribute.
+ * Builds the primary index key: the lowercase name, a NUL byte and the four bytes of the region ID.
  */
-City *CityManager::sortedMerge(City *a, City *b, const string &sortAttribute)
+string CityManager::makeKey(const string &name, uint32_t region)
 {
-    City *result = nullptr;
+    string key = toLowerCase(name);
+    key.push_back('\0');
+    key.append(reinterpret_cast<const char *>(&region), sizeof(region));
+    return key;
+}
 
-    // Base cases
-    if (a == nullptr)
-        return b;
-    else if (b == nullptr)
-        return a;
+/**
+ * Finds a city by name within a region ID.
+ */
+City *CityManager::findInRegion(const string &name, uint32_t region) const
+{
+    auto it = cityIndex.find(makeKey(name, region));
+    return it == cityIndex.end() ? nullptr : it->second;
+}
 
-    // Compare based on the sortAttribute
-    bool condition = false;
-    if (sortAttribute == "name")
-        condition = (a->name < b->name);
-    else if (sortAttribute == "population")
-        condition = (a->population < b->population);
-    else if (sortAttribute == "year")
-        condition = (a->year < b->year);
-    else if (sortAttribute == "latitude")
-        condition = (a->latitude < b->latitude);
-    else if (sortAttribute == "longitude")
-        condition = (a->longitude < b->longitude);
-    else
+/**
+ * Constructs the City node of a lowercase record, adding its region to the dictionary.
+ * The record's strings are moved into the node.
+ */
+City *CityManager::createCity(CityRecord &record)
+{
+    const uint32_t region = regions.intern(record.region);
+    return arena.create(move(record.name), regions.name(region), region, move(record.mayorName),
+                        move(record.mayorAddress), move(record.history));
+}
+
+/**
+ * Stores a new city, links it at the tail of the list and registers it in the index.
+ */
+void CityManager::appendCity(City *city, int population, int year, double latitude, double longitude)
+{
+    store.insert(city, population, year, latitude, longitude);
+    linkCity(city);
+}
+
+/**
+ * Links an already stored city at the tail of the list and registers it in every index.
+ */
+void CityManager::linkCity(City *city)
+{
+    city->prev = tail;
+    city->next = nullptr;
+    if (tail == nullptr)
     {
-        cout << "Invalid sort attribute. Sorting by name by default." << endl;
-        condition = (a->name < b->name);
+        head = city; // If the list is empty, the new city becomes the head
     }
-
-    if (condition)
+    else
     {
-        result = a;
-        result->next = sortedMerge(a->next, b, sortAttribute);
+        tail->next = city;
     }
+    tail = city;
+    if (linkSequence.size() <= city->id)
+        linkSequence.resize(store.capacity());
+    linkSequence[city->id] = nextSequence++;
+    cityIndex[makeKey(city->name, city->regionId)] = city;
+    regions.add(city->regionId, city->id);
+    grid.insert(city->id, store.latitude[city->id], store.longitude[city->id]);
+    indexCity(city);
+}
+
+/**
+ * Unlinks a city from the list, the index and the store, then returns it to the arena.
+ */
+void CityManager::removeCity(City *city)
+{
+    cityIndex.erase(makeKey(city->name, city->regionId));
+    regions.remove(city->regionId, city->id);
+    unindexCity(city);
+    grid.remove(city->id, store.latitude[city->id], store.longitude[city->id]);
+    store.erase(city->id);
+    if (city->prev != nullptr)
+        city->prev->next = city->next;
+    else
+        head = city->next;
+    if (city->next != nullptr)
+        city->next->prev = city->prev;
+    else
+        tail = city->prev;
+    arena.destroy(city);
+}
+
+/**
+ * Moves a city to new coordinates, keeping the spatial index in sync.
+ */
+void CityManager::moveCity(City *city, double latitude, double longitude)
+{
+    grid.remove(city->id, store.latitude[city->id], store.longitude[city->id]);
+    latitudeIndex.erase(store.latitude[city->id], city->id);
+    longitudeIndex.erase(store.longitude[city->id], city->id);
+    store.setCoordinates(city->id, latitude, longitude);
+    grid.insert(city->id, latitude, longitude);
+    latitudeIndex.insert(latitude, city->id);
+    longitudeIndex.insert(longitude, city->id);
+}
+
+/**
+ * Returns the ordered secondary index of field I of CITY_FIELDS.
+ */
+template <size_t I>
+auto &CityManager::fieldIndex() const
+{
+    constexpr CityField FIELD = CITY_FIELDS[I].field;
+    static_assert(CITY_FIELDS[I].ordered, "only ordered fields have an index");
+    if constexpr (FIELD == CityField::Name)
+        return nameIndex;
+    else if constexpr (FIELD == CityField::Population)
+        return populationIndex;
+    else if constexpr (FIELD == CityField::Year)
+        return yearIndex;
+    else if constexpr (FIELD == CityField::Latitude)
+        return latitudeIndex;
     else
+        return longitudeIndex;
+}
+
+/**
+ * Adds a city to every built secondary index.
+ */
+void CityManager::indexCity(const City *city)
+{
+    forEachField([this, city](auto index)
+                 {
+                     if constexpr (CITY_FIELDS[index].ordered)
+                         fieldIndex<index>().insert(fieldValue<index>(store, city->id), city->id);
+                 });
+    textIndex.add(*city);
+    nameTrie.add(city->name);
+    listCity(city->id);
+}
+
+/**
+ * Removes a city from every built secondary index.
+ */
+void CityManager::unindexCity(const City *city)
+{
+    forEachField([this, city](auto index)
+                 {
+                     if constexpr (CITY_FIELDS[index].ordered)
+                         fieldIndex<index>().erase(fieldValue<index>(store, city->id), city->id);
+                 });
+    textIndex.remove(*city);
+    nameTrie.remove(city->name);
+    unlistCity(city->id);
+}
+
+/**
+ * Drops every secondary index so it is rebuilt on next use.
+ */
+void CityManager::invalidateIndexes()
+{
+    forEachField([this](auto index)
+                 {
+                     if constexpr (CITY_FIELDS[index].ordered)
+                         fieldIndex<index>().invalidate();
+                 });
+    textIndex.invalidate();
+    nameTrie.invalidate();
+    listingSorted = false;
+}
+
+/**
+ * Builds a secondary index from the store if it is not already built.
+ */
+template <typename Key, typename Getter>
+static void ensureBuilt(SortedIndex<Key> &index, const CityStore &store, Getter keyOf)
+{
+    if (index.isBuilt())
+        return;
+    vector<pair<Key, uint32_t>> entries;
+    entries.reserve(store.size());
+    for (uint32_t id = 0; id < store.capacity(); ++id)
     {
-        result = b;
-        result->next = sortedMerge(a, b->next, sortAttribute);
+        if (store.live[id])
+            entries.emplace_back(keyOf(id), id);
     }
-    return result;
+    index.rebuild(move(entries));
 }
 
 /**
- *  Performs merge sort on the linked list.
+ * Returns the ordered secondary index of field I, building it from its column if needed.
  */
-void CityManager::mergeSort(City **headRef, const string &sortAttribute)
+template <size_t I>
+const auto &CityManager::builtIndex() const
 {
-    City *headLocal = *headRef;
-    City *a;
-    City *b;
+    auto &index = fieldIndex<I>();
+    ensureBuilt(index, store, [this](uint32_t id) { return fieldValue<I>(store, id); });
+    return index;
+}
 
-    // Base case -- length 0 or 1
-    if ((headLocal == nullptr) || (headLocal->next == nullptr))
+/**
+ * Returns record IDs ordered by an attribute, building its index if needed (nullptr if unknown).
+ */
+const vector<uint32_t> *CityManager::orderedBy(const string &attribute) const
+{
+    const FieldDescriptor *field = findField(attribute);
+    const vector<uint32_t> *ids = nullptr;
+    if (field != nullptr)
     {
-        return;
+        visitField(field->field, [this, &ids](auto index)
+                   {
+                       if constexpr (CITY_FIELDS[index].ordered)
+                           ids = &builtIndex<index>().orderedIds();
+                   });
+    }
+    return ids;
+}
+
+/**
+ * Returns true if the index of an attribute is built, so reading it in order costs nothing extra.
+ */
+bool CityManager::isOrdered(const string &attribute) const
+{
+    const FieldDescriptor *field = findField(attribute);
+    bool built = false;
+    if (field != nullptr)
+    {
+        visitField(field->field, [this, &built](auto index)
+                   {
+                       if constexpr (CITY_FIELDS[index].ordered)
+                           built = fieldIndex<index>().isBuilt();
+                   });
     }
+    return built;
+}
+
+/**
+ * Returns the text index, building it if needed.
+ */
+const TextIndex &CityManager::textIndexed() const
+{
+    if (!textIndex.isBuilt())
+        textIndex.rebuild(store.rows);
+    return textIndex;
+}
+
+/**
+ * Returns the name trie, building it if needed.
+ */
+const NameTrie &CityManager::namesIndexed() const
+{
+    if (!nameTrie.isBuilt())
+        nameTrie.rebuild(store.rows);
+    return nameTrie;
+}
 
-    // Split head into 'a' and 'b' sublists
-    splitList(headLocal, &a, &b);
+/**
+ * Calls visit for each city in the current listing order: insertion order, or the
+ * order of the active sort attribute's index.
+ */
+template <typename Visitor>
+void CityManager::forEachCity(Visitor visit) const
+{
+    // A visitor that returns bool ends the walk early by returning false
+    auto proceed = [&visit](const City *city)
+    {
+        if constexpr (is_same_v<invoke_result_t<Visitor &, const City *>, bool>)
+        {
+            return visit(city);
+        }
+        else
+        {
+            visit(city);
+            return true;
+        }
+    };
 
-    // Recursively sort the sublists
-    mergeSort(&a, sortAttribute);
-    mergeSort(&b, sortAttribute);
+    bool reversed;
+    const vector<uint32_t> *order = listingIds(reversed);
+    if (order == nullptr)
+    {
+        for (const City *current = head; current != nullptr; current = current->next)
+        {
+            if (!proceed(current))
+                return;
+        }
+    }
+    else if (reversed)
+    {
+        for (auto it = order->rbegin(); it != order->rend(); ++it)
+        {
+            if (!proceed(store.rows[*it]))
+                return;
+        }
+    }
+    else
+    {
+        for (uint32_t id : *order)
+        {
+            if (!proceed(store.rows[id]))
+                return;
+        }
+    }
+}
 
-    // Merge the two sorted lists together
-    *headRef = sortedMerge(a, b, sortAttribute);
+/**
+ * Offers a city to a result writer; returns false once the writer's limit is reached.
+ */
+bool CityManager::writeCity(ResultWriter &writer, const City *city) const
+{
+    return writer.write(*city, store.population[city->id], store.year[city->id], store.latitude[city->id],
+                        store.longitude[city->id]);
 }
 
 /**
- *  Adds a new city to the list.
+ *  Adds a new city to the list, asking before overwriting an existing one.
  */
 void CityManager::addCity(string name, string region, int population, int year, string mayorName,
                           string mayorAddress, string history, double latitude, double longitude)
@@ -132,9 +412,6 @@ void CityManager::addCity(string name, string region, int population, int year,
     // Convert all string inputs to lowercase before storing
     string lowerName = toLowerCase(name);
     string lowerRegion = toLowerCase(region);
-    string lowerMayorName = toLowerCase(mayorName);
-    string lowerMayorAddress = toLowerCase(mayorAddress);
-    string lowerHistory = toLowerCase(history);
     // Check for duplicates
     if (findCity(lowerName, lowerRegion))
     {
@@ -153,28 +430,47 @@ void CityManager::addCity(string name, string region, int population, int year,
         }
     }
 
-    City *newCity = new City(lowerName, lowerRegion, population, year, lowerMayorName, lowerMayorAddress, lowerHistory, latitude, longitude);
+    insertCity({move(lowerName), move(lowerRegion), population, year, move(mayorName), move(mayorAddress),
+                move(history), latitude, longitude},
+               DuplicatePolicy::KeepLast);
+}
 
-    if (head == nullptr)
-    {
-        head = newCity; // If the list is empty, set the new city as the head
-    }
-    else
+/**
+ * Adds a city without prompting, resolving an existing (name, region) by policy.
+ * Returns false if the city was not added.
+ */
+bool CityManager::insertCity(CityRecord record, DuplicatePolicy policy)
+{
+    // Convert all string inputs to lowercase before storing
+    toLowerInPlace(record.name);
+    toLowerInPlace(record.region);
+    toLowerInPlace(record.mayorName);
+    toLowerInPlace(record.mayorAddress);
+    toLowerInPlace(record.history);
+    City *existing = findCity(record.name, record.region);
+    if (existing != nullptr)
     {
-        // Insert the new city at the end of the list
-        City *current = head;
-        while (current->next != nullptr)
+        if (policy != DuplicatePolicy::KeepLast)
         {
-            current = current->next;
+            cout << "A city with the name '" << record.name << "' in region '" << record.region
+                 << "' already exists. City not added." << endl;
+            return false;
         }
-        current->next = newCity;
+        removeCity(existing); // Replaying the add below replaces it too
     }
+
+    JournalEntry entry;
+    entry.operation = JournalOperation::Add;
+    entry.city = record;
+    appendCity(createCity(record), record.population, record.year, record.latitude, record.longitude);
+    journalChange(entry);
+    return true;
 }
 
 /**
- *  Displays all cities in the list.
+ *  Displays all cities in the list, in the given format and window.
  */
-void CityManager::displayCities() const
+void CityManager::displayCities(const OutputOptions &output) const
 {
     if (head == nullptr)
     {
@@ -182,15 +478,13 @@ void CityManager::displayCities() const
         return;
     }
 
-    City *current = head;
-    while (current != nullptr)
+    ResultWriter writer(cout, output);
+    if (output.countOnly)
     {
-        cout << "City: " << current->name << ", Region: " << current->region
-             << ", Population: " << current->population << ", Year: " << current->year
-             << ", Mayor: " << current->mayorName << ", History: " << current->history
-             << ", Latitude: " << current->latitude << ", Longitude: " << current->longitude << endl;
-        current = current->next;
+        writer.writeCount(store.size());
+        return;
     }
+    forEachCity([this, &writer](const City *current) { return writeCity(writer, current); });
 }
 
 /**
@@ -198,16 +492,13 @@ void CityManager::displayCities() const
  */
 City *CityManager::findCity(const string &name, const string &region) const
 {
-    City *current = head;
-    while (current != nullptr)
+    // A region that is not in the dictionary has no cities
+    const uint32_t regionId = regions.find(toLowerCase(region));
+    if (regionId == RegionDictionary::NONE)
     {
-        if (equalsIgnoreCase(current->name, name) && equalsIgnoreCase(current->region, region))
-        {
-            return current;
-        }
-        current = current->next;
+        return nullptr;
     }
-    return nullptr;
+    return findInRegion(name, regionId);
 }
 
 /**
@@ -215,264 +506,244 @@ City *CityManager::findCity(const string &name, const string &region) const
  */
 void CityManager::calculateDistance(const string &city1Name, const string &region1, const string &city2Name, const string &region2) const
 {
-    string lowerCity1 = toLowerCase(city1Name);
-    string lowerRegion1 = toLowerCase(region1);
-    string lowerCity2 = toLowerCase(city2Name);
-    string lowerRegion2 = toLowerCase(region2);
-
-    City *city1 = findCity(lowerCity1, lowerRegion1);
-    City *city2 = findCity(lowerCity2, lowerRegion2);
-    const double EARTH_RADIUS = 6371.0;
+    City *city1 = findCity(city1Name, region1);
+    City *city2 = findCity(city2Name, region2);
     if (!city1 || !city2)
     {
         cerr << "Error: One or both cities not found." << endl;
+        if (!city1)
+            suggestAlternatives(city1Name, region1);
+        if (!city2)
+            suggestAlternatives(city2Name, region2);
         return;
     }
 
-    // Convert latitudes and longitudes from degrees to radians
-    double lat1 = toRadians(city1->latitude);
-    double lat2 = toRadians(city2->latitude);
-    double lon1 = toRadians(city1->longitude);
-    double lon2 = toRadians(city2->longitude);
+    double distance = haversineDistance(store.latitude[city1->id], store.longitude[city1->id],
+                                        store.latitude[city2->id], store.longitude[city2->id]);
 
-    // Haversine formula for distance
-    double dLat = lat2 - lat1;
-    double dLon = lon2 - lon1;
-
-    double a = sin(dLat / 2) * sin(dLat / 2) +
-               cos(lat1) * cos(lat2) *
-                   sin(dLon / 2) * sin(dLon / 2);
-    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
-    double distance = EARTH_RADIUS * c;
-
-    cout << "Distance between " << city1->name << ", " << city1->region << " and "
-         << city2->name << ", " << city2->region << " is: " << distance << " km." << endl;
+    cout << "Distance between " << city1->name << ", " << *city1->region << " and "
+         << city2->name << ", " << *city2->region << " is: " << distance << " km." << endl;
 }
 
 /**
- *  Deletes a city by name and region.
+ * Computes the distance from one city to every other city with a batched kernel.
  */
-void CityManager::deleteCity(const string &name, const string &region)
+bool CityManager::distancesFrom(const string &name, const string &region, vector<CityDistance> &results,
+                                double maxDistance, bool sorted) const
 {
-    if (head == nullptr)
+    results.clear();
+    const City *origin = findCity(name, region);
+    if (origin == nullptr)
     {
-        cout << "No cities available to delete." << endl;
-        return;
+        return false;
     }
 
-    // Handle deletion of the head city
-    if (equalsIgnoreCase(head->name, name) && equalsIgnoreCase(head->region, region))
-    {
-        City *toDelete = head;
-        head = head->next;
-        delete toDelete;
-        cout << "City deleted successfully!" << endl;
-        return;
-    }
+    // Squared chord lengths to every record ID in one vectorized pass
+    const size_t slots = store.capacity();
+    vector<double> chords(slots);
+    chordSquaredFromPoint(store.unitX[origin->id], store.unitY[origin->id], store.unitZ[origin->id],
+                          store.unitX.data(), store.unitY.data(), store.unitZ.data(), chords.data(), slots);
 
-    // Traverse the list to find and delete the city
-    City *current = head;
-    while (current->next != nullptr)
+    // Threshold in chord space so only the survivors pay for the conversion to km
+    const double limit = isinf(maxDistance) ? maxDistance : kmToChordSquared(maxDistance);
+    for (size_t id = 0; id < slots; ++id)
     {
-        if (equalsIgnoreCase(current->next->name, name) && equalsIgnoreCase(current->next->region, region))
+        if (store.live[id] && id != origin->id && chords[id] <= limit)
         {
-            City *toDelete = current->next;
-            current->next = current->next->next;
-            delete toDelete;
-            cout << "City deleted successfully!" << endl;
-            return;
+            results.push_back({store.rows[id], chordSquaredToKm(chords[id])});
         }
-        current = current->next;
     }
 
-    cout << "City not found!" << endl;
+    if (sorted)
+    {
+        stable_sort(results.begin(), results.end(),
+                    [](const CityDistance &a, const CityDistance &b) { return a.distance < b.distance; });
+    }
+    return true;
 }
 
 /**
- *  Searches for a city and outputs a specific attribute.
+ * Displays the distance from one city to every other city, optionally sorted or limited to a radius.
  */
-void CityManager::searchCityAttribute(const string &name, const string &region, const string &attribute) const
+void CityManager::showDistancesFrom(const string &name, const string &region, double maxDistance, bool sorted) const
 {
-    string lowerName = toLowerCase(name);
-    string lowerRegion = toLowerCase(region);
-    City *current = findCity(lowerName, lowerRegion);
-    if (current == nullptr)
+    vector<CityDistance> results;
+    if (!distancesFrom(name, region, results, maxDistance, sorted))
     {
-        cout << "City not found!" << endl;
+        cout << "City '" << name << "' in region '" << region << "' not found!" << endl;
+        suggestAlternatives(name, region);
         return;
     }
-
-    // Output the requested attribute
-    if (attribute == "name")
-    {
-        cout << "Name: " << current->name << endl;
-    }
-    else if (attribute == "region")
-    {
-        cout << "Region: " << current->region << endl;
-    }
-    else if (attribute == "population")
-    {
-        cout << "Population: " << current->population << endl;
-    }
-    else if (attribute == "year")
-    {
-        cout << "Year: " << current->year << endl;
-    }
-    else if (attribute == "mayorname")
-    {
-        cout << "Mayor's Name: " << current->mayorName << endl;
-    }
-    else if (attribute == "mayoraddress")
+    if (results.empty())
     {
-        cout << "Mayor's Address: " << current->mayorAddress << endl;
-    }
-    else if (attribute == "latitude")
-    {
-        cout << "Latitude: " << current->latitude << endl;
+        cout << "No other cities found within the specified distance." << endl;
+        return;
     }
-    else if (attribute == "longitude")
+
+    printDistances(results);
+}
+
+/**
+ * Converts (squared chord length, ID) pairs from the spatial index into distances.
+ */
+void CityManager::toCityDistances(const vector<pair<double, uint32_t>> &matches, const City *exclude,
+                                  vector<CityDistance> &results) const
+{
+    results.clear();
+    results.reserve(matches.size());
+    for (const auto &[chord, id] : matches)
     {
-        cout << "Longitude: " << current->longitude << endl;
+        if (store.rows[id] != exclude)
+        {
+            results.push_back({store.rows[id], chordSquaredToKm(chord)});
+        }
     }
-    else if (attribute == "history")
+}
+
+/**
+ * Prints one line per city with its distance.
+ */
+void CityManager::printDistances(const vector<CityDistance> &results) const
+{
+    for (const CityDistance &result : results)
     {
-        cout << "History: " << current->history << endl;
+        cout << result.city->name << ", " << *result.city->region << ": " << result.distance << " km" << endl;
     }
-    else
+}
+
+/**
+ * Finds the k cities nearest to a point, nearest first, optionally skipping one city.
+ */
+void CityManager::nearestTo(double latitude, double longitude, size_t k, vector<CityDistance> &results,
+                            const City *exclude) const
+{
+    vector<pair<double, uint32_t>> matches;
+    grid.queryNearest(store, latitude, longitude, exclude != nullptr ? k + 1 : k, matches);
+    toCityDistances(matches, exclude, results);
+    if (results.size() > k)
     {
-        cout << "Attribute not found!" << endl;
+        results.resize(k);
     }
 }
 
 /**
- * Sorts the cities based on a specified attribute using Merge Sort.
+ * Finds all cities within maxDistance km of a point, nearest first, optionally skipping one city.
  */
-void CityManager::sortCities(const string &sortAttribute)
+void CityManager::withinRadius(double latitude, double longitude, double maxDistance, vector<CityDistance> &results,
+                               const City *exclude) const
 {
-    mergeSort(&head, sortAttribute);
-    cout << "Cities sorted by " << sortAttribute << " successfully!" << endl;
+    vector<pair<double, uint32_t>> matches;
+    grid.queryRadius(store, latitude, longitude, maxDistance, matches);
+    sort(matches.begin(), matches.end());
+    toCityDistances(matches, exclude, results);
 }
 
 /**
- * Filters and displays cities based on population range.
+ * Displays the k cities nearest to a city.
  */
-void CityManager::filterCitiesByPopulation(int minPopulation, int maxPopulation) const
+void CityManager::showNearest(const string &name, const string &region, size_t k) const
 {
-    if (head == nullptr)
+    const City *origin = findCity(name, region);
+    if (origin == nullptr)
     {
-        cout << "No cities available." << endl;
+        cout << "City '" << name << "' in region '" << region << "' not found!" << endl;
+        suggestAlternatives(name, region);
         return;
     }
-
-    City *current = head;
-    bool found = false;
-    while (current != nullptr)
+    vector<CityDistance> results;
+    nearestTo(store.latitude[origin->id], store.longitude[origin->id], k, results, origin);
+    if (results.empty())
     {
-        if (current->population >= minPopulation && current->population <= maxPopulation)
-        {
-            cout << "City: " << current->name << ", Region: " << current->region
-                 << ", Population: " << current->population << ", Year: " << current->year
-                 << ", Mayor: " << current->mayorName << ", History: " << current->history
-                 << ", Latitude: " << current->latitude << ", Longitude: " << current->longitude << endl;
-            found = true;
-        }
-        current = current->next;
+        cout << "No other cities available." << endl;
+        return;
     }
+    printDistances(results);
+}
 
-    if (!found)
+/**
+ * Displays the k cities nearest to a point.
+ */
+void CityManager::showNearest(double latitude, double longitude, size_t k) const
+{
+    vector<CityDistance> results;
+    nearestTo(latitude, longitude, k, results);
+    if (results.empty())
     {
-        cout << "No cities found within the specified population range." << endl;
+        cout << "No cities available." << endl;
+        return;
     }
+    printDistances(results);
 }
 
 /**
- * Filters and displays cities based on region.
+ * Displays all cities within maxDistance km of a city.
  */
-void CityManager::filterCitiesByRegion(const string &region) const
+void CityManager::showWithin(const string &name, const string &region, double maxDistance) const
 {
-    if (head == nullptr)
+    const City *origin = findCity(name, region);
+    if (origin == nullptr)
     {
-        cout << "No cities available." << endl;
+        cout << "City '" << name << "' in region '" << region << "' not found!" << endl;
+        suggestAlternatives(name, region);
         return;
     }
-
-    string targetRegion = toLowerCase(region);
-    City *current = head;
-    bool found = false;
-    while (current != nullptr)
+    vector<CityDistance> results;
+    withinRadius(store.latitude[origin->id], store.longitude[origin->id], maxDistance, results, origin);
+    if (results.empty())
     {
-        if (equalsIgnoreCase(current->region, targetRegion))
-        {
-            cout << "City: " << current->name << ", Region: " << current->region
-                 << ", Population: " << current->population << ", Year: " << current->year
-                 << ", Mayor: " << current->mayorName << ", History: " << current->history
-                 << ", Latitude: " << current->latitude << ", Longitude: " << current->longitude << endl;
-            found = true;
-        }
-        current = current->next;
+        cout << "No other cities found within the specified distance." << endl;
+        return;
     }
+    printDistances(results);
+}
 
-    if (!found)
+/**
+ * Displays all cities within maxDistance km of a point.
+ */
+void CityManager::showWithin(double latitude, double longitude, double maxDistance) const
+{
+    vector<CityDistance> results;
+    withinRadius(latitude, longitude, maxDistance, results);
+    if (results.empty())
     {
-        cout << "No cities found in the specified region." << endl;
+        cout << "No cities found within the specified distance." << endl;
+        return;
     }
+    printDistances(results);
 }
 
 /**
- *  Displays statistical summaries of the cities.
+ *  Deletes a city by name and region.
  */
-void CityManager::showStatistics() const
+bool CityManager::deleteCity(const string &name, const string &region)
 {
     if (head == nullptr)
     {
-        cout << "No cities available to display statistics." << endl;
-        return;
+        cout << "No cities available to delete." << endl;
+        return false;
     }
 
-    int count = 0;
-    long totalPopulation = 0;
-    int minPopulation = numeric_limits<int>::max();
-    int maxPopulation = numeric_limits<int>::min();
-    long totalYear = 0;
-    double totalLatitude = 0.0;
-    double totalLongitude = 0.0;
-
-    City *current = head;
-    while (current != nullptr)
+    City *toDelete = findCity(name, region);
+    if (toDelete == nullptr)
     {
-        count++;
-        totalPopulation += current->population;
-        if (current->population < minPopulation)
-            minPopulation = current->population;
-        if (current->population > maxPopulation)
-            maxPopulation = current->population;
-        totalYear += current->year;
-        totalLatitude += current->latitude;
-        totalLongitude += current->longitude;
-        current = current->next;
+        cout << "City not found!" << endl;
+        suggestAlternatives(name, region);
+        return false;
     }
-
-    double averagePopulation = static_cast<double>(totalPopulation) / count;
-    double averageYear = static_cast<double>(totalYear) / count;
-    double averageLatitude = totalLatitude / count;
-    double averageLongitude = totalLongitude / count;
-
-    cout << "----- Statistical Summary -----" << endl;
-    cout << "Total Number of Cities: " << count << endl;
-    cout << "Average Population: " << averagePopulation << endl;
-    cout << "Minimum Population: " << minPopulation << endl;
-    cout << "Maximum Population: " << maxPopulation << endl;
-    cout << "Average Year Recorded: " << averageYear << endl;
-    cout << "Average Latitude: " << averageLatitude << endl;
-    cout << "Average Longitude: " << averageLongitude << endl;
-    cout << "-------------------------------" << endl;
+    JournalEntry entry;
+    entry.operation = JournalOperation::Delete;
+    entry.city.name = toDelete->name;
+    entry.city.region = *toDelete->region;
+    removeCity(toDelete);
+    journalChange(entry);
+    status() << "City deleted successfully!" << endl;
+    return true;
 }
 
 /**
- *  Modifies a specific attribute of a city.
+ *  Searches for a city and outputs a specific attribute.
  */
-void CityManager::modifyCityAttribute(const string &name, const string &region, const string &attribute)
+void CityManager::searchCityAttribute(const string &name, const string &region, const string &attribute) const
 {
     string lowerName = toLowerCase(name);
     string lowerRegion = toLowerCase(region);
@@ -480,212 +751,2104 @@ void CityManager::modifyCityAttribute(const string &name, const string &region,
     if (current == nullptr)
     {
         cout << "City not found!" << endl;
+        suggestAlternatives(name, region);
         return;
     }
 
-    // Modify the requested attribute
-    if (attribute == "name")
+    // Output the requested attribute
+    const FieldDescriptor *field = findField(attribute);
+    if (field == nullptr)
     {
-        string newName = InputHandler::getLineInput("Enter the new name: ");
-        if (newName.empty())
-        {
-            cout << "Name cannot be empty. Modification aborted." << endl;
-            return;
-        }
-        current->name = toLowerCase(newName);
-        cout << "Name updated successfully!" << endl;
+        cout << "Attribute not found!" << endl;
+        return;
     }
-    else if (attribute == "region")
-    {
-        string newRegion = InputHandler::getLineInput("Enter the new region: ");
-        if (newRegion.empty())
-        {
-            cout << "Region cannot be empty. Modification aborted." << endl;
-            return;
+    cout << field->heading << ": ";
+    visitField(field->field, [this, current](auto index) { cout << fieldValue<index>(store, current->id); });
+    cout << endl;
+}
+
+/**
+ * Lists cities in the order of an attribute from now on ("none" restores insertion order).
+ */
+void CityManager::sortCities(const string &attribute, bool descending)
+{
+    sortCities(vector<SortKey>{{attribute, descending}});
+}
+
+/**
+ * Lists cities by several attributes from now on, each key breaking the ties of the one
+ * before it. A single attribute with an ordered index is read from that index; any other
+ * order is materialized by sortListing. An unknown single attribute falls back to name;
+ * an unknown key in a longer list leaves the order unchanged and returns false.
+ */
+bool CityManager::sortCities(const vector<SortKey> &keys)
+{
+    if (keys.empty() || (keys.size() == 1 && keys[0].attribute == "none"))
+    {
+        sortKeys.clear();
+        sortedIds = vector<uint32_t>();
+        status() << "Cities are listed in insertion order." << endl;
+        return true;
+    }
+
+    vector<SortKey> chosen = keys;
+    if (keys.size() == 1 && findField(keys[0].attribute) == nullptr)
+    {
+        cout << "Invalid sort attribute. Sorting by name by default." << endl;
+        chosen[0].attribute = "name";
+    }
+    for (const SortKey &key : chosen)
+    {
+        if (findField(key.attribute) == nullptr)
+        {
+            cout << "Invalid sort attribute '" << key.attribute << "'. The listing order is unchanged." << endl;
+            return false;
+        }
+    }
+    sortKeys = move(chosen);
+    sortedIds = vector<uint32_t>();
+    listingSorted = false;
+    bool reversed;
+    listingIds(reversed);
+
+    // A single key is reported as given; a list names the direction of each descending key
+    string description;
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        description += (i > 0 ? ", " : "") + keys[i].attribute;
+        if (keys.size() > 1 && keys[i].descending)
+            description += " desc";
+    }
+    status() << "Cities sorted by " << description << " successfully!" << endl;
+    return true;
+}
+
+/**
+ * Returns the keys cities are listed by, or none for insertion order.
+ */
+const vector<SortKey> &CityManager::listingKeys() const
+{
+    return sortKeys;
+}
+
+/**
+ * Rebuilds sortedIds. Each city's sort keys are encoded into one binary-comparable key,
+ * so a radix sort orders the cities in O(n * key length) without comparing attributes.
+ * Cities are encoded in insertion order and the sort is stable, so ties keep that order.
+ */
+void CityManager::sortListing() const
+{
+    vector<uint32_t> ids;
+    ids.reserve(store.size());
+    for (const City *current = head; current != nullptr; current = current->next)
+    {
+        ids.push_back(current->id);
+    }
+
+    vector<pair<CityField, bool>> fields;
+    for (const SortKey &key : sortKeys)
+    {
+        fields.emplace_back(findField(key.attribute)->field, key.descending);
+    }
+
+    NormalizedKeys keys;
+    keys.reserve(ids.size(), fields.size() * SORT_KEY_BYTES);
+    for (uint32_t id : ids)
+    {
+        for (const pair<CityField, bool> &field : fields)
+        {
+            const bool descending = field.second;
+            visitField(field.first, [this, &keys, id, descending](auto index)
+                       {
+                           constexpr FieldType TYPE = CITY_FIELDS[index].type;
+                           if constexpr (TYPE == FieldType::Integer)
+                               keys.appendInteger(fieldValue<index>(store, id), descending);
+                           else if constexpr (TYPE == FieldType::Real)
+                               keys.appendReal(fieldValue<index>(store, id), descending);
+                           else
+                               keys.appendText(fieldValue<index>(store, id), descending);
+                       });
+        }
+        keys.endRow();
+    }
+
+    vector<uint32_t> order;
+    keys.sort(order);
+    sortedIds.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        sortedIds[i] = ids[order[i]];
+    }
+    listingSorted = true;
+}
+
+/**
+ * Returns true if record a is listed before record b in an order sortListing materializes:
+ * by each sort key in turn, then in insertion order, as the stable radix sort leaves ties.
+ */
+bool CityManager::listedBefore(uint32_t a, uint32_t b) const
+{
+    for (const SortKey &key : sortKeys)
+    {
+        int order = 0;
+        visitField(findField(key.attribute)->field, [this, a, b, &order](auto index)
+                   {
+                       auto valueA = fieldValue<index>(store, a);
+                       auto valueB = fieldValue<index>(store, b);
+                       order = valueA < valueB ? -1 : valueB < valueA ? 1 : 0;
+                   });
+        if (order != 0)
+            return key.descending ? order > 0 : order < 0;
+    }
+    return linkSequence[a] < linkSequence[b];
+}
+
+/**
+ * Sorts record IDs into the current listing order, for listings that gather a few matches
+ * from an index instead of walking every city.
+ */
+void CityManager::sortByListing(vector<uint32_t> &ids) const
+{
+    if (sortKeys.empty())
+    {
+        sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) { return linkSequence[a] < linkSequence[b]; });
+        return;
+    }
+    const FieldDescriptor *field = findField(sortKeys[0].attribute);
+    if (sortKeys.size() == 1 && field->ordered)
+    {
+        // Read from the attribute's index: by (value, record ID), both reversed when descending
+        const bool descending = sortKeys[0].descending;
+        visitField(field->field, [this, &ids, descending](auto index)
+                   {
+                       constexpr size_t I = index;
+                       sort(ids.begin(), ids.end(), [this, descending](uint32_t a, uint32_t b)
+                            {
+                                auto valueA = fieldValue<I>(store, a);
+                                auto valueB = fieldValue<I>(store, b);
+                                if (valueA != valueB)
+                                    return descending ? valueB < valueA : valueA < valueB;
+                                return descending ? b < a : a < b;
+                            });
+                   });
+        return;
+    }
+    sort(ids.begin(), ids.end(), [this](uint32_t a, uint32_t b) { return listedBefore(a, b); });
+}
+
+/**
+ * Inserts a record into sortedIds at its listing position, if sortedIds is built, so a
+ * single change costs a binary search and a shift rather than a full re-sort.
+ */
+void CityManager::listCity(uint32_t id)
+{
+    if (!listingSorted)
+        return;
+    auto position = lower_bound(sortedIds.begin(), sortedIds.end(), id,
+                                [this](uint32_t listed, uint32_t added) { return listedBefore(listed, added); });
+    sortedIds.insert(position, id);
+}
+
+/**
+ * Removes a record from sortedIds, if it is built. The record's sort keys must still be
+ * the ones it was listed by.
+ */
+void CityManager::unlistCity(uint32_t id)
+{
+    if (!listingSorted)
+        return;
+    auto position = lower_bound(sortedIds.begin(), sortedIds.end(), id,
+                                [this](uint32_t listed, uint32_t removed) { return listedBefore(listed, removed); });
+    if (position != sortedIds.end() && *position == id)
+        sortedIds.erase(position);
+    else
+        listingSorted = false;
+}
+
+/**
+ * Returns the record IDs in listing order, to be read backwards if reversed is set, or
+ * nullptr for insertion order. A single key with an ordered index is read from the index.
+ */
+const vector<uint32_t> *CityManager::listingIds(bool &reversed) const
+{
+    reversed = false;
+    if (sortKeys.empty())
+        return nullptr;
+    if (sortKeys.size() == 1)
+    {
+        const vector<uint32_t> *order = orderedBy(sortKeys[0].attribute);
+        if (order != nullptr)
+        {
+            reversed = sortKeys[0].descending;
+            return order;
+        }
+    }
+    if (!listingSorted)
+        sortListing();
+    return &sortedIds;
+}
+
+/**
+ * Filters and displays cities based on population range, in the given format and window.
+ */
+void CityManager::filterCitiesByPopulation(int minPopulation, int maxPopulation, const OutputOptions &output) const
+{
+    if (head == nullptr)
+    {
+        cout << "No cities available." << endl;
+        return;
+    }
+
+    // The population index gives the exact number of matches in O(log n)
+    orderedBy("population");
+    auto [first, last] = populationIndex.range(minPopulation, maxPopulation);
+    ResultWriter writer(cout, output);
+    if (output.countOnly)
+    {
+        writer.writeCount(last - first);
+        return;
+    }
+
+    // Rows are listed in the current listing order. A narrow band gathers and sorts just its
+    // k IDs, O(log n + k log k); a wide one is cheaper as a predicate pass over the column.
+    const size_t slots = store.capacity();
+    if ((last - first) * WIDE_RANGE_FRACTION < store.size())
+    {
+        const vector<uint32_t> &ids = populationIndex.orderedIds();
+        vector<uint32_t> matches(ids.begin() + first, ids.begin() + last);
+        sortByListing(matches);
+        for (uint32_t id : matches)
+        {
+            if (!writeCity(writer, store.rows[id]))
+                break;
+        }
+    }
+    else
+    {
+        // One branch-free pass marks the matches; the listing walk then prints them in order
+        const int *population = store.population.data();
+        const unsigned char *live = store.live.data();
+        vector<unsigned char> matches(slots);
+        for (size_t id = 0; id < slots; ++id)
+        {
+            matches[id] = live[id] & (population[id] >= minPopulation) & (population[id] <= maxPopulation);
+        }
+        forEachCity([this, &writer, &matches](const City *city)
+                    { return !matches[city->id] || writeCity(writer, city); });
+    }
+
+    if (writer.matchedRows() == 0 && output.format == OutputFormat::Table)
+    {
+        cout << "No cities found within the specified population range." << endl;
+    }
+}
+
+/**
+ * Filters and displays cities based on region, in the given format and window.
+ */
+void CityManager::filterCitiesByRegion(const string &region, const OutputOptions &output) const
+{
+    if (head == nullptr)
+    {
+        cout << "No cities available." << endl;
+        return;
+    }
+
+    // One dictionary lookup finds the region's posting list, in record ID order
+    static const vector<uint32_t> NO_CITIES;
+    const uint32_t regionId = regions.find(toLowerCase(region));
+    const vector<uint32_t> &ids = regionId == RegionDictionary::NONE ? NO_CITIES : regions.cities(regionId);
+    ResultWriter writer(cout, output);
+    if (output.countOnly)
+    {
+        writer.writeCount(ids.size());
+        return;
+    }
+
+    // Rows are listed in the current listing order: a small region sorts its k IDs by
+    // listing position, a large one is cheaper to pick out of a walk over the listing
+    if (ids.size() * WIDE_RANGE_FRACTION < store.size())
+    {
+        vector<uint32_t> matches(ids);
+        sortByListing(matches);
+        for (uint32_t id : matches)
+        {
+            if (!writeCity(writer, store.rows[id]))
+                break;
+        }
+    }
+    else
+    {
+        forEachCity([this, &writer, regionId](const City *city)
+                    { return city->regionId != regionId || writeCity(writer, city); });
+    }
+
+    if (writer.matchedRows() == 0 && output.format == OutputFormat::Table)
+    {
+        cout << "No cities found in the specified region." << endl;
+    }
+}
+
+/**
+ * Displays the cities matching a text search, in record ID order and the given format and window.
+ * Every word is looked up once and the lists are intersected from the rarest up, so the
+ * work follows the rarest word; phrases are checked against the text of the cities left.
+ */
+void CityManager::searchText(const TextQuery &query, const OutputOptions &output) const
+{
+    if (head == nullptr)
+    {
+        cout << "No cities available." << endl;
+        return;
+    }
+
+    // One lookup per word, phrase words included, each with the clause it came from
+    const TextIndex &index = textIndexed();
+    vector<pair<size_t, pair<const string *, const TextQuery::Clause *>>> lookups;
+    for (const TextQuery::Clause &clause : query.clauses)
+    {
+        for (const string &word : clause.words)
+            lookups.push_back({index.estimate(word, clause.prefix), {&word, &clause}});
+    }
+    sort(lookups.begin(), lookups.end(),
+         [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    vector<uint32_t> matches, wordMatches, both;
+    bool first = true;
+    for (const auto &[estimate, lookup] : lookups)
+    {
+        if (!first && matches.empty())
+            break;
+        const auto &[word, clause] = lookup;
+        index.matches(*word, clause->prefix, clause->fields, wordMatches);
+        if (first)
+        {
+            matches.swap(wordMatches);
+            first = false;
+            continue;
+        }
+        both.clear();
+        set_intersection(matches.begin(), matches.end(), wordMatches.begin(), wordMatches.end(),
+                         back_inserter(both));
+        matches.swap(both);
+    }
+
+    // Every word of a phrase is present; keep the cities that have them in sequence in one field
+    for (const TextQuery::Clause &clause : query.clauses)
+    {
+        if (clause.words.size() < 2)
+            continue;
+        auto lacksPhrase = [this, &clause](uint32_t id)
+        {
+            const City &city = *store.rows[id];
+            auto inField = [&clause](uint8_t field, const string &text)
+            { return (clause.fields & field) && TextIndex::containsPhrase(text, clause.words); };
+            return !inField(HISTORY_FIELD, city.history) && !inField(MAYOR_NAME_FIELD, city.mayorName) &&
+                   !inField(MAYOR_ADDRESS_FIELD, city.mayorAddress);
+        };
+        matches.erase(remove_if(matches.begin(), matches.end(), lacksPhrase), matches.end());
+    }
+
+    ResultWriter writer(cout, output);
+    if (output.countOnly)
+    {
+        writer.writeCount(matches.size());
+        return;
+    }
+    for (uint32_t id : matches)
+    {
+        if (!writeCity(writer, store.rows[id]))
+            break;
+    }
+
+    if (writer.matchedRows() == 0 && output.format == OutputFormat::Table)
+    {
+        cout << "No cities match the search." << endl;
+    }
+}
+
+/**
+ * Returns how many typing mistakes a name lookup of a given length tolerates.
+ */
+static int typoAllowance(size_t length)
+{
+    if (length <= 2)
+        return 0;
+    return length <= 5 ? 1 : 2;
+}
+
+/**
+ * Prints the cities a name and region that was not found may have meant: cities with a
+ * name within a few typing mistakes of it, those in the given region first.
+ */
+void CityManager::suggestAlternatives(const string &name, const string &region) const
+{
+    const string lowerName = toLowerCase(name);
+    const uint32_t regionId = regions.find(toLowerCase(region));
+    vector<NameSuggestion> names;
+    namesIndexed().similar(lowerName, typoAllowance(lowerName.size()), false, MISS_SUGGESTIONS, names);
+    if (names.empty())
+        return;
+
+    // Rank each city by the edits to its name, plus one if it is in another region
+    vector<pair<int, const City *>> cities;
+    orderedBy("name");
+    const vector<uint32_t> &ids = nameIndex.orderedIds();
+    for (const NameSuggestion &suggestion : names)
+    {
+        auto [first, last] = nameIndex.range(suggestion.name, suggestion.name);
+        for (size_t i = first; i < last; ++i)
+        {
+            const City *city = store.rows[ids[i]];
+            cities.emplace_back(suggestion.distance + (city->regionId == regionId ? 0 : 1), city);
+        }
+    }
+    stable_sort(cities.begin(), cities.end(),
+                [](const auto &a, const auto &b) { return a.first < b.first; });
+    if (cities.size() > MISS_SUGGESTIONS)
+        cities.resize(MISS_SUGGESTIONS);
+
+    cout << "Did you mean:" << endl;
+    for (const auto &[rank, city] : cities)
+    {
+        cout << "  " << city->name << " (" << *city->region << ")" << endl;
+    }
+}
+
+/**
+ * Lists up to limit city names starting with prefix, followed by names close to it if
+ * there are fewer, each with the regions it is found in.
+ */
+void CityManager::suggestCities(const string &prefix, size_t limit) const
+{
+    const string lowerPrefix = toLowerCase(prefix);
+    const NameTrie &trie = namesIndexed();
+    vector<NameSuggestion> names;
+    trie.complete(lowerPrefix, limit, names);
+    const size_t completions = names.size();
+    if (completions < limit)
+    {
+        // Every completion was found, so the close matches start after them
+        vector<NameSuggestion> close;
+        trie.similar(lowerPrefix, typoAllowance(lowerPrefix.size()), true, limit, close);
+        for (NameSuggestion &suggestion : close)
+        {
+            if (suggestion.distance > 0)
+                names.push_back(move(suggestion));
+        }
+    }
+    if (names.empty())
+    {
+        cout << "No city names match '" << prefix << "'." << endl;
+        return;
+    }
+
+    // Names are shown with the first few of their regions
+    const size_t shownRegions = 3;
+    orderedBy("name");
+    const vector<uint32_t> &ids = nameIndex.orderedIds();
+    for (size_t n = 0; n < names.size(); ++n)
+    {
+        if (n == completions)
+            cout << "Similar names:" << endl;
+        auto [first, last] = nameIndex.range(names[n].name, names[n].name);
+        cout << names[n].name << " (";
+        for (size_t i = first; i < last && i < first + shownRegions; ++i)
+        {
+            cout << (i == first ? "" : ", ") << *store.rows[ids[i]]->region;
+        }
+        if (last - first > shownRegions)
+            cout << " and " << last - first - shownRegions << " more";
+        cout << ")" << endl;
+    }
+}
+
+/**
+ * Resolves the region names of a condition to dictionary IDs, so each test is an integer compare.
+ */
+void CityManager::bindRegions(QueryCondition &condition) const
+{
+    if (condition.kind == QueryCondition::Kind::Region)
+        condition.regionId = regions.find(condition.text);
+    for (QueryCondition &child : condition.children)
+        bindRegions(child);
+}
+
+/**
+ * Returns the record IDs of the index that answers a predicate, with the matching entries
+ * at positions [first, last). Returns nullptr for predicates without an ordered index.
+ */
+const vector<uint32_t> *CityManager::indexRange(const QueryCondition &condition, size_t &first, size_t &last) const
+{
+    static const vector<uint32_t> NO_CITIES;
+    first = last = 0;
+    switch (condition.kind)
+    {
+    case QueryCondition::Kind::Range:
+    {
+        const vector<uint32_t> *ids = nullptr;
+        visitField(condition.field, [this, &condition, &ids, &first, &last](auto index)
+                   {
+                       if constexpr (CITY_FIELDS[index].ordered && CITY_FIELDS[index].type != FieldType::Text)
+                       {
+                           using Key = decltype(fieldValue<index>(store, 0));
+                           const auto &sorted = builtIndex<index>();
+                           ids = &sorted.orderedIds();
+                           if (condition.low <= condition.high)
+                               tie(first, last) = sorted.range(static_cast<Key>(condition.low),
+                                                               static_cast<Key>(condition.high));
+                       }
+                   });
+        return ids;
+    }
+    case QueryCondition::Kind::Region:
+    {
+        const vector<uint32_t> &ids = condition.regionId == RegionDictionary::NONE ? NO_CITIES
+                                                                                   : regions.cities(condition.regionId);
+        last = ids.size();
+        return &ids;
+    }
+    case QueryCondition::Kind::Name:
+        orderedBy("name");
+        tie(first, last) = nameIndex.range(condition.text, condition.text);
+        return &nameIndex.orderedIds();
+    case QueryCondition::Kind::NamePrefix:
+        orderedBy("name");
+        tie(first, last) = nameIndex.prefixRange(condition.text);
+        return &nameIndex.orderedIds();
+    default:
+        return nullptr;
+    }
+}
+
+/**
+ * Chooses how to find the cities that may match a condition. Every predicate has an index
+ * whose match count is known in O(log n): and reads the candidates of its most selective
+ * operand and tests the rest, or reads the union of every operand's candidates.
+ */
+QueryPlan CityManager::planCondition(const QueryCondition &condition) const
+{
+    QueryPlan plan;
+    plan.estimate = store.size();
+    switch (condition.kind)
+    {
+    case QueryCondition::Kind::All:
+        return plan;
+    case QueryCondition::Kind::And:
+    {
+        bool indexed = false;
+        for (const QueryCondition &child : condition.children)
+        {
+            QueryPlan option = planCondition(child);
+            if (option.access == QueryPlan::Access::Empty)
+                return option;
+            if (option.access != QueryPlan::Access::Scan && (!indexed || option.estimate < plan.estimate))
+            {
+                plan = move(option);
+                indexed = true;
+            }
+        }
+        return plan;
+    }
+    case QueryCondition::Kind::Or:
+    {
+        QueryPlan merged;
+        merged.access = QueryPlan::Access::Union;
+        for (const QueryCondition &child : condition.children)
+        {
+            QueryPlan option = planCondition(child);
+            if (option.access == QueryPlan::Access::Scan)
+                return plan;
+            if (option.access == QueryPlan::Access::Empty)
+                continue;
+            merged.estimate += option.estimate;
+            merged.branches.push_back(move(option));
+        }
+        if (merged.branches.empty())
+            merged.access = QueryPlan::Access::Empty;
+        else if (merged.branches.size() == 1)
+            return move(merged.branches[0]);
+        merged.estimate = min(merged.estimate, store.size());
+        return merged;
+    }
+    case QueryCondition::Kind::Radius:
+    {
+        // The spatial grid finds the matches; the latitude band around the centre bounds their number
+        const double degrees = condition.distance / EARTH_RADIUS_KM * 180.0 / M_PI;
+        orderedBy("latitude");
+        auto [first, last] = latitudeIndex.range(condition.latitude - degrees, condition.latitude + degrees);
+        plan.access = first < last ? QueryPlan::Access::Index : QueryPlan::Access::Empty;
+        plan.driver = &condition;
+        plan.estimate = last - first;
+        return plan;
+    }
+    default:
+    {
+        size_t first, last;
+        indexRange(condition, first, last);
+        plan.access = first < last ? QueryPlan::Access::Index : QueryPlan::Access::Empty;
+        plan.driver = &condition;
+        plan.estimate = last - first;
+        return plan;
+    }
+    }
+}
+
+/**
+ * Plans a whole query. As with a wide population filter, reading a large share of the
+ * cities through an index costs more than one predicate pass over the columns.
+ */
+QueryPlan CityManager::planQuery(const QueryCondition &where) const
+{
+    QueryPlan plan = planCondition(where);
+    if (plan.access != QueryPlan::Access::Empty && plan.estimate * WIDE_RANGE_FRACTION >= store.size())
+    {
+        QueryPlan scan;
+        scan.estimate = store.size();
+        return scan;
+    }
+    return plan;
+}
+
+/**
+ * Appends the record IDs a plan reads from its indexes. A union may append a city more than once.
+ */
+void CityManager::collectCandidates(const QueryPlan &plan, vector<uint32_t> &ids) const
+{
+    if (plan.access == QueryPlan::Access::Union)
+    {
+        for (const QueryPlan &branch : plan.branches)
+            collectCandidates(branch, ids);
+        return;
+    }
+    if (plan.access != QueryPlan::Access::Index)
+        return;
+    if (plan.driver->kind == QueryCondition::Kind::Radius)
+    {
+        vector<pair<double, uint32_t>> matches;
+        grid.queryRadius(store, plan.driver->latitude, plan.driver->longitude, plan.driver->distance, matches);
+        for (const auto &match : matches)
+            ids.push_back(match.second);
+        return;
+    }
+    size_t first, last;
+    const vector<uint32_t> *order = indexRange(*plan.driver, first, last);
+    ids.insert(ids.end(), order->begin() + first, order->begin() + last);
+}
+
+/**
+ * Returns true if a city satisfies a condition.
+ */
+bool CityManager::matchesCondition(const QueryCondition &condition, uint32_t id) const
+{
+    const City *city = store.rows[id];
+    switch (condition.kind)
+    {
+    case QueryCondition::Kind::All:
+        return true;
+    case QueryCondition::Kind::And:
+        return all_of(condition.children.begin(), condition.children.end(),
+                      [this, id](const QueryCondition &child) { return matchesCondition(child, id); });
+    case QueryCondition::Kind::Or:
+        return any_of(condition.children.begin(), condition.children.end(),
+                      [this, id](const QueryCondition &child) { return matchesCondition(child, id); });
+    case QueryCondition::Kind::Range:
+    {
+        double value = numericValue(condition.field, store, id);
+        return condition.low <= value && value <= condition.high;
+    }
+    case QueryCondition::Kind::Region:
+        return city->regionId == condition.regionId;
+    case QueryCondition::Kind::Name:
+        return city->name == condition.text;
+    case QueryCondition::Kind::NamePrefix:
+        return city->name.compare(0, condition.text.size(), condition.text) == 0;
+    case QueryCondition::Kind::Radius:
+    {
+        double dx = store.unitX[id] - condition.unitX;
+        double dy = store.unitY[id] - condition.unitY;
+        double dz = store.unitZ[id] - condition.unitZ;
+        return dx * dx + dy * dy + dz * dz <= condition.chordLimit;
+    }
+    }
+    return false;
+}
+
+/**
+ * Evaluates a condition over every record ID, one branch-free pass per column, leaving 1
+ * in matches for each match. Free record IDs are not masked out here.
+ */
+void CityManager::scanCondition(const QueryCondition &condition, vector<unsigned char> &matches) const
+{
+    const size_t slots = store.capacity();
+    matches.assign(slots, 0);
+    auto markRange = [&matches, slots](const auto *column, auto low, auto high)
+    {
+        for (size_t id = 0; id < slots; ++id)
+            matches[id] = (column[id] >= low) & (column[id] <= high);
+    };
+
+    switch (condition.kind)
+    {
+    case QueryCondition::Kind::All:
+        fill(matches.begin(), matches.end(), 1);
+        break;
+    case QueryCondition::Kind::And:
+    case QueryCondition::Kind::Or:
+    {
+        const bool both = condition.kind == QueryCondition::Kind::And;
+        vector<unsigned char> part;
+        scanCondition(condition.children[0], matches);
+        for (size_t i = 1; i < condition.children.size(); ++i)
+        {
+            scanCondition(condition.children[i], part);
+            for (size_t id = 0; id < slots; ++id)
+                matches[id] = both ? (matches[id] & part[id]) : (matches[id] | part[id]);
+        }
+        break;
+    }
+    case QueryCondition::Kind::Range:
+        if (condition.low > condition.high)
+            break;
+        visitField(condition.field, [this, &condition, &markRange](auto index)
+                   {
+                       constexpr const FieldDescriptor &field = CITY_FIELDS[index];
+                       if constexpr (field.type == FieldType::Integer)
+                           markRange((store.*field.integers).data(), static_cast<int>(condition.low),
+                                     static_cast<int>(condition.high));
+                       else if constexpr (field.type == FieldType::Real)
+                           markRange((store.*field.reals).data(), condition.low, condition.high);
+                   });
+        break;
+    case QueryCondition::Kind::Region:
+    case QueryCondition::Kind::Name:
+    case QueryCondition::Kind::NamePrefix:
+        for (size_t id = 0; id < slots; ++id)
+            matches[id] = store.rows[id] != nullptr && matchesCondition(condition, static_cast<uint32_t>(id));
+        break;
+    case QueryCondition::Kind::Radius:
+    {
+        const double *x = store.unitX.data();
+        const double *y = store.unitY.data();
+        const double *z = store.unitZ.data();
+        for (size_t id = 0; id < slots; ++id)
+        {
+            double dx = x[id] - condition.unitX;
+            double dy = y[id] - condition.unitY;
+            double dz = z[id] - condition.unitZ;
+            matches[id] = dx * dx + dy * dy + dz * dz <= condition.chordLimit;
+        }
+        break;
+    }
+    }
+}
+
+/**
+ * Calls visit with a comparator that puts record IDs in the query's result order: by the
+ * order attribute, ties broken by record ID, with a descending order reversing both as
+ * sort ... desc lists them. Without an order attribute it is record order.
+ */
+template <typename Visitor>
+void CityManager::withResultOrder(const CityQuery &query, Visitor visit) const
+{
+    auto byKey = [&query, &visit](auto key)
+    {
+        visit([&query, key](uint32_t a, uint32_t b)
+              {
+                  auto keyA = key(a);
+                  auto keyB = key(b);
+                  if (keyA != keyB)
+                      return query.descending ? keyB < keyA : keyA < keyB;
+                  return query.descending ? b < a : a < b;
+              });
+    };
+    const FieldDescriptor *field = query.orderBy.empty() ? nullptr : findField(query.orderBy);
+    if (field == nullptr)
+    {
+        byKey([](uint32_t id) { return id; });
+        return;
+    }
+    visitField(field->field, [this, &byKey](auto index)
+               {
+                   constexpr size_t I = index;
+                   if constexpr (CITY_FIELDS[I].ordered)
+                       byKey([this](uint32_t id) { return fieldValue<I>(store, id); });
+               });
+}
+
+/**
+ * Runs a planned query, leaving at most query.limit matching record IDs in result order.
+ * A scan tests every city with column passes. For an ordered query it then walks the
+ * order's index so a limit stops it early; if that index is not built, a limited query
+ * keeps its first rows in a bounded heap instead, in O(n log k) without sorting every city.
+ * An index plan tests only its candidates and sorts just the ones it keeps.
+ */
+void CityManager::selectMatches(const CityQuery &query, const QueryPlan &plan, vector<uint32_t> &matches) const
+{
+    if (plan.access == QueryPlan::Access::Empty || query.limit == 0)
+        return;
+
+    if (plan.access == QueryPlan::Access::Scan)
+    {
+        vector<unsigned char> selected;
+        scanCondition(query.where, selected);
+        const unsigned char *live = store.live.data();
+        auto take = [&](uint32_t id)
+        {
+            if (selected[id] & live[id])
+                matches.push_back(id);
+            return matches.size() < query.limit;
+        };
+        if (!query.orderBy.empty() && !isOrdered(query.orderBy) && query.limit < store.size())
+        {
+            // The heap's front is the last row kept, replaced whenever a row comes before it
+            withResultOrder(query, [&](auto before)
+                            {
+                                for (uint32_t id = 0; id < store.capacity(); ++id)
+                                {
+                                    if (!(selected[id] & live[id]))
+                                        continue;
+                                    if (matches.size() < query.limit)
+                                    {
+                                        matches.push_back(id);
+                                        push_heap(matches.begin(), matches.end(), before);
+                                    }
+                                    else if (before(id, matches.front()))
+                                    {
+                                        pop_heap(matches.begin(), matches.end(), before);
+                                        matches.back() = id;
+                                        push_heap(matches.begin(), matches.end(), before);
+                                    }
+                                }
+                                sort_heap(matches.begin(), matches.end(), before);
+                            });
+            return;
+        }
+        const vector<uint32_t> *order = query.orderBy.empty() ? nullptr : orderedBy(query.orderBy);
+        if (order == nullptr)
+        {
+            for (uint32_t id = 0; id < store.capacity() && take(id); ++id)
+            {
+            }
+        }
+        else if (query.descending)
+        {
+            for (auto it = order->rbegin(); it != order->rend() && take(*it); ++it)
+            {
+            }
+        }
+        else
+        {
+            for (auto it = order->begin(); it != order->end() && take(*it); ++it)
+            {
+            }
+        }
+        return;
+    }
+
+    collectCandidates(plan, matches);
+    if (plan.access == QueryPlan::Access::Union)
+    {
+        sort(matches.begin(), matches.end());
+        matches.erase(unique(matches.begin(), matches.end()), matches.end());
+    }
+    // The driving predicate already holds for every candidate; test whatever else the condition asks
+    if (plan.driver != &query.where)
+    {
+        matches.erase(remove_if(matches.begin(), matches.end(),
+                                [this, &query](uint32_t id) { return !matchesCondition(query.where, id); }),
+                      matches.end());
+    }
+
+    const size_t keep = min(query.limit, matches.size());
+    withResultOrder(query, [&](auto before)
+                    { partial_sort(matches.begin(), matches.begin() + keep, matches.end(), before); });
+    matches.resize(keep);
+}
+
+/**
+ * Displays the cities matching a query, in the given format and window.
+ */
+void CityManager::runQuery(const CityQuery &query, const OutputOptions &output) const
+{
+    if (head == nullptr)
+    {
+        cout << "No cities available." << endl;
+        return;
+    }
+
+    CityQuery bound = query;
+    bindRegions(bound.where);
+    QueryPlan plan = planQuery(bound.where);
+    vector<uint32_t> matches;
+    selectMatches(bound, plan, matches);
+
+    ResultWriter writer(cout, output);
+    if (output.countOnly)
+    {
+        writer.writeCount(matches.size());
+        return;
+    }
+    for (uint32_t id : matches)
+    {
+        if (!writeCity(writer, store.rows[id]))
+            break;
+    }
+
+    if (writer.matchedRows() == 0 && output.format == OutputFormat::Table)
+    {
+        cout << "No cities match the query." << endl;
+    }
+}
+
+/**
+ * Prints the access paths of a plan, one per line, indented by depth.
+ */
+void CityManager::describePlan(const QueryPlan &plan, int depth) const
+{
+    const string indent(2 * depth, ' ');
+    if (plan.access == QueryPlan::Access::Union)
+    {
+        cout << indent << "union of " << plan.branches.size() << " index lookups (~" << plan.estimate << " cities)" << endl;
+        for (const QueryPlan &branch : plan.branches)
+            describePlan(branch, depth + 1);
+        return;
+    }
+    const QueryCondition &driver = *plan.driver;
+    string source;
+    if (driver.kind == QueryCondition::Kind::Range)
+        source = driver.attribute + " index";
+    else if (driver.kind == QueryCondition::Kind::Region)
+        source = "region posting list";
+    else if (driver.kind == QueryCondition::Kind::Radius)
+        source = "spatial grid";
+    else
+        source = "name index";
+    cout << indent << source << ": " << CityQuery::describe(driver) << " (~" << plan.estimate << " cities)" << endl;
+}
+
+/**
+ * Displays the plan the query planner picks for a query, without running it.
+ */
+void CityManager::explainQuery(const CityQuery &query) const
+{
+    CityQuery bound = query;
+    bindRegions(bound.where);
+    QueryPlan best = planCondition(bound.where);
+    QueryPlan plan = planQuery(bound.where);
+    const string direction = query.descending ? " desc" : " asc";
+    const string limit = query.limit == numeric_limits<size_t>::max() ? "" : to_string(query.limit);
+
+    cout << "Query: " << CityQuery::describe(bound.where);
+    if (!query.orderBy.empty())
+        cout << " order by " << query.orderBy << direction;
+    if (!limit.empty())
+        cout << " limit " << limit;
+    cout << endl;
+    cout << "Cities: " << store.size() << endl;
+    cout << "Plan:" << endl;
+
+    switch (plan.access)
+    {
+    case QueryPlan::Access::Empty:
+        cout << "  empty: an index shows that no city can match" << endl;
+        return;
+    case QueryPlan::Access::Scan:
+        if (best.access == QueryPlan::Access::Index || best.access == QueryPlan::Access::Union)
+            cout << "  column scan: the best index matches ~" << best.estimate << " of " << store.size()
+                 << " cities, too many to read one by one" << endl;
+        else if (bound.where.kind == QueryCondition::Kind::All)
+            cout << "  column scan: every city matches" << endl;
+        else
+            cout << "  column scan: no index narrows the condition" << endl;
+        if (query.orderBy.empty())
+            cout << "  order: record order" << (limit.empty() ? "" : ", stop after " + limit + " matches") << endl;
+        else if (!isOrdered(query.orderBy) && query.limit < store.size())
+            cout << "  order: keep the first " << limit << " by " << query.orderBy << direction
+                 << " in a bounded heap (the " << query.orderBy << " index is not built)" << endl;
+        else
+            cout << "  order: walk the " << query.orderBy << " index" << direction
+                 << (limit.empty() ? "" : ", stop after " + limit + " matches") << endl;
+        return;
+    default:
+        describePlan(plan, 1);
+        if (plan.driver != &bound.where)
+            cout << "  filter: " << CityQuery::describe(bound.where) << endl;
+        cout << "  order: sort candidates by " << (query.orderBy.empty() ? "record order" : query.orderBy + direction)
+             << (limit.empty() ? "" : ", keep " + limit) << endl;
+        return;
+    }
+}
+
+/**
+ * Reads the aggregates from the running column totals and the population index, without
+ * visiting any city. The index is built on first use and kept up to date after that.
+ */
+CityStatistics CityManager::currentStatistics() const
+{
+    const ColumnTotals &totals = store.totals();
+    const vector<uint32_t> &byPopulation = *orderedBy("population");
+    CityStatistics statistics;
+    statistics.count = store.size();
+    statistics.totalPopulation = totals.population;
+    statistics.minPopulation = store.population[byPopulation.front()];
+    statistics.maxPopulation = store.population[byPopulation.back()];
+    statistics.totalYear = totals.year;
+    statistics.totalLatitude = static_cast<double>(totals.latitude);
+    statistics.totalLongitude = static_cast<double>(totals.longitude);
+    return statistics;
+}
+
+/**
+ * Recomputes the aggregates with a full pass over the columns.
+ */
+CityStatistics CityManager::scanStatistics() const
+{
+    // Free record IDs hold zeros, so sums run over whole columns; min/max mask them out
+    const size_t slots = store.capacity();
+    const int *population = store.population.data();
+    const int *year = store.year.data();
+    const double *latitude = store.latitude.data();
+    const double *longitude = store.longitude.data();
+    const unsigned char *live = store.live.data();
+
+    CityStatistics statistics;
+    size_t liveCount = 0;
+    int minPopulation = numeric_limits<int>::max();
+    int maxPopulation = numeric_limits<int>::min();
+    long long totalPopulation = 0;
+    long long totalYear = 0;
+    for (size_t id = 0; id < slots; ++id)
+    {
+        liveCount += live[id];
+        totalPopulation += population[id];
+        totalYear += year[id];
+        minPopulation = min(minPopulation, live[id] ? population[id] : numeric_limits<int>::max());
+        maxPopulation = max(maxPopulation, live[id] ? population[id] : numeric_limits<int>::min());
+    }
+
+    double totalLatitude = 0.0;
+    double totalLongitude = 0.0;
+    for (size_t id = 0; id < slots; ++id)
+    {
+        totalLatitude += latitude[id];
+        totalLongitude += longitude[id];
+    }
+
+    statistics.count = liveCount;
+    statistics.totalPopulation = totalPopulation;
+    statistics.minPopulation = minPopulation;
+    statistics.maxPopulation = maxPopulation;
+    statistics.totalYear = totalYear;
+    statistics.totalLatitude = totalLatitude;
+    statistics.totalLongitude = totalLongitude;
+    return statistics;
+}
+
+/**
+ *  Displays statistical summaries of the cities. With verify, the running aggregates are
+ *  also recomputed from scratch and any difference is reported; returns false if there is one.
+ */
+bool CityManager::showStatistics(bool verify) const
+{
+    if (head == nullptr)
+    {
+        cout << "No cities available to display statistics." << endl;
+        return true;
+    }
+
+    const CityStatistics statistics = currentStatistics();
+    const double count = static_cast<double>(statistics.count);
+    double averagePopulation = static_cast<double>(statistics.totalPopulation) / count;
+    double averageYear = static_cast<double>(statistics.totalYear) / count;
+    double averageLatitude = statistics.totalLatitude / count;
+    double averageLongitude = statistics.totalLongitude / count;
+
+    cout << "----- Statistical Summary -----" << endl;
+    cout << "Total Number of Cities: " << statistics.count << endl;
+    cout << "Average Population: " << averagePopulation << endl;
+    cout << "Minimum Population: " << statistics.minPopulation << endl;
+    cout << "Maximum Population: " << statistics.maxPopulation << endl;
+    cout << "Average Year Recorded: " << averageYear << endl;
+    cout << "Average Latitude: " << averageLatitude << endl;
+    cout << "Average Longitude: " << averageLongitude << endl;
+    cout << "-------------------------------" << endl;
+
+    if (!verify)
+        return true;
+
+    // Integer aggregates must match exactly; coordinate sums may differ by rounding only
+    const CityStatistics scanned = scanStatistics();
+    const double tolerance = 1e-9 * 180.0 * count;
+    int mismatches = 0;
+    auto check = [&mismatches](const char *label, auto incremental, auto recomputed, bool equal)
+    {
+        if (!equal)
+        {
+            cout << "Mismatch in " << label << ": running " << incremental << ", recomputed " << recomputed << endl;
+            mismatches++;
+        }
+    };
+    check("count", statistics.count, scanned.count, statistics.count == scanned.count);
+    check("total population", statistics.totalPopulation, scanned.totalPopulation,
+          statistics.totalPopulation == scanned.totalPopulation);
+    check("minimum population", statistics.minPopulation, scanned.minPopulation,
+          statistics.minPopulation == scanned.minPopulation);
+    check("maximum population", statistics.maxPopulation, scanned.maxPopulation,
+          statistics.maxPopulation == scanned.maxPopulation);
+    check("total year", statistics.totalYear, scanned.totalYear, statistics.totalYear == scanned.totalYear);
+    check("total latitude", statistics.totalLatitude, scanned.totalLatitude,
+          fabs(statistics.totalLatitude - scanned.totalLatitude) <= tolerance);
+    check("total longitude", statistics.totalLongitude, scanned.totalLongitude,
+          fabs(statistics.totalLongitude - scanned.totalLongitude) <= tolerance);
+    if (mismatches == 0)
+        cout << "Verified against a full recompute: all statistics match." << endl;
+    return mismatches == 0;
+}
+
+/**
+ * Aggregates the cities by region ID or year. The record IDs are split into pieces that a
+ * pool of worker threads takes one at a time; each worker adds its cities into its own hash
+ * table, and the tables are merged once every piece is done, so workers share nothing.
+ */
+void CityManager::groupStatistics(const string &attribute, unordered_map<int64_t, GroupStatistics> &groups) const
+{
+    const size_t slots = store.capacity();
+    const size_t pieces = max<size_t>(1, (slots + GROUP_CHUNK_ROWS - 1) / GROUP_CHUNK_ROWS);
+    const size_t workers = min<size_t>(max(1u, thread::hardware_concurrency()), pieces);
+    vector<unordered_map<int64_t, GroupStatistics>> partial(workers);
+
+    auto aggregate = [&](auto keyOf)
+    {
+        atomic<size_t> nextPiece(0);
+        auto work = [&](unordered_map<int64_t, GroupStatistics> &local)
+        {
+            for (size_t piece = nextPiece++; piece < pieces; piece = nextPiece++)
+            {
+                const size_t last = min(slots, (piece + 1) * GROUP_CHUNK_ROWS);
+                for (size_t id = piece * GROUP_CHUNK_ROWS; id < last; ++id)
+                {
+                    if (!store.live[id])
+                        continue;
+                    GroupStatistics &group = local[keyOf(id)];
+                    const int population = store.population[id];
+                    group.count++;
+                    group.totalPopulation += population;
+                    group.minPopulation = min(group.minPopulation, population);
+                    group.maxPopulation = max(group.maxPopulation, population);
+                    group.totalX += store.unitX[id];
+                    group.totalY += store.unitY[id];
+                    group.totalZ += store.unitZ[id];
+                }
+            }
+        };
+        vector<thread> pool;
+        for (size_t i = 1; i < workers; ++i)
+            pool.emplace_back(work, ref(partial[i]));
+        work(partial[0]);
+        for (thread &worker : pool)
+            worker.join();
+    };
+    if (attribute == "region")
+        aggregate([this](size_t id) { return static_cast<int64_t>(store.rows[id]->regionId); });
+    else
+        aggregate([this](size_t id) { return static_cast<int64_t>(store.year[id]); });
+
+    groups = move(partial[0]);
+    for (size_t i = 1; i < workers; ++i)
+    {
+        for (const auto &[key, part] : partial[i])
+        {
+            GroupStatistics &group = groups[key];
+            group.count += part.count;
+            group.totalPopulation += part.totalPopulation;
+            group.minPopulation = min(group.minPopulation, part.minPopulation);
+            group.maxPopulation = max(group.maxPopulation, part.maxPopulation);
+            group.totalX += part.totalX;
+            group.totalY += part.totalY;
+            group.totalZ += part.totalZ;
         }
-        current->region = toLowerCase(newRegion);
-        cout << "Region updated successfully!" << endl;
     }
-    else if (attribute == "population")
+}
+
+/**
+ * Displays the count, population aggregates and centroid of the cities in each region
+ * (by name) or year (in order). The centroid is the direction of the mean unit-sphere
+ * position, so a region spanning the 180th meridian is centred on it rather than near 0.
+ * Returns false for any other attribute.
+ */
+bool CityManager::showGroupStatistics(const string &attribute) const
+{
+    if (attribute != "region" && attribute != "year")
+        return false;
+    if (head == nullptr)
+    {
+        cout << "No cities available to display statistics." << endl;
+        return true;
+    }
+
+    unordered_map<int64_t, GroupStatistics> groups;
+    groupStatistics(attribute, groups);
+    const bool byRegion = attribute == "region";
+    vector<pair<int64_t, const GroupStatistics *>> rows;
+    rows.reserve(groups.size());
+    for (const auto &[key, group] : groups)
+        rows.emplace_back(key, &group);
+    auto label = [this, byRegion](int64_t key)
+    { return byRegion ? *regions.name(static_cast<uint32_t>(key)) : to_string(key); };
+    if (byRegion)
+        sort(rows.begin(), rows.end(), [&label](const auto &a, const auto &b) { return label(a.first) < label(b.first); });
+    else
+        sort(rows.begin(), rows.end());
+
+    // Columns are laid out in a stream of their own so the width and precision set here never
+    // touch cout, which concurrent sessions share
+    ostringstream table;
+    table << "----- Statistics by " << (byRegion ? "Region" : "Year") << " -----" << endl;
+    table << left << setw(24) << (byRegion ? "Region" : "Year") << right << setw(10) << "Cities" << setw(16)
+          << "Total Pop." << setw(14) << "Average Pop." << setw(12) << "Min Pop." << setw(12) << "Max Pop."
+          << setw(13) << "Centre Lat." << setw(13) << "Centre Lon." << endl;
+    for (const auto &[key, group] : rows)
+    {
+        const double latitude = atan2(group->totalZ, hypot(group->totalX, group->totalY)) * 180.0 / M_PI;
+        const double longitude = atan2(group->totalY, group->totalX) * 180.0 / M_PI;
+        table << left << setw(24) << label(key) << right << setw(10) << group->count << setw(16)
+              << group->totalPopulation << setw(14) << fixed << setprecision(0)
+              << static_cast<double>(group->totalPopulation) / static_cast<double>(group->count) << setw(12)
+              << group->minPopulation << setw(12) << group->maxPopulation << setprecision(4) << setw(13) << latitude
+              << setw(13) << longitude << defaultfloat << endl;
+    }
+    cout << table.str();
+    cout << groups.size() << (byRegion ? " regions" : " years") << endl;
+    cout << "-------------------------------" << endl;
+    return true;
+}
+
+/**
+ * Displays memory used by city nodes, columns and the region dictionary.
+ */
+void CityManager::showMemoryUsage() const
+{
+    const size_t cities = store.size();
+    const size_t columnBytes = store.capacity() * (sizeof(City *) + 2 * sizeof(int) + 5 * sizeof(double) + 1);
+
+    // What per-city region strings would have cost: the string object beyond the
+    // pointer that replaced it, plus a heap block whenever the value is too long for
+    // the small-string buffer
+    const size_t inlineCapacity = string().capacity();
+    size_t regionBytesSaved = cities * (sizeof(string) - sizeof(const string *));
+    for (const City *city : store.rows)
+    {
+        if (city != nullptr && city->region->size() > inlineCapacity)
+            regionBytesSaved += city->region->size() + 1;
+    }
+
+    cout << "----- Memory Usage -----" << endl;
+    cout << "Cities: " << cities << endl;
+    cout << "City node slabs: " << arena.slabCount() << " (" << arena.reservedBytes() / 1024 << " KB, "
+         << sizeof(City) << " bytes per node)" << endl;
+    cout << "Numeric columns: " << columnBytes / 1024 << " KB" << endl;
+    cout << "Region dictionary: " << regions.size() << " regions (" << regions.characters() << " characters)" << endl;
+    cout << "Saved by region encoding: " << regionBytesSaved / 1024 << " KB" << endl;
+    if (textIndex.isBuilt())
+        cout << "Text index: " << textIndex.size() << " words (" << textIndex.bytes() / 1024 << " KB)" << endl;
+    if (nameTrie.isBuilt())
+        cout << "Name trie: " << nameTrie.size() << " names (" << nameTrie.bytes() / 1024 << " KB)" << endl;
+    cout << "------------------------" << endl;
+}
+
+/**
+ *  Modifies a specific attribute of a city, prompting for the new value.
+ */
+void CityManager::modifyCityAttribute(const string &name, const string &region, const string &attribute)
+{
+    if (findCity(name, region) == nullptr)
+    {
+        cout << "City not found!" << endl;
+        suggestAlternatives(name, region);
+        return;
+    }
+
+    // Prompt for the new value of the requested attribute
+    const FieldDescriptor *field = findField(attribute);
+    if (field == nullptr)
+    {
+        cout << "Attribute not found!" << endl;
+        return;
+    }
+    const string prompt(field->prompt);
+    string value;
+    if (field->type == FieldType::Integer)
+        value = to_string(InputHandler::getValidatedInt(prompt, static_cast<int>(field->minimum),
+                                                        static_cast<int>(field->maximum)));
+    else if (field->type == FieldType::Real)
+        value = formatDouble(InputHandler::getValidatedDouble(prompt, field->minimum, field->maximum));
+    else
+        value = InputHandler::getLineInput(prompt);
+    setCityAttribute(name, region, attribute, value);
+}
+
+/**
+ * Sets an attribute of a city to a value given as text, without prompting.
+ */
+bool CityManager::setCityAttribute(const string &name, const string &region, const string &attribute, const string &value)
+{
+    City *current = findCity(name, region);
+    if (current == nullptr)
+    {
+        cout << "City not found!" << endl;
+        suggestAlternatives(name, region);
+        return false;
+    }
+
+    // Record the change under the key the city had before it
+    JournalEntry entry;
+    entry.operation = JournalOperation::Set;
+    entry.city.name = current->name;
+    entry.city.region = *current->region;
+    string message;
+    if (!applyAttribute(current, attribute, value, message))
+    {
+        cout << message << endl;
+        return false;
+    }
+    entry.attribute = attribute;
+    entry.value = value;
+    journalChange(entry);
+    status() << message << endl;
+    return true;
+}
+
+/**
+ * Applies a new attribute value to a city, keeping every index in sync.
+ * Sets message to the outcome and returns false if the value is rejected.
+ */
+bool CityManager::applyAttribute(City *current, const string &attribute, const string &value, string &message)
+{
+    // Parses the whole value as a number within [minimum, maximum]
+    auto parseValue = [&value](auto &number, double minimum, double maximum)
+    {
+        auto result = from_chars(value.data(), value.data() + value.size(), number);
+        return result.ec == errc() && result.ptr == value.data() + value.size() &&
+               number >= minimum && number <= maximum;
+    };
+
+    const FieldDescriptor *field = findField(attribute);
+    if (field == nullptr)
+    {
+        message = "Attribute not found!";
+        return false;
+    }
+
+    // Text must not be empty; numbers must be whole values within the field's range
+    const string description(field->description);
+    int integer = 0;
+    double real = 0.0;
+    if (field->type == FieldType::Text && value.empty())
     {
-        const int MAX_POPULATION = 40000000;
-        int newPopulation = InputHandler::getValidatedInt("Enter the new population: ", 1, MAX_POPULATION);
-        current->population = newPopulation;
-        cout << "Population updated successfully!" << endl;
+        message = description + " cannot be empty. Modification aborted.";
+        return false;
     }
-    else if (attribute == "year")
+    if ((field->type == FieldType::Integer && !parseValue(integer, field->minimum, field->maximum)) ||
+        (field->type == FieldType::Real && !parseValue(real, field->minimum, field->maximum)))
     {
-        int newYear = InputHandler::getYearInput("Enter the new year (4-digit year): ");
-        current->year = newYear;
-        cout << "Year updated successfully!" << endl;
+        message = "Invalid " + toLowerCase(description) + ". Modification aborted.";
+        return false;
     }
-    else if (attribute == "mayorname")
+
+    // A new name or region must not collide with another city. A region that is not in the
+    // dictionary yet holds no city to collide with; it is only added once the move is
+    // accepted, so a rejected one leaves no empty entry behind
+    if (field->field == CityField::Name)
     {
-        string newMayorName = InputHandler::getLineInput("Enter the new mayor's name: ");
-        if (newMayorName.empty())
+        const string lowerNewName = toLowerCase(value);
+        if (lowerNewName != current->name && findInRegion(lowerNewName, current->regionId))
         {
-            cout << "Mayor's name cannot be empty. Modification aborted." << endl;
-            return;
+            message = "A city with that name already exists in this region. Modification aborted.";
+            return false;
         }
-        current->mayorName = toLowerCase(newMayorName);
-        cout << "Mayor's name updated successfully!" << endl;
     }
-    else if (attribute == "mayoraddress")
+    if (field->field == CityField::Region)
     {
-        string newMayorAddress = InputHandler::getLineInput("Enter the new mayor's address: ");
-        if (newMayorAddress.empty())
+        const uint32_t existing = regions.find(toLowerCase(value));
+        if (existing != RegionDictionary::NONE && existing != current->regionId &&
+            findInRegion(current->name, existing))
         {
-            cout << "Mayor's address cannot be empty. Modification aborted." << endl;
-            return;
+            message = "A city with that name already exists in that region. Modification aborted.";
+            return false;
         }
-        current->mayorAddress = toLowerCase(newMayorAddress);
-        cout << "Mayor's address updated successfully!" << endl;
     }
-    else if (attribute == "latitude")
+
+    // A city whose sort key changes moves in the listing: take it out while it still has its old value
+    const bool relisted = any_of(sortKeys.begin(), sortKeys.end(),
+                                 [field](const SortKey &key) { return key.attribute == field->name; });
+    if (relisted)
+        unlistCity(current->id);
+
+    switch (field->field)
+    {
+    case CityField::Name:
     {
-        double newLatitude = InputHandler::getLatitudeInput("Enter the new latitude (between -90 and 90): ");
-        current->latitude = newLatitude;
-        cout << "Latitude updated successfully!" << endl;
+        const string lowerNewName = toLowerCase(value);
+        cityIndex.erase(makeKey(current->name, current->regionId));
+        nameIndex.erase(current->name, current->id);
+        nameTrie.remove(current->name);
+        current->name = lowerNewName;
+        cityIndex[makeKey(current->name, current->regionId)] = current;
+        nameIndex.insert(current->name, current->id);
+        nameTrie.add(current->name);
+        break;
     }
-    else if (attribute == "longitude")
+    case CityField::Region:
     {
-        double newLongitude = InputHandler::getLongitudeInput("Enter the new longitude (between -180 and 180): ");
-        current->longitude = newLongitude;
-        cout << "Longitude updated successfully!" << endl;
+        const uint32_t newRegion = regions.intern(toLowerCase(value));
+        cityIndex.erase(makeKey(current->name, current->regionId));
+        regions.remove(current->regionId, current->id);
+        current->regionId = newRegion;
+        current->region = regions.name(newRegion);
+        cityIndex[makeKey(current->name, current->regionId)] = current;
+        regions.add(current->regionId, current->id);
+        break;
     }
-    else if (attribute == "history")
+    case CityField::Population:
+        populationIndex.erase(store.population[current->id], current->id);
+        store.setPopulation(current->id, integer);
+        populationIndex.insert(integer, current->id);
+        break;
+    case CityField::Year:
+        yearIndex.erase(store.year[current->id], current->id);
+        store.setYear(current->id, integer);
+        yearIndex.insert(integer, current->id);
+        break;
+    case CityField::MayorName:
+    case CityField::MayorAddress:
+    case CityField::History:
+        // Text the word index covers
+        textIndex.remove(*current);
+        current->*field->text = toLowerCase(value);
+        textIndex.add(*current);
+        break;
+    case CityField::Latitude:
+        moveCity(current, real, store.longitude[current->id]);
+        break;
+    case CityField::Longitude:
+        moveCity(current, store.latitude[current->id], real);
+        break;
+    }
+    if (relisted)
+        listCity(current->id);
+    message = description + " updated successfully!";
+    return true;
+}
+
+/**
+ * Appends a change to the journal, if one is open, and to the change log, if one is set.
+ */
+void CityManager::journalChange(const JournalEntry &entry)
+{
+    if (journal.isOpen())
+        journal.append(entry);
+    if (changeLog != nullptr)
+        changeLog->push_back(entry);
+}
+
+/**
+ * Re-applies one journaled change. Replay is quiet and idempotent: an add replaces any
+ * existing city and changes to a city that no longer exists are ignored.
+ */
+void CityManager::applyJournalEntry(JournalEntry &entry)
+{
+    CityRecord &record = entry.city;
+    City *existing = findCity(record.name, record.region);
+    switch (entry.operation)
     {
-        string newHistory = InputHandler::getLineInput("Enter the new history: ");
-        if (newHistory.empty())
+    case JournalOperation::Add:
+        if (existing != nullptr)
+            removeCity(existing);
+        appendCity(createCity(record), record.population, record.year, record.latitude, record.longitude);
+        break;
+    case JournalOperation::Delete:
+        if (existing != nullptr)
+            removeCity(existing);
+        break;
+    case JournalOperation::Set:
+        if (existing != nullptr)
         {
-            cout << "History cannot be empty. Modification aborted." << endl;
-            return;
+            string message;
+            applyAttribute(existing, entry.attribute, entry.value, message);
         }
-        current->history = toLowerCase(newHistory);
-        cout << "History updated successfully!" << endl;
+        break;
     }
-    else
+}
+
+/**
+ * Opens the journal of a data file and replays the changes made since its last checkpoint.
+ */
+bool CityManager::openJournal(const string &filename)
+{
+    dataFilename = filename;
+    vector<JournalEntry> entries;
+    size_t discardedBytes = 0;
+    string error;
+    if (!journal.open(filename + ".journal", entries, discardedBytes, error))
     {
-        cout << "Attribute not found!" << endl;
+        cerr << "Error: " << error << endl;
+        return false;
+    }
+    for (JournalEntry &entry : entries)
+    {
+        if (changeLog != nullptr)
+            changeLog->push_back(entry);
+        applyJournalEntry(entry);
     }
+    if (!entries.empty())
+        status() << "Recovered " << entries.size() << " change(s) from the journal." << endl;
+    if (discardedBytes > 0)
+        status() << "Discarded " << discardedBytes << " byte(s) of an incomplete journal record." << endl;
+    baseFileBytes = fileSize(filename);
+    return true;
 }
 
 /**
- *  Saves the cities to a file.
+ * Makes journaled changes durable, compacting the journal into the data file once it
+ * has grown to a sizeable fraction of it.
  */
-void CityManager::saveToFile(const string &filename) const
+void CityManager::commitJournal()
 {
-    ofstream outFile(filename);
-    if (!outFile)
+    if (!journal.isOpen())
+        return;
+    if (!journal.commit())
     {
-        cerr << "Error: Could not open file " << filename << endl;
+        cerr << "Error: Could not write journal " << journal.filename() << endl;
         return;
     }
+    if (journal.size() >= max(COMPACT_MIN_BYTES, baseFileBytes / 2))
+        checkpoint();
+}
 
-    City *current = head;
-    while (current != nullptr)
+/**
+ * Rewrites the data file with every change and empties the journal.
+ */
+bool CityManager::checkpoint()
+{
+    if (journal.isOpen() && !journal.commit())
+    {
+        cerr << "Error: Could not write journal " << journal.filename() << endl;
+        return false;
+    }
+    string error;
+    if (!writeDataFile(dataFilename, error))
     {
-        // Enclose string fields in double quotes and escape existing quotes by doubling them
-        outFile << escapeQuotes(current->name) << ","
-                << escapeQuotes(current->region) << ","
-                << current->population << ","
-                << current->year << ","
-                << escapeQuotes(current->mayorName) << ","
-                << escapeQuotes(current->mayorAddress) << ","
-                << escapeQuotes(current->history) << ","
-                << current->latitude << ","
-                << current->longitude << endl;
-        current = current->next;
+        cerr << "Error: " << error << endl;
+        return false;
     }
-    outFile.close();
-    cout << "Cities saved to file successfully!" << endl;
+    // The data file now holds every change, so a crash before the reset only replays them again
+    if (!journal.reset())
+    {
+        cerr << "Error: Could not reset journal " << journal.filename() << endl;
+        return false;
+    }
+    baseFileBytes = fileSize(dataFilename);
+    return true;
 }
 
 /**
- *  Loads cities from a file.
+ * Returns the size of a file in bytes, or 0 if it cannot be read.
  */
-void CityManager::loadFromFile(const string &filename)
+uint64_t CityManager::fileSize(const string &filename)
 {
-    ifstream inFile(filename);
-    if (!inFile)
+    struct stat info;
+    if (stat(filename.c_str(), &info) != 0)
+        return 0;
+    return static_cast<uint64_t>(info.st_size);
+}
+
+/**
+ * Returns true if a file name selects the binary snapshot format (a ".snap" extension).
+ */
+bool CityManager::isSnapshotName(const string &filename)
+{
+    const string extension = ".snap";
+    return filename.size() >= extension.size() &&
+           equalsIgnoreCase(filename.substr(filename.size() - extension.size()), extension);
+}
+
+/**
+ *  Saves the cities to a file, as a binary snapshot if the name ends in ".snap".
+ */
+void CityManager::saveToFile(const string &filename) const
+{
+    if (isSnapshotName(filename))
     {
-        cerr << "Error: Could not open file " << filename << endl;
+        saveSnapshot(filename);
+        return;
+    }
+
+    string error;
+    if (!writeDataFile(filename, error))
+    {
+        cerr << "Error: " << error << endl;
         return;
     }
+    status() << "Cities saved to file successfully!" << endl;
+}
+
+/**
+ * Writes every city to a data file in the format its name selects. The file is written
+ * under a temporary name, synced and renamed into place, so a crash leaves either the
+ * old or the new contents.
+ */
+bool CityManager::writeDataFile(const string &filename, string &error) const
+{
+    if (isSnapshotName(filename))
+        return writeSnapshot(filename, error);
 
-    string line;
-    while (getline(inFile, line))
+    string temporary = filename + ".tmp";
     {
-        // Parse CSV line considering quoted fields
-        stringstream ss(line);
-        string field;
-        string fields[9]; // There are 9 attributes
+        ofstream outFile(temporary, ios::trunc);
+        if (!outFile)
+        {
+            error = "Could not open file " + temporary;
+            return false;
+        }
 
-        for (int i = 0; i < 9; ++i)
+        forEachCity([this, &outFile](const City *current)
         {
-            if (ss.peek() == '"')
-            {
-                // Quoted field
-                ss.ignore(); // Ignore the opening quote
-                getline(ss, field, '"');
-                ss.ignore(); // Ignore the closing quote
-                // Ignore the comma after the closing quote
-                if (i < 8 && ss.peek() == ',')
-                    ss.ignore();
-            }
-            else
-            {
-                // Unquoted field
-                getline(ss, field, ',');
-            }
-            fields[i] = trim(field);
+            // Enclose string fields in double quotes and escape existing quotes by doubling them;
+            // coordinates are written in full so they read back unchanged
+            outFile << escapeQuotes(current->name) << ","
+                    << escapeQuotes(*current->region) << ","
+                    << store.population[current->id] << ","
+                    << store.year[current->id] << ","
+                    << escapeQuotes(current->mayorName) << ","
+                    << escapeQuotes(current->mayorAddress) << ","
+                    << escapeQuotes(current->history) << ","
+                    << formatDouble(store.latitude[current->id]) << ","
+                    << formatDouble(store.longitude[current->id]) << '\n';
+        });
+        if (!outFile.flush())
+        {
+            error = "Could not write file " + temporary;
+            return false;
         }
+    }
+    if (!replaceFileDurably(temporary, filename))
+    {
+        error = "Could not replace file " + filename;
+        return false;
+    }
+    return true;
+}
 
-        // Convert numeric fields
-        int population = 0, year = 0;
-        double latitude = 0.0, longitude = 0.0;
+/**
+ * Parses one CSV line of the data file into a record.
+ * Quoted fields may contain commas and doubled quotes; unparsable numbers become 0.
+ */
+void CityManager::parseRecord(string_view line, CityRecord &record)
+{
+    string fields[9]; // There are 9 attributes
+    size_t pos = 0;
+    for (int i = 0; i < 9; ++i)
+    {
+        string &field = fields[i];
+        while (pos < line.size() && (line[pos] == ' ' || line[pos] == '\t'))
+            pos++;
 
-        try
+        if (pos < line.size() && line[pos] == '"')
         {
-            population = stoi(fields[2]);
+            // Quoted field, where "" stands for a literal quote
+            pos++;
+            while (pos < line.size())
+            {
+                size_t quote = line.find('"', pos);
+                if (quote == string_view::npos)
+                {
+                    field.append(line.substr(pos));
+                    pos = line.size();
+                    break;
+                }
+                field.append(line.substr(pos, quote - pos));
+                pos = quote + 1;
+                if (pos < line.size() && line[pos] == '"')
+                {
+                    field.push_back('"');
+                    pos++;
+                }
+                else
+                {
+                    break;
+                }
+            }
+            // Skip anything up to and including the separating comma
+            size_t comma = line.find(',', pos);
+            pos = (comma == string_view::npos) ? line.size() : comma + 1;
         }
-        catch (...)
+        else
         {
-            population = 0; // Default value or handle error
+            // Unquoted field
+            size_t comma = line.find(',', pos);
+            size_t end = (comma == string_view::npos) ? line.size() : comma;
+            field.assign(line.substr(pos, end - pos));
+            pos = (comma == string_view::npos) ? line.size() : comma + 1;
         }
+        field = trim(field);
+    }
+
+    record.name = move(fields[0]);
+    record.region = move(fields[1]);
+    record.mayorName = move(fields[4]);
+    record.mayorAddress = move(fields[5]);
+    record.history = move(fields[6]);
+    toLowerInPlace(record.name);
+    toLowerInPlace(record.region);
+    toLowerInPlace(record.mayorName);
+    toLowerInPlace(record.mayorAddress);
+    toLowerInPlace(record.history);
+
+    // Convert numeric fields, defaulting to 0 when a field is not a number
+    const string &populationField = fields[2];
+    const string &yearField = fields[3];
+    const string &latitudeField = fields[7];
+    const string &longitudeField = fields[8];
+    record.population = 0;
+    record.year = 0;
+    record.latitude = 0.0;
+    record.longitude = 0.0;
+    from_chars(populationField.data(), populationField.data() + populationField.size(), record.population);
+    from_chars(yearField.data(), yearField.data() + yearField.size(), record.year);
+    from_chars(latitudeField.data(), latitudeField.data() + latitudeField.size(), record.latitude);
+    from_chars(longitudeField.data(), longitudeField.data() + longitudeField.size(), record.longitude);
+}
+
+/**
+ * Bulk-loads cities from a CSV file or binary snapshot without prompting, resolving duplicates by policy.
+ * Returns false if the file could not be read or the load was rejected.
+ */
+bool CityManager::loadFromFile(const string &filename, DuplicatePolicy policy)
+{
+    if (SnapshotReader::isSnapshot(filename))
+    {
+        return loadSnapshot(filename, policy);
+    }
+
+    ifstream inFile(filename, ios::binary);
+    if (!inFile)
+    {
+        cerr << "Error: Could not open file " << filename << endl;
+        return false;
+    }
 
-        try
+    // Read the whole file in one block, then parse it from memory in parallel
+    inFile.seekg(0, ios::end);
+    string contents(static_cast<size_t>(inFile.tellg()), '\0');
+    inFile.seekg(0, ios::beg);
+    inFile.read(contents.data(), static_cast<streamsize>(contents.size()));
+    contents.resize(static_cast<size_t>(inFile.gcount()));
+    inFile.close();
+
+    vector<vector<CityRecord>> batches;
+    parseRecords(contents, batches);
+    string().swap(contents);
+
+    // Merge the batches in file order, so duplicates resolve exactly as in a serial load
+    vector<CityRecord *> records;
+    for (vector<CityRecord> &batch : batches)
+    {
+        for (CityRecord &record : batch)
+            records.push_back(&record);
+    }
+
+    if (policy == DuplicatePolicy::Reject)
+    {
+        int duplicates = reportDuplicates(records.size(), [&records](size_t i)
+                                          { return make_pair(records[i]->name, records[i]->region); });
+        if (duplicates > 0)
         {
-            year = stoi(fields[3]);
+            cout << "Load rejected: " << duplicates << " duplicate record(s) found in " << filename << "." << endl;
+            return false;
         }
-        catch (...)
+    }
+
+    prepareBulkLoad(records.size());
+    int loaded = 0;
+    int skipped = 0;
+    int replaced = 0;
+    for (CityRecord *record : records)
+    {
+        if (!resolveDuplicate(record->name, regions.intern(record->region), policy, replaced, skipped))
+            continue;
+        appendCity(createCity(*record), record->population, record->year, record->latitude, record->longitude);
+        loaded++;
+    }
+    reportLoad(loaded, replaced, skipped);
+    return true;
+}
+
+/**
+ * Parses every non-blank line of a piece of the data file, appending the records.
+ */
+void CityManager::parseLines(string_view text, vector<CityRecord> &records)
+{
+    records.reserve(records.size() + count(text.begin(), text.end(), '\n') + 1);
+    size_t start = 0;
+    while (start < text.size())
+    {
+        size_t end = text.find('\n', start);
+        if (end == string_view::npos)
+            end = text.size();
+        string_view line = text.substr(start, end - start);
+        start = end + 1;
+        if (line.find_first_not_of(" \t\r") == string_view::npos)
+            continue; // Skip blank lines
+        records.emplace_back();
+        parseRecord(line, records.back());
+    }
+}
+
+/**
+ * Splits a data file into pieces that end just after a newline and parses them on a pool of
+ * worker threads. Rows never span lines (a newline always ends a row, even inside quotes), so
+ * every newline is a safe boundary and the batches, taken in order, hold the same records a
+ * serial parse would produce. Small files are parsed on the calling thread.
+ */
+void CityManager::parseRecords(const string &contents, vector<vector<CityRecord>> &batches)
+{
+    const size_t hardwareThreads = max(1u, thread::hardware_concurrency());
+    const size_t workers = min(hardwareThreads, max<size_t>(1, contents.size() / PARSE_CHUNK_BYTES));
+    if (workers == 1)
+    {
+        batches.assign(1, {});
+        parseLines(contents, batches[0]);
+        return;
+    }
+
+    // Several pieces per worker, handed out one at a time, even out rows of different lengths
+    const size_t pieces = min(workers * 4, max<size_t>(1, contents.size() / PARSE_CHUNK_BYTES));
+    vector<size_t> bounds(1, 0);
+    for (size_t i = 1; i < pieces; ++i)
+    {
+        size_t cut = max(bounds.back(), contents.size() / pieces * i);
+        size_t newline = contents.find('\n', cut);
+        if (newline == string::npos)
+            break;
+        bounds.push_back(newline + 1);
+    }
+    bounds.push_back(contents.size());
+
+    batches.assign(bounds.size() - 1, {});
+    atomic<size_t> nextPiece(0);
+    auto work = [&contents, &bounds, &batches, &nextPiece]()
+    {
+        for (size_t piece = nextPiece++; piece < batches.size(); piece = nextPiece++)
         {
-            year = 0; // Default value or handle error
+            string_view text(contents.data() + bounds[piece], bounds[piece + 1] - bounds[piece]);
+            parseLines(text, batches[piece]);
         }
+    };
+    vector<thread> pool;
+    for (size_t i = 1; i < workers; ++i)
+        pool.emplace_back(work);
+    work();
+    for (thread &worker : pool)
+        worker.join();
+}
 
-        try
+/**
+ * Reports incoming rows whose (name, region) repeats an earlier row or an existing city.
+ * rowKey(i) returns the name and region of row i. Returns the number of duplicates.
+ */
+template <typename RowKey>
+int CityManager::reportDuplicates(size_t rows, RowKey rowKey) const
+{
+    unordered_map<string, size_t> seen;
+    int duplicates = 0;
+    for (size_t i = 0; i < rows; ++i)
+    {
+        auto [name, region] = rowKey(i);
+        string key = toLowerCase(name);
+        key.push_back('\0');
+        key += toLowerCase(region);
+        auto earlier = seen.find(key);
+        if (earlier != seen.end())
         {
-            latitude = stod(fields[7]);
+            cout << "Duplicate: '" << name << "' in region '" << region
+                 << "' (record " << i + 1 << " repeats record " << earlier->second + 1 << ")" << endl;
+            duplicates++;
         }
-        catch (...)
+        else if (findCity(name, region) != nullptr)
         {
-            latitude = 0.0; // Default value or handle error
+            cout << "Duplicate: '" << name << "' in region '" << region
+                 << "' (record " << i + 1 << " already exists)" << endl;
+            duplicates++;
         }
+        seen.emplace(move(key), i);
+    }
+    return duplicates;
+}
+
+/**
+ * Reserves space for a bulk load; large loads drop the secondary indexes, and every load
+ * the materialized listing, so they are rebuilt in one sort when next needed rather than
+ * updated row by row.
+ */
+void CityManager::prepareBulkLoad(size_t rows)
+{
+    cityIndex.reserve(cityIndex.size() + rows);
+    store.reserve(rows);
+    if (rows > store.size() / 8)
+    {
+        invalidateIndexes();
+    }
+    // One re-sort of the listing costs less than shifting it for every row
+    listingSorted = false;
+}
+
+/**
+ * Applies the duplicate policy to an incoming row; returns true if the row should be inserted.
+ */
+bool CityManager::resolveDuplicate(const string &name, uint32_t region, DuplicatePolicy policy,
+                                   int &replaced, int &skipped)
+{
+    City *existing = findInRegion(name, region);
+    if (existing == nullptr)
+        return true;
+    if (policy == DuplicatePolicy::KeepFirst)
+    {
+        skipped++;
+        return false;
+    }
+    removeCity(existing);
+    replaced++;
+    return true;
+}
+
+/**
+ * Prints the outcome of a bulk load.
+ */
+void CityManager::reportLoad(int loaded, int replaced, int skipped) const
+{
+    ostream &out = status();
+    out << "Cities loaded from file successfully! (" << loaded << " loaded";
+    if (replaced > 0)
+        out << ", " << replaced << " duplicate(s) replaced";
+    if (skipped > 0)
+        out << ", " << skipped << " duplicate(s) skipped";
+    out << ")" << endl;
+}
+
+/**
+ * Loads cities from a memory-mapped binary snapshot, resolving duplicates by policy.
+ */
+bool CityManager::loadSnapshot(const string &filename, DuplicatePolicy policy)
+{
+    SnapshotReader reader;
+    string error;
+    if (!reader.open(filename, error))
+    {
+        cerr << "Error: " << error << endl;
+        return false;
+    }
 
-        try
+    const size_t cities = reader.cityCount();
+    const uint32_t *regionOf = reader.region();
+    if (policy == DuplicatePolicy::Reject)
+    {
+        int duplicates = reportDuplicates(cities, [&reader, regionOf](size_t i)
+                                          { return make_pair(string(reader.cityString(i, SnapshotField::Name)),
+                                                             string(reader.regionName(regionOf[i]))); });
+        if (duplicates > 0)
         {
-            longitude = stod(fields[8]);
+            cout << "Load rejected: " << duplicates << " duplicate record(s) found in " << filename << "." << endl;
+            return false;
         }
-        catch (...)
+    }
+
+    // Map the snapshot's region table to dictionary IDs once; rows then refer to it by index
+    vector<uint32_t> regionIds(reader.regionCount());
+    for (size_t r = 0; r < regionIds.size(); ++r)
+    {
+        regionIds[r] = regions.intern(string(reader.regionName(r)));
+    }
+
+    prepareBulkLoad(cities);
+    int loaded = 0;
+    int skipped = 0;
+    int replaced = 0;
+    for (size_t i = 0; i < cities; ++i)
+    {
+        string name(reader.cityString(i, SnapshotField::Name));
+        const uint32_t region = regionIds[regionOf[i]];
+        if (!resolveDuplicate(name, region, policy, replaced, skipped))
+            continue;
+        City *city = arena.create(move(name), regions.name(region), region, string(reader.cityString(i, SnapshotField::MayorName)),
+                                  string(reader.cityString(i, SnapshotField::MayorAddress)),
+                                  string(reader.cityString(i, SnapshotField::History)));
+        store.insert(city, reader.population()[i], reader.year()[i], reader.latitude()[i], reader.longitude()[i],
+                     reader.unitX()[i], reader.unitY()[i], reader.unitZ()[i]);
+        linkCity(city);
+        loaded++;
+    }
+    reportLoad(loaded, replaced, skipped);
+    return true;
+}
+
+/**
+ * Saves the cities to a binary snapshot in the current listing order.
+ */
+void CityManager::saveSnapshot(const string &filename) const
+{
+    string error;
+    if (!writeSnapshot(filename, error))
+    {
+        cerr << "Error: " << error << endl;
+        return;
+    }
+    status() << "Cities saved to snapshot successfully!" << endl;
+}
+
+/**
+ * Writes every city to a binary snapshot in the current listing order.
+ */
+bool CityManager::writeSnapshot(const string &filename, string &error) const
+{
+    SnapshotData data;
+    const size_t cities = store.size();
+    data.population.reserve(cities);
+    data.year.reserve(cities);
+    data.latitude.reserve(cities);
+    data.longitude.reserve(cities);
+    data.unitX.reserve(cities);
+    data.unitY.reserve(cities);
+    data.unitZ.reserve(cities);
+    data.region.reserve(cities);
+    data.strings.reserve(cities * 4);
+
+    // Snapshot region numbers follow first use in listing order; NONE marks regions not yet seen
+    vector<uint32_t> regionNumbers(regions.size(), RegionDictionary::NONE);
+    forEachCity([this, &data, &regionNumbers](const City *city)
+    {
+        const uint32_t id = city->id;
+        uint32_t &number = regionNumbers[city->regionId];
+        if (number == RegionDictionary::NONE)
         {
-            longitude = 0.0; // Default value or handle error
+            number = static_cast<uint32_t>(data.regions.size());
+            data.regions.push_back(*city->region);
         }
+        data.population.push_back(store.population[id]);
+        data.year.push_back(store.year[id]);
+        data.latitude.push_back(store.latitude[id]);
+        data.longitude.push_back(store.longitude[id]);
+        data.unitX.push_back(store.unitX[id]);
+        data.unitY.push_back(store.unitY[id]);
+        data.unitZ.push_back(store.unitZ[id]);
+        data.region.push_back(number);
+        data.strings.push_back(city->name);
+        data.strings.push_back(city->mayorName);
+        data.strings.push_back(city->mayorAddress);
+        data.strings.push_back(city->history);
+    });
 
-        // Add the city to the linked list
-        addCity(fields[0], fields[1], population, year, fields[4], fields[5], fields[6], latitude, longitude);
-    }
-    inFile.close();
-    cout << "Cities loaded from file successfully!" << endl;
+    return data.write(filename, error);
 }
 
 /**
@@ -702,18 +2865,12 @@ void CityManager::displayCity(const string &name, const string &region) const
     if (current == nullptr)
     {
         cout << "City '" << name << "' in region '" << region << "' not found!" << endl;
+        suggestAlternatives(name, region);
         return;
     }
 
     cout << "----- City Information -----" << endl;
-    cout << "Name: " << current->name << endl;
-    cout << "Region: " << current->region << endl;
-    cout << "Population: " << current->population << endl;
-    cout << "Year: " << current->year << endl;
-    cout << "Mayor's Name: " << current->mayorName << endl;
-    cout << "Mayor's Address: " << current->mayorAddress << endl;
-    cout << "History: " << current->history << endl;
-    cout << "Latitude: " << current->latitude << endl;
-    cout << "Longitude: " << current->longitude << endl;
+    forEachField([this, current](auto index)
+                 { cout << CITY_FIELDS[index].heading << ": " << fieldValue<index>(store, current->id) << endl; });
     cout << "-----------------------------" << endl;
 }
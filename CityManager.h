@@ -2,22 +2,325 @@
 #define CITYMANAGER_H
 
 #include "City.h"
+#include "CityStore.h"
+#include "CityFields.h"
+#include "SpatialGrid.h"
+#include "SortedIndex.h"
+#include "CityArena.h"
+#include "RegionDictionary.h"
+#include "Journal.h"
+#include "ResultWriter.h"
+#include "CityQuery.h"
+#include "TextIndex.h"
+#include "NameTrie.h"
 #include <string>
+#include <unordered_map>
+#include <string_view>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <ostream>
 
 using namespace std;
 
+/**
+ * How a bulk load resolves rows whose (name, region) already exists.
+ */
+enum class DuplicatePolicy
+{
+    KeepFirst, // Keep the existing city and skip the incoming row
+    KeepLast,  // Replace the existing city with the incoming row
+    Reject     // Load nothing and report every duplicate
+};
+
+/**
+ * A city paired with its distance in km from a reference city.
+ */
+struct CityDistance
+{
+    const City *city;
+    double distance;
+};
+
+/**
+ * Aggregates over every city, as reported by stats.
+ */
+struct CityStatistics
+{
+    size_t count = 0;
+    long long totalPopulation = 0;
+    int minPopulation = 0;
+    int maxPopulation = 0;
+    long long totalYear = 0;
+    double totalLatitude = 0.0;
+    double totalLongitude = 0.0;
+};
+
+/**
+ * Aggregates over the cities sharing one region or year, as reported by stats by.
+ */
+struct GroupStatistics
+{
+    size_t count = 0;
+    long long totalPopulation = 0;
+    int minPopulation = numeric_limits<int>::max();
+    int maxPopulation = numeric_limits<int>::min();
+    double totalX = 0.0; // Sums of the unit-sphere positions; their direction is the centroid
+    double totalY = 0.0;
+    double totalZ = 0.0;
+};
+
+/**
+ * One key of a listing order, as given to sort.
+ */
+struct SortKey
+{
+    string attribute; // Lowercase attribute name
+    bool descending = false;
+};
+
 /**
  * Class to manage city data using a linked list.
  */
 class CityManager
 {
 private:
+    CityArena arena;          // Storage for every City node
+    RegionDictionary regions; // Region names by ID, with the record IDs of each region's cities
+
     City *head; // Pointer to the first City in the list
+    City *tail; // Pointer to the last City in the list, for O(1) appends
+
+    // Link order of each record ID. Cities are only linked at the tail, so it ranks them in insertion order
+    vector<uint64_t> linkSequence;
+    uint64_t nextSequence; // Link order given to the next city linked
+
+    // Columnar storage of the numeric attributes, indexed by City::id
+    CityStore store;
+
+    // Spatial index over the latitude/longitude columns
+    SpatialGrid grid;
+
+    // Ordered secondary indexes, built on first use and then maintained incrementally
+    mutable SortedIndex<string_view> nameIndex;
+    mutable SortedIndex<int> populationIndex;
+    mutable SortedIndex<int> yearIndex;
+    mutable SortedIndex<double> latitudeIndex;
+    mutable SortedIndex<double> longitudeIndex;
+
+    // Inverted index over the words of the history and the mayor's name and address, built like the above
+    mutable TextIndex textIndex;
+
+    // Trie over the distinct city names for suggestions and typo-tolerant lookups, built like the above
+    mutable NameTrie nameTrie;
+
+    // Typical size of one normalized sort key, for reserving room
+    static const size_t SORT_KEY_BYTES = 12;
+
+    vector<SortKey> sortKeys;           // Keys cities are listed by, most significant first; empty for insertion order
+    mutable vector<uint32_t> sortedIds; // Record IDs in listing order, for orders no single index gives
+    mutable bool listingSorted;         // False until sortedIds is built; kept in step by single changes, cleared by bulk ones
+
+    // Primary index mapping the case-folded name and region ID key to its City node
+    unordered_map<string, City *> cityIndex;
+
+    // Write-ahead journal of changes made since the data file was last written
+    Journal journal;
+    string dataFilename;    // Data file the journal belongs to
+    uint64_t baseFileBytes; // Size of the data file when it was last written
+
+    // Smallest journal size that triggers compaction into the data file
+    static constexpr uint64_t COMPACT_MIN_BYTES = 4 << 20;
+
+    // A population band or region matching more than 1/WIDE_RANGE_FRACTION of the cities is filtered by a full pass
+    static const size_t WIDE_RANGE_FRACTION = 16;
+
+    // Most cities offered when a lookup by name and region finds nothing
+    static const size_t MISS_SUGGESTIONS = 5;
+
+    // Record IDs each worker aggregates at a time in stats by
+    static const size_t GROUP_CHUNK_ROWS = 1 << 16;
+
+    bool quiet; // True to suppress status messages
+
+    vector<JournalEntry> *changeLog; // Receives a copy of every change as it is made, if set
+
+    // Returns the stream for status messages: cout, or a discarding stream when quiet
+    ostream &status() const;
+
+    // Builds the primary index key for a city name and region ID
+    static string makeKey(const string &name, uint32_t region);
+
+    // Finds a city by name within a region ID
+    City *findInRegion(const string &name, uint32_t region) const;
+
+    // Constructs the City node of a lowercase record, adding its region to the dictionary
+    City *createCity(CityRecord &record);
+
+    // Stores a new city, links it at the tail of the list and registers it in the index
+    void appendCity(City *city, int population, int year, double latitude, double longitude);
+
+    // Links an already stored city at the tail of the list and registers it in every index
+    void linkCity(City *city);
+
+    // Unlinks a city from the list, the index and the store, then returns it to the arena
+    void removeCity(City *city);
+
+    // Moves a city to new coordinates, keeping the spatial index in sync
+    void moveCity(City *city, double latitude, double longitude);
+
+    // Converts (squared chord length, ID) pairs from the spatial index into distances
+    void toCityDistances(const vector<pair<double, uint32_t>> &matches, const City *exclude,
+                         vector<CityDistance> &results) const;
+
+    // Prints one line per city with its distance
+    void printDistances(const vector<CityDistance> &results) const;
+
+    // Parses one CSV line of the data file into a record
+    static void parseRecord(string_view line, CityRecord &record);
+
+    // Parses every non-blank line of a piece of the data file, appending the records
+    static void parseLines(string_view text, vector<CityRecord> &records);
+
+    // Splits a data file at row boundaries and parses the pieces on worker threads, one batch per piece
+    static void parseRecords(const string &contents, vector<vector<CityRecord>> &batches);
+
+    // Smallest piece of a data file worth handing to a worker thread
+    static const size_t PARSE_CHUNK_BYTES = 1 << 20;
+
+    // Returns true if a file name selects the binary snapshot format
+    static bool isSnapshotName(const string &filename);
+
+    // Reports incoming rows that repeat an earlier row or an existing city; returns how many
+    template <typename RowKey>
+    int reportDuplicates(size_t rows, RowKey rowKey) const;
+
+    // Reserves space for a bulk load and drops secondary indexes if it is large
+    void prepareBulkLoad(size_t rows);
+
+    // Applies the duplicate policy to an incoming row; returns true if it should be inserted
+    bool resolveDuplicate(const string &name, uint32_t region, DuplicatePolicy policy, int &replaced, int &skipped);
+
+    // Prints the outcome of a bulk load
+    void reportLoad(int loaded, int replaced, int skipped) const;
+
+    // Loads cities from a memory-mapped binary snapshot
+    bool loadSnapshot(const string &filename, DuplicatePolicy policy);
+
+    // Writes every city to a data file, atomically replacing it; returns false and sets error on failure
+    bool writeDataFile(const string &filename, string &error) const;
+
+    // Writes every city to a binary snapshot; returns false and sets error on failure
+    bool writeSnapshot(const string &filename, string &error) const;
+
+    // Applies a new attribute value to a city; sets message and returns false if it is rejected
+    bool applyAttribute(City *current, const string &attribute, const string &value, string &message);
+
+    // Appends a change to the journal and the change log, if they are set
+    void journalChange(const JournalEntry &entry);
+
+    // Re-applies one journaled change without printing or journaling it again
+    void applyJournalEntry(JournalEntry &entry);
+
+    // Returns the size of a file in bytes, or 0 if it cannot be read
+    static uint64_t fileSize(const string &filename);
+
+    // Adds a city to every built secondary index
+    void indexCity(const City *city);
+
+    // Removes a city from every built secondary index
+    void unindexCity(const City *city);
+
+    // Drops every secondary index so it is rebuilt on next use
+    void invalidateIndexes();
+
+    // Returns the ordered secondary index of field I of CITY_FIELDS
+    template <size_t I>
+    auto &fieldIndex() const;
+
+    // Returns the ordered secondary index of field I, building it if needed
+    template <size_t I>
+    const auto &builtIndex() const;
+
+    // Returns record IDs ordered by an attribute, building its index if needed (nullptr if unknown)
+    const vector<uint32_t> *orderedBy(const string &attribute) const;
+
+    // Returns true if the index of an attribute is built, so reading it in order costs nothing extra
+    bool isOrdered(const string &attribute) const;
+
+    // Returns the text index, building it if needed
+    const TextIndex &textIndexed() const;
+
+    // Returns the name trie, building it if needed
+    const NameTrie &namesIndexed() const;
+
+    // Prints the cities a name and region that was not found may have meant
+    void suggestAlternatives(const string &name, const string &region) const;
+
+    // Rebuilds sortedIds with a radix sort over the normalized sort keys of every city
+    void sortListing() const;
+
+    // Returns the record IDs in listing order, to be read backwards if reversed is set (nullptr for insertion order)
+    const vector<uint32_t> *listingIds(bool &reversed) const;
+
+    // Returns true if record a is listed before record b in an order sortListing materializes
+    bool listedBefore(uint32_t a, uint32_t b) const;
+
+    // Sorts record IDs into the current listing order
+    void sortByListing(vector<uint32_t> &ids) const;
+
+    // Inserts a record into a built sortedIds at its listing position
+    void listCity(uint32_t id);
+
+    // Removes a record from a built sortedIds, before its sort keys change
+    void unlistCity(uint32_t id);
+
+    // Calls visit for each city in the current listing order
+    template <typename Visitor>
+    void forEachCity(Visitor visit) const;
+
+    // Offers a city to a result writer; returns false once the writer's limit is reached
+    bool writeCity(ResultWriter &writer, const City *city) const;
+
+    // Reads the aggregates from the running column totals and the population index
+    CityStatistics currentStatistics() const;
+
+    // Recomputes the aggregates with a full pass over the columns
+    CityStatistics scanStatistics() const;
 
-    // Private helper functions for merge sort
-    void splitList(City *source, City **frontRef, City **backRef);
-    City *sortedMerge(City *a, City *b, const string &sortAttribute);
-    void mergeSort(City **headRef, const string &sortAttribute);
+    // Aggregates the cities by region ID or year on a pool of worker threads
+    void groupStatistics(const string &attribute, unordered_map<int64_t, GroupStatistics> &groups) const;
+
+    // Resolves the region names of a condition to dictionary IDs
+    void bindRegions(QueryCondition &condition) const;
+
+    // Returns the record IDs of an index that match a predicate, as positions [first, last) (nullptr if it has none)
+    const vector<uint32_t> *indexRange(const QueryCondition &condition, size_t &first, size_t &last) const;
+
+    // Chooses how to find the cities that may match a condition
+    QueryPlan planCondition(const QueryCondition &condition) const;
+
+    // Plans a whole query, falling back to a column scan when the best index matches too much
+    QueryPlan planQuery(const QueryCondition &where) const;
+
+    // Appends the record IDs a plan reads from its indexes
+    void collectCandidates(const QueryPlan &plan, vector<uint32_t> &ids) const;
+
+    // Returns true if a city satisfies a condition
+    bool matchesCondition(const QueryCondition &condition, uint32_t id) const;
+
+    // Evaluates a condition over every record ID with one pass per column
+    void scanCondition(const QueryCondition &condition, vector<unsigned char> &matches) const;
+
+    // Calls visit with a comparator that puts record IDs in the query's result order
+    template <typename Visitor>
+    void withResultOrder(const CityQuery &query, Visitor visit) const;
+
+    // Runs a planned query, leaving the matching record IDs in result order
+    void selectMatches(const CityQuery &query, const QueryPlan &plan, vector<uint32_t> &matches) const;
+
+    // Prints the access paths of a plan, one per line
+    void describePlan(const QueryPlan &plan, int depth) const;
 
 public:
     /**
@@ -31,15 +334,42 @@ public:
     ~CityManager();
 
     /**
-     *Adds a new city to the list.
+     *Adds a new city to the list, asking before overwriting an existing one.
      */
     void addCity(string name, string region, int population, int year, string mayorName,
                  string mayorAddress, string history, double latitude, double longitude);
 
     /**
-     *Displays all cities in the list.
+     * Adds a city without prompting, resolving an existing (name, region) by policy.
+     * Returns false if the city was not added.
+     */
+    bool insertCity(CityRecord record, DuplicatePolicy policy);
+
+    /**
+     * Turns status messages such as "City deleted successfully!" off or on.
+     */
+    void setQuiet(bool enabled);
+
+    /**
+     * Copies every change made from now on, including journal replay, into log (nullptr to stop).
+     */
+    void recordChanges(vector<JournalEntry> *log);
+
+    /**
+     * Applies changes recorded by another manager, quietly and without journaling them.
+     */
+    void replayChanges(vector<JournalEntry> &entries);
+
+    /**
+     * Builds every index that const methods would otherwise build on first use, so that
+     * const methods change no state and may run on several threads at once.
      */
-    void displayCities() const;
+    void buildIndexes() const;
+
+    /**
+     *Displays all cities in the list, in the given format and window.
+     */
+    void displayCities(const OutputOptions &output = OutputOptions()) const;
 
     /**
      *Finds a city by name and region (case-insensitive).
@@ -52,9 +382,54 @@ public:
     void calculateDistance(const string &city1Name, const string &region1, const string &city2Name, const string &region2) const;
 
     /**
-     * Deletes a city by name and region.
+     * Computes the distance from one city to every other city with a batched kernel.
+     * Returns false if the origin city does not exist.
+     */
+    bool distancesFrom(const string &name, const string &region, vector<CityDistance> &results,
+                       double maxDistance = numeric_limits<double>::infinity(), bool sorted = false) const;
+
+    /**
+     * Displays the distance from one city to every other city, optionally sorted or limited to a radius.
+     */
+    void showDistancesFrom(const string &name, const string &region,
+                           double maxDistance = numeric_limits<double>::infinity(), bool sorted = false) const;
+
+    /**
+     * Finds the k cities nearest to a point, nearest first, optionally skipping one city.
+     */
+    void nearestTo(double latitude, double longitude, size_t k, vector<CityDistance> &results,
+                   const City *exclude = nullptr) const;
+
+    /**
+     * Finds all cities within maxDistance km of a point, nearest first, optionally skipping one city.
+     */
+    void withinRadius(double latitude, double longitude, double maxDistance, vector<CityDistance> &results,
+                      const City *exclude = nullptr) const;
+
+    /**
+     * Displays the k cities nearest to a city.
+     */
+    void showNearest(const string &name, const string &region, size_t k) const;
+
+    /**
+     * Displays the k cities nearest to a point.
+     */
+    void showNearest(double latitude, double longitude, size_t k) const;
+
+    /**
+     * Displays all cities within maxDistance km of a city.
+     */
+    void showWithin(const string &name, const string &region, double maxDistance) const;
+
+    /**
+     * Displays all cities within maxDistance km of a point.
+     */
+    void showWithin(double latitude, double longitude, double maxDistance) const;
+
+    /**
+     * Deletes a city by name and region. Returns false if it does not exist.
      */
-    void deleteCity(const string &name, const string &region);
+    bool deleteCity(const string &name, const string &region);
 
     /**
      * Searches for a city and outputs a specific attribute.
@@ -62,39 +437,110 @@ public:
     void searchCityAttribute(const string &name, const string &region, const string &attribute) const;
 
     /**
-     * Sorts the cities based on a specified attribute using Merge Sort.
+     * Lists cities in the order of an attribute from now on ("none" restores insertion order).
+     */
+    void sortCities(const string &attribute, bool descending = false);
+
+    /**
+     * Lists cities by several attributes from now on, each key breaking the ties of the one
+     * before it. Returns false and leaves the order unchanged if a key is unknown.
+     */
+    bool sortCities(const vector<SortKey> &keys);
+
+    /**
+     * Returns the keys cities are listed by, or none for insertion order.
+     */
+    const vector<SortKey> &listingKeys() const;
+
+    /**
+     * @brief Filters and displays cities based on population range, in the given format and window.
+     */
+    void filterCitiesByPopulation(int minPopulation, int maxPopulation, const OutputOptions &output = OutputOptions()) const;
+
+    /**
+     * Filters and displays cities based on region, in the given format and window.
+     */
+    void filterCitiesByRegion(const string &region, const OutputOptions &output = OutputOptions()) const;
+
+    /**
+     * Displays the cities whose history or mayor's name or address match a text search.
+     */
+    void searchText(const TextQuery &query, const OutputOptions &output = OutputOptions()) const;
+
+    /**
+     * Lists up to limit city names starting with prefix, followed by names close to it if
+     * there are fewer, each with the regions it is found in.
+     */
+    void suggestCities(const string &prefix, size_t limit) const;
+
+    /**
+     * Displays the cities matching a query, in the given format and window.
      */
-    void sortCities(const string &sortAttribute);
+    void runQuery(const CityQuery &query, const OutputOptions &output = OutputOptions()) const;
 
     /**
-     * @brief Filters and displays cities based on population range.
+     * Displays the plan the query planner picks for a query, without running it.
      */
-    void filterCitiesByPopulation(int minPopulation, int maxPopulation) const;
+    void explainQuery(const CityQuery &query) const;
 
     /**
-     * Filters and displays cities based on region.
+     * Displays statistical summaries of the cities, optionally checked against a full recompute.
+     * Returns false if the check finds a mismatch.
      */
-    void filterCitiesByRegion(const string &region) const;
+    bool showStatistics(bool verify = false) const;
 
     /**
-     * Displays statistical summaries of the cities.
+     * Displays the count, population aggregates and centroid of the cities in each region
+     * or year. Returns false for any other attribute.
      */
-    void showStatistics() const;
+    bool showGroupStatistics(const string &attribute) const;
 
     /**
-     * Modifies a specific attribute of a city.
+     * Displays memory used by city nodes, columns and the region dictionary.
+     */
+    void showMemoryUsage() const;
+
+    /**
+     * Modifies a specific attribute of a city, prompting for the new value.
      */
     void modifyCityAttribute(const string &name, const string &region, const string &attribute);
 
     /**
-     * Saves the cities to a file.
+     * Sets an attribute of a city to a value given as text, without prompting.
+     * Returns false if the city does not exist or the value is rejected.
+     */
+    bool setCityAttribute(const string &name, const string &region, const string &attribute, const string &value);
+
+    /**
+     * Saves the cities to a file, as a binary snapshot if the name ends in ".snap".
      */
     void saveToFile(const string &filename) const;
 
     /**
-     * Loads cities from a file.
+     * Saves the cities to a versioned, checksummed binary snapshot.
+     */
+    void saveSnapshot(const string &filename) const;
+
+    /**
+     * Bulk-loads cities from a CSV file or binary snapshot without prompting, resolving duplicates by policy.
+     * Returns false if the file could not be read or the load was rejected.
+     */
+    bool loadFromFile(const string &filename, DuplicatePolicy policy = DuplicatePolicy::KeepLast);
+
+    /**
+     * Opens the journal of a data file and replays the changes made since its last checkpoint.
+     */
+    bool openJournal(const string &filename);
+
+    /**
+     * Makes journaled changes durable, compacting the journal once it grows large.
+     */
+    void commitJournal();
+
+    /**
+     * Rewrites the data file with every change and empties the journal.
      */
-    void loadFromFile(const string &filename);
+    bool checkpoint();
 
     /**
      * Displays information for a specific city.
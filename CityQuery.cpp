@@ -0,0 +1,493 @@
+#include "CityQuery.h"
+#include "Distance.h"
+#include "Utilities.h"
+#include <cmath>
+#include <climits>
+#include <cctype>
+#include <charconv>
+
+namespace
+{
+    // One word, number, quoted string or symbol of query text
+    struct QueryToken
+    {
+        string text;
+        bool quoted; // Quoted strings are never keywords
+    };
+
+    /**
+     * Recursive-descent parser over the tokens of one query.
+     */
+    class QueryParser
+    {
+    private:
+        vector<QueryToken> tokens;
+        size_t next;
+        string error;
+
+        // Returns true if the next token is the given keyword or symbol (case-insensitive)
+        bool peek(const string &keyword) const
+        {
+            return next < tokens.size() && !tokens[next].quoted && toLowerCase(tokens[next].text) == keyword;
+        }
+
+        // Consumes the next token if it is the given keyword or symbol
+        bool accept(const string &keyword)
+        {
+            if (!peek(keyword))
+                return false;
+            next++;
+            return true;
+        }
+
+        // Returns the numeric field the next token names, or nullptr
+        const FieldDescriptor *numericField() const
+        {
+            if (next >= tokens.size() || tokens[next].quoted)
+                return nullptr;
+            const FieldDescriptor *field = findField(toLowerCase(tokens[next].text));
+            return field != nullptr && field->type != FieldType::Text ? field : nullptr;
+        }
+
+        // Records the first error; always returns false
+        bool fail(const string &message)
+        {
+            if (error.empty())
+                error = message;
+            return false;
+        }
+
+        // Consumes the given keyword or symbol, or fails
+        bool expect(const string &keyword)
+        {
+            if (accept(keyword))
+                return true;
+            return fail("expected '" + keyword + "'" + where());
+        }
+
+        // Describes the position of the next token for error messages
+        string where() const
+        {
+            return next < tokens.size() ? " at '" + tokens[next].text + "'" : " at end of query";
+        }
+
+        // Consumes a value (word or quoted string) in lowercase
+        bool value(string &text)
+        {
+            if (next >= tokens.size() || (!tokens[next].quoted && string("()<>=,").find(tokens[next].text[0]) != string::npos))
+                return fail("expected a value" + where());
+            text = toLowerCase(tokens[next++].text);
+            return true;
+        }
+
+        // Consumes a number
+        bool number(double &result)
+        {
+            if (next >= tokens.size())
+                return fail("expected a number at end of query");
+            const string &text = tokens[next].text;
+            try
+            {
+                size_t used = 0;
+                result = stod(text, &used);
+                if (used == text.size() && isfinite(result))
+                {
+                    next++;
+                    return true;
+                }
+            }
+            catch (...)
+            {
+            }
+            return fail("expected a number" + where());
+        }
+
+        // Consumes a token holding a whole number that fits in a size_t
+        bool count(size_t &result)
+        {
+            if (next >= tokens.size())
+                return false;
+            const string &text = tokens[next].text;
+            auto parsed = from_chars(text.data(), text.data() + text.size(), result);
+            if (parsed.ec != errc() || parsed.ptr != text.data() + text.size())
+                return false;
+            next++;
+            return true;
+        }
+
+        // Parses: term (or term)*
+        bool condition(QueryCondition &result)
+        {
+            QueryCondition first;
+            if (!term(first))
+                return false;
+            if (!peek("or"))
+            {
+                result = move(first);
+                return true;
+            }
+            result = QueryCondition();
+            result.kind = QueryCondition::Kind::Or;
+            result.children.push_back(move(first));
+            while (accept("or"))
+            {
+                result.children.emplace_back();
+                if (!term(result.children.back()))
+                    return false;
+            }
+            return true;
+        }
+
+        // Parses: factor (and factor)*
+        bool term(QueryCondition &result)
+        {
+            QueryCondition first;
+            if (!factor(first))
+                return false;
+            if (!peek("and"))
+            {
+                result = move(first);
+                return true;
+            }
+            result = QueryCondition();
+            result.kind = QueryCondition::Kind::And;
+            result.children.push_back(move(first));
+            while (accept("and"))
+            {
+                result.children.emplace_back();
+                if (!factor(result.children.back()))
+                    return false;
+            }
+            return true;
+        }
+
+        // Parses a parenthesized condition or a single predicate
+        bool factor(QueryCondition &result)
+        {
+            if (accept("("))
+                return condition(result) && expect(")");
+            if (numericField() != nullptr)
+                return range(result);
+            if (accept("region"))
+                return region(result);
+            if (accept("name"))
+            {
+                if (accept("prefix"))
+                    result.kind = QueryCondition::Kind::NamePrefix;
+                else if (accept("="))
+                    result.kind = QueryCondition::Kind::Name;
+                else
+                    return fail("expected '=' or 'prefix' after 'name'" + where());
+                return value(result.text);
+            }
+            if (accept("within"))
+                return radius(result);
+            if (accept("box"))
+                return box(result);
+            return fail("expected a condition" + where());
+        }
+
+        // Parses: <attribute> (=|<|<=|>|>=) <number> | <attribute> between <low> and <high>
+        bool range(QueryCondition &result)
+        {
+            result.kind = QueryCondition::Kind::Range;
+            const FieldDescriptor *field = numericField();
+            result.field = field->field;
+            result.attribute = string(field->name);
+            next++;
+            const bool whole = field->type == FieldType::Integer;
+            double bound = 0.0;
+            if (accept("between"))
+            {
+                if (!number(result.low) || !expect("and") || !number(result.high))
+                    return false;
+            }
+            else if (accept("="))
+            {
+                if (!number(bound))
+                    return false;
+                result.low = result.high = bound;
+            }
+            else if (accept("<="))
+            {
+                if (!number(result.high))
+                    return false;
+                result.low = -HUGE_VAL;
+            }
+            else if (accept(">="))
+            {
+                if (!number(result.low))
+                    return false;
+                result.high = HUGE_VAL;
+            }
+            else if (accept("<"))
+            {
+                if (!number(bound))
+                    return false;
+                result.low = -HUGE_VAL;
+                result.high = whole ? ceil(bound) - 1 : nextafter(bound, -HUGE_VAL);
+            }
+            else if (accept(">"))
+            {
+                if (!number(bound))
+                    return false;
+                result.low = whole ? floor(bound) + 1 : nextafter(bound, HUGE_VAL);
+                result.high = HUGE_VAL;
+            }
+            else
+            {
+                return fail("expected a comparison after '" + result.attribute + "'" + where());
+            }
+            if (whole)
+            {
+                // Integer fields such as population and year; keep whole-number bounds within int range
+                result.low = max(ceil(result.low), static_cast<double>(INT_MIN));
+                result.high = min(floor(result.high), static_cast<double>(INT_MAX));
+            }
+            return true;
+        }
+
+        // Parses: region = <region> | region in (<region>, ...)
+        bool region(QueryCondition &result)
+        {
+            result.kind = QueryCondition::Kind::Region;
+            if (accept("="))
+                return value(result.text);
+            if (!accept("in"))
+                return fail("expected '=' or 'in' after 'region'" + where());
+            if (!expect("("))
+                return false;
+            QueryCondition alternatives;
+            alternatives.kind = QueryCondition::Kind::Or;
+            do
+            {
+                alternatives.children.push_back(result);
+                if (!value(alternatives.children.back().text))
+                    return false;
+            } while (accept(","));
+            if (!expect(")"))
+                return false;
+            result = alternatives.children.size() == 1 ? move(alternatives.children[0]) : move(alternatives);
+            return true;
+        }
+
+        // Parses: within <km> of <latitude> <longitude>
+        bool radius(QueryCondition &result)
+        {
+            result.kind = QueryCondition::Kind::Radius;
+            if (!number(result.distance) || !expect("of") || !number(result.latitude) || !number(result.longitude))
+                return false;
+            if (result.distance < 0)
+                return fail("the distance of 'within' cannot be negative");
+            toUnitVector(result.latitude, result.longitude, result.unitX, result.unitY, result.unitZ);
+            result.chordLimit = kmToChordSquared(result.distance);
+            return true;
+        }
+
+        // Parses: box <latitude1> <longitude1> <latitude2> <longitude2>, a latitude and a longitude range.
+        // The box runs east from longitude1 to longitude2, so a larger longitude1 crosses the 180th meridian
+        bool box(QueryCondition &result)
+        {
+            double latitude1, longitude1, latitude2, longitude2;
+            if (!number(latitude1) || !number(longitude1) || !number(latitude2) || !number(longitude2))
+                return false;
+            auto range = [](CityField field, double low, double high)
+            {
+                QueryCondition condition;
+                condition.kind = QueryCondition::Kind::Range;
+                condition.field = field;
+                condition.attribute = string(describeField(field).name);
+                condition.low = low;
+                condition.high = high;
+                return condition;
+            };
+            result.kind = QueryCondition::Kind::And;
+            result.children.clear();
+            result.children.push_back(range(CityField::Latitude, min(latitude1, latitude2), max(latitude1, latitude2)));
+            if (longitude1 <= longitude2)
+            {
+                result.children.push_back(range(CityField::Longitude, longitude1, longitude2));
+                return true;
+            }
+            const FieldDescriptor &longitude = describeField(CityField::Longitude);
+            QueryCondition wrapped;
+            wrapped.kind = QueryCondition::Kind::Or;
+            wrapped.children.push_back(range(CityField::Longitude, longitude1, longitude.maximum));
+            wrapped.children.push_back(range(CityField::Longitude, longitude.minimum, longitude2));
+            result.children.push_back(move(wrapped));
+            return true;
+        }
+
+        // Parses: order by <attribute> [asc|desc]
+        bool ordering(CityQuery &query)
+        {
+            if (!expect("by"))
+                return false;
+            const FieldDescriptor *field = next < tokens.size() && !tokens[next].quoted
+                                               ? findField(toLowerCase(tokens[next].text))
+                                               : nullptr;
+            if (field != nullptr && field->ordered)
+            {
+                next++;
+                query.orderBy = string(field->name);
+                if (accept("desc"))
+                    query.descending = true;
+                else
+                    accept("asc");
+                return true;
+            }
+            return fail("expected name, population, year, latitude or longitude after 'order by'" + where());
+        }
+
+    public:
+        /**
+         * Constructor splits query text into tokens, setting aside output options.
+         */
+        QueryParser(const string &text, vector<string> &options) : next(0)
+        {
+            size_t i = 0;
+            while (i < text.size())
+            {
+                if (isspace(static_cast<unsigned char>(text[i])))
+                {
+                    i++;
+                }
+                else if (text[i] == '"')
+                {
+                    size_t close = text.find('"', i + 1);
+                    if (close == string::npos)
+                        close = text.size();
+                    tokens.push_back({text.substr(i + 1, close - i - 1), true});
+                    i = close + 1;
+                }
+                else if (text[i] == '<' || text[i] == '>')
+                {
+                    size_t length = i + 1 < text.size() && text[i + 1] == '=' ? 2 : 1;
+                    tokens.push_back({text.substr(i, length), false});
+                    i += length;
+                }
+                else if (text[i] == '(' || text[i] == ')' || text[i] == ',' || text[i] == '=')
+                {
+                    tokens.push_back({string(1, text[i]), false});
+                    i++;
+                }
+                else
+                {
+                    size_t end = i;
+                    while (end < text.size() && !isspace(static_cast<unsigned char>(text[end])) &&
+                           string("()<>=,\"").find(text[end]) == string::npos)
+                        end++;
+                    // Options such as --format=csv run to the next space
+                    if (text.compare(i, 2, "--") == 0)
+                    {
+                        end = text.find_first_of(" \t", i);
+                        end = end == string::npos ? text.size() : end;
+                        options.push_back(text.substr(i, end - i));
+                    }
+                    else
+                    {
+                        tokens.push_back({text.substr(i, end - i), false});
+                    }
+                    i = end;
+                }
+            }
+        }
+
+        /**
+         * Parses the whole query. Returns false and sets message on the first error.
+         */
+        bool parse(CityQuery &query, string &message)
+        {
+            accept("where");
+            if (next < tokens.size() && !peek("order") && !peek("limit"))
+            {
+                if (!condition(query.where))
+                {
+                    message = error;
+                    return false;
+                }
+            }
+            if (accept("order") && !ordering(query))
+            {
+                message = error;
+                return false;
+            }
+            if (accept("limit"))
+            {
+                if (!count(query.limit))
+                {
+                    message = "expected a whole number after 'limit'";
+                    return false;
+                }
+            }
+            if (next < tokens.size())
+            {
+                message = "unexpected '" + tokens[next].text + "'";
+                return false;
+            }
+            return true;
+        }
+    };
+
+    // Formats a number for query text, writing whole numbers without an exponent
+    string formatNumber(double value)
+    {
+        if (value == floor(value) && fabs(value) < 1e15)
+            return to_string(static_cast<long long>(value));
+        return formatDouble(value);
+    }
+}
+
+/**
+ * Parses query text. Returns false and sets error if it is not a valid query.
+ */
+bool CityQuery::parse(const string &text, CityQuery &query, string &error)
+{
+    query = CityQuery();
+    QueryParser parser(text, query.options);
+    return parser.parse(query, error);
+}
+
+/**
+ * Writes a condition back as query text, with each predicate in a canonical form.
+ */
+string CityQuery::describe(const QueryCondition &condition)
+{
+    switch (condition.kind)
+    {
+    case QueryCondition::Kind::All:
+        return "all cities";
+    case QueryCondition::Kind::And:
+    case QueryCondition::Kind::Or:
+    {
+        const string separator = condition.kind == QueryCondition::Kind::And ? " and " : " or ";
+        string text;
+        for (const QueryCondition &child : condition.children)
+        {
+            if (!text.empty())
+                text += separator;
+            bool nested = child.kind == QueryCondition::Kind::And || child.kind == QueryCondition::Kind::Or;
+            text += nested ? "(" + describe(child) + ")" : describe(child);
+        }
+        return text;
+    }
+    case QueryCondition::Kind::Range:
+        if (condition.low == condition.high)
+            return condition.attribute + " = " + formatNumber(condition.low);
+        if (condition.low == -HUGE_VAL || condition.low <= INT_MIN)
+            return condition.attribute + " <= " + formatNumber(condition.high);
+        if (condition.high == HUGE_VAL || condition.high >= INT_MAX)
+            return condition.attribute + " >= " + formatNumber(condition.low);
+        return condition.attribute + " between " + formatNumber(condition.low) + " and " + formatNumber(condition.high);
+    case QueryCondition::Kind::Region:
+        return "region = " + condition.text;
+    case QueryCondition::Kind::Name:
+        return "name = " + condition.text;
+    case QueryCondition::Kind::NamePrefix:
+        return "name prefix " + condition.text;
+    case QueryCondition::Kind::Radius:
+        return "within " + formatNumber(condition.distance) + " of " + formatNumber(condition.latitude) + " " +
+               formatNumber(condition.longitude);
+    }
+    return "";
+}
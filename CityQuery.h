@@ -0,0 +1,96 @@
+#ifndef CITYQUERY_H
+#define CITYQUERY_H
+
+#include "CityFields.h"
+#include <string>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * One node of a query's condition tree.
+ */
+struct QueryCondition
+{
+    enum class Kind
+    {
+        All,        // Matches every city (a query without a condition)
+        And,        // Every child matches
+        Or,         // At least one child matches
+        Range,      // A numeric attribute lies in [low, high]
+        Region,     // The city is in a region
+        Name,       // The city has exactly this name
+        NamePrefix, // The city's name starts with text
+        Radius      // The city lies within distance km of (latitude, longitude)
+    };
+
+    Kind kind = Kind::All;
+    vector<QueryCondition> children; // Operands of And and Or
+    CityField field = CityField::Population; // Range: population, year, latitude or longitude
+    string attribute;                        // Range: the name of field, for messages and query text
+    double low = 0.0;                // Range: inclusive bounds, whole numbers for population and year
+    double high = 0.0;
+    string text;                    // Region, Name, NamePrefix: lowercase value
+    uint32_t regionId = UINT32_MAX; // Region: dictionary ID, resolved when the query runs
+    double latitude = 0.0;          // Radius: centre in degrees and distance in km
+    double longitude = 0.0;
+    double distance = 0.0;
+    double unitX = 0.0; // Radius: unit-sphere position of the centre
+    double unitY = 0.0;
+    double unitZ = 0.0;
+    double chordLimit = 0.0; // Radius: squared chord length equivalent to distance
+};
+
+/**
+ * How the cities a condition may match are found, as chosen by the query planner.
+ */
+struct QueryPlan
+{
+    enum class Access
+    {
+        Scan,  // Test every city
+        Index, // Read the candidates from the index of one condition
+        Union, // Merge the candidates of every branch
+        Empty  // Nothing can match
+    };
+
+    Access access = Access::Scan;
+    const QueryCondition *driver = nullptr; // Index: condition whose index supplies the candidates
+    vector<QueryPlan> branches;             // Union: one plan per alternative
+    size_t estimate = 0;                    // Cities the candidates are expected to hold
+};
+
+/**
+ * A parsed query:
+ *     [where] <condition> [order by <attribute> [asc|desc]] [limit <n>] [--output options]
+ * Conditions combine predicates with and, or and parentheses; and binds tighter than or.
+ *     population|year|latitude|longitude (=|<|<=|>|>=) <number>
+ *     population|year|latitude|longitude between <low> and <high>
+ *     region = <region>         region in (<region>, ...)
+ *     name = <name>             name prefix <text>
+ *     within <km> of <latitude> <longitude>
+ *     box <latitude1> <longitude1> <latitude2> <longitude2>   (east from longitude1 to longitude2)
+ */
+struct CityQuery
+{
+    QueryCondition where;
+    string orderBy; // Attribute to order by, or empty for record order
+    bool descending = false;
+    size_t limit = numeric_limits<size_t>::max(); // Most rows the query returns
+    vector<string> options;                       // Output options such as --format=csv, left to the caller
+
+    /**
+     * Parses query text. Returns false and sets error if it is not a valid query.
+     */
+    static bool parse(const string &text, CityQuery &query, string &error);
+
+    /**
+     * Writes a condition back as query text.
+     */
+    static string describe(const QueryCondition &condition);
+};
+
+#endif // CITYQUERY_H
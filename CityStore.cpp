@@ -0,0 +1,155 @@
+#include "CityStore.h"
+#include "Distance.h"
+
+/**
+ * Constructor creates an empty store.
+ */
+CityStore::CityStore() : liveCount(0) {}
+
+/**
+ * Stores a city and its numeric attributes, assigning it a record ID.
+ */
+uint32_t CityStore::insert(City *city, int populationValue, int yearValue, double latitudeValue, double longitudeValue)
+{
+    double x, y, z;
+    toUnitVector(latitudeValue, longitudeValue, x, y, z);
+    return insert(city, populationValue, yearValue, latitudeValue, longitudeValue, x, y, z);
+}
+
+/**
+ * Stores a city whose unit-sphere position is already known, e.g. read from a snapshot.
+ */
+uint32_t CityStore::insert(City *city, int populationValue, int yearValue, double latitudeValue, double longitudeValue,
+                           double x, double y, double z)
+{
+    uint32_t id;
+    if (!freeIds.empty())
+    {
+        id = freeIds.back();
+        freeIds.pop_back();
+        rows[id] = city;
+        population[id] = populationValue;
+        year[id] = yearValue;
+        latitude[id] = latitudeValue;
+        longitude[id] = longitudeValue;
+        unitX[id] = x;
+        unitY[id] = y;
+        unitZ[id] = z;
+        live[id] = 1;
+    }
+    else
+    {
+        id = static_cast<uint32_t>(rows.size());
+        rows.push_back(city);
+        population.push_back(populationValue);
+        year.push_back(yearValue);
+        latitude.push_back(latitudeValue);
+        longitude.push_back(longitudeValue);
+        unitX.push_back(x);
+        unitY.push_back(y);
+        unitZ.push_back(z);
+        live.push_back(1);
+    }
+    city->id = id;
+    liveCount++;
+    sums.population += populationValue;
+    sums.year += yearValue;
+    sums.latitude += latitudeValue;
+    sums.longitude += longitudeValue;
+    return id;
+}
+
+/**
+ * Releases a record ID. Numeric columns of free IDs are zeroed.
+ */
+void CityStore::erase(uint32_t id)
+{
+    sums.population -= population[id];
+    sums.year -= year[id];
+    sums.latitude -= latitude[id];
+    sums.longitude -= longitude[id];
+    rows[id] = nullptr;
+    population[id] = 0;
+    year[id] = 0;
+    latitude[id] = 0.0;
+    longitude[id] = 0.0;
+    unitX[id] = 0.0;
+    unitY[id] = 0.0;
+    unitZ[id] = 0.0;
+    live[id] = 0;
+    freeIds.push_back(id);
+    liveCount--;
+}
+
+/**
+ * Updates a city's coordinates along with its precomputed unit-sphere position.
+ */
+void CityStore::setCoordinates(uint32_t id, double latitudeValue, double longitudeValue)
+{
+    sums.latitude += static_cast<long double>(latitudeValue) - latitude[id];
+    sums.longitude += static_cast<long double>(longitudeValue) - longitude[id];
+    latitude[id] = latitudeValue;
+    longitude[id] = longitudeValue;
+    toUnitVector(latitudeValue, longitudeValue, unitX[id], unitY[id], unitZ[id]);
+}
+
+/**
+ * Updates a city's population.
+ */
+void CityStore::setPopulation(uint32_t id, int populationValue)
+{
+    sums.population += static_cast<long long>(populationValue) - population[id];
+    population[id] = populationValue;
+}
+
+/**
+ * Updates a city's year recorded.
+ */
+void CityStore::setYear(uint32_t id, int yearValue)
+{
+    sums.year += static_cast<long long>(yearValue) - year[id];
+    year[id] = yearValue;
+}
+
+/**
+ * Returns the running sums of the numeric columns.
+ */
+const ColumnTotals &CityStore::totals() const
+{
+    return sums;
+}
+
+/**
+ * Returns the number of cities in the store.
+ */
+size_t CityStore::size() const
+{
+    return liveCount;
+}
+
+/**
+ * Returns the number of record ID slots, i.e. the length of every column.
+ */
+size_t CityStore::capacity() const
+{
+    return rows.size();
+}
+
+/**
+ * Reserves column space for the given number of additional cities.
+ */
+void CityStore::reserve(size_t additional)
+{
+    if (additional <= freeIds.size())
+        return;
+    size_t target = rows.size() + additional - freeIds.size();
+    rows.reserve(target);
+    population.reserve(target);
+    year.reserve(target);
+    latitude.reserve(target);
+    longitude.reserve(target);
+    unitX.reserve(target);
+    unitY.reserve(target);
+    unitZ.reserve(target);
+    live.reserve(target);
+}
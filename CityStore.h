@@ -0,0 +1,103 @@
+#ifndef CITYSTORE_H
+#define CITYSTORE_H
+
+#include "City.h"
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Running sums of the numeric columns over every live city.
+ * Coordinates are summed in extended precision so that long runs of changes do not drift.
+ */
+struct ColumnTotals
+{
+    long long population = 0;
+    long long year = 0;
+    long double latitude = 0.0L;
+    long double longitude = 0.0L;
+};
+
+/**
+ * Columnar backing store for city records.
+ * Numeric attributes live in contiguous arrays indexed by record ID, and the
+ * City node stored for each ID holds the string attributes.
+ */
+class CityStore
+{
+private:
+    vector<uint32_t> freeIds; // Released record IDs, reused before growing the columns
+    size_t liveCount;         // Number of IDs currently holding a city
+    ColumnTotals sums;        // Column sums, updated by every insert, erase and change
+
+public:
+    vector<City *> rows;        // City node for each record ID (nullptr when free)
+    vector<int> population;     // Population column
+    vector<int> year;           // Year recorded column
+    vector<double> latitude;    // Latitude column, in degrees
+    vector<double> longitude;   // Longitude column, in degrees
+    vector<double> unitX;       // Precomputed unit-sphere position (cos(lat) * cos(lon))
+    vector<double> unitY;       // Precomputed unit-sphere position (cos(lat) * sin(lon))
+    vector<double> unitZ;       // Precomputed unit-sphere position (sin(lat))
+    vector<unsigned char> live; // 1 when the record ID holds a city, 0 otherwise
+
+    /**
+     * Constructor creates an empty store.
+     */
+    CityStore();
+
+    /**
+     * Stores a city and its numeric attributes, assigning it a record ID.
+     */
+    uint32_t insert(City *city, int population, int year, double latitude, double longitude);
+
+    /**
+     * Stores a city whose unit-sphere position is already known, e.g. read from a snapshot.
+     */
+    uint32_t insert(City *city, int population, int year, double latitude, double longitude,
+                    double x, double y, double z);
+
+    /**
+     * Releases a record ID. Numeric columns of free IDs are zeroed.
+     */
+    void erase(uint32_t id);
+
+    /**
+     * Updates a city's coordinates along with its precomputed unit-sphere position.
+     */
+    void setCoordinates(uint32_t id, double latitude, double longitude);
+
+    /**
+     * Updates a city's population.
+     */
+    void setPopulation(uint32_t id, int population);
+
+    /**
+     * Updates a city's year recorded.
+     */
+    void setYear(uint32_t id, int year);
+
+    /**
+     * Returns the running sums of the numeric columns.
+     */
+    const ColumnTotals &totals() const;
+
+    /**
+     * Returns the number of cities in the store.
+     */
+    size_t size() const;
+
+    /**
+     * Returns the number of record ID slots, i.e. the length of every column.
+     */
+    size_t capacity() const;
+
+    /**
+     * Reserves column space for the given number of additional cities.
+     */
+    void reserve(size_t additional);
+};
+
+#endif // CITYSTORE_H
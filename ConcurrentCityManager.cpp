@@ -0,0 +1,173 @@
+#include "ConcurrentCityManager.h"
+#include <thread>
+#include <functional>
+
+/**
+ * Constructor creates two empty copies, with readers on the mirror.
+ */
+ConcurrentCityManager::ConcurrentCityManager() : published(MIRROR), versionIndex(0)
+{
+    copies[PRIMARY].recordChanges(&changes);
+    copies[MIRROR].setQuiet(true);
+    copies[MIRROR].buildIndexes();
+}
+
+/**
+ * Returns the reader slot of the calling thread, fixed for the thread's lifetime.
+ */
+size_t ConcurrentCityManager::readerSlot()
+{
+    thread_local const size_t slot = hash<thread::id>()(this_thread::get_id()) % READER_SLOTS;
+    return slot;
+}
+
+/**
+ * Waits until no reader registered under a version is still running. Readers that
+ * register after a slot was seen empty read the copy published before the wait began.
+ */
+void ConcurrentCityManager::waitForReaders(int version) const
+{
+    for (const ReaderSlot &slot : readers[version])
+    {
+        while (slot.count.load() != 0)
+            this_thread::yield();
+    }
+}
+
+/**
+ * Publishes a copy to new readers, then waits until no reader can still be on the other
+ * copy. Readers are counted under two versions so that a steady stream of new readers
+ * cannot keep the writer waiting: it drains the idle version, switches new readers to
+ * it, then drains the version that was current.
+ */
+void ConcurrentCityManager::publish(int copy)
+{
+    published.store(copy);
+    const int current = versionIndex.load();
+    const int next = 1 - current;
+    waitForReaders(next);
+    versionIndex.store(next);
+    waitForReaders(current);
+}
+
+/**
+ * Repeats the changes recorded by the primary on the mirror. Readers are moved to the
+ * primary while the mirror is changed and back once it has caught up, so the primary
+ * is again free for the next write.
+ */
+void ConcurrentCityManager::syncMirror()
+{
+    if (changes.empty())
+        return;
+    copies[PRIMARY].buildIndexes();
+    publish(PRIMARY);
+    copies[MIRROR].replayChanges(changes);
+    changes.clear();
+    copies[MIRROR].buildIndexes();
+    publish(MIRROR);
+}
+
+/**
+ * Adds a city without prompting, resolving an existing (name, region) by policy.
+ */
+bool ConcurrentCityManager::insertCity(CityRecord record, DuplicatePolicy policy)
+{
+    lock_guard<mutex> lock(writerMutex);
+    bool inserted = copies[PRIMARY].insertCity(move(record), policy);
+    syncMirror();
+    return inserted;
+}
+
+/**
+ * Deletes a city by name and region. Returns false if it does not exist.
+ */
+bool ConcurrentCityManager::deleteCity(const string &name, const string &region)
+{
+    lock_guard<mutex> lock(writerMutex);
+    bool deleted = copies[PRIMARY].deleteCity(name, region);
+    syncMirror();
+    return deleted;
+}
+
+/**
+ * Sets an attribute of a city to a value given as text. Returns false if it is rejected.
+ */
+bool ConcurrentCityManager::setCityAttribute(const string &name, const string &region, const string &attribute,
+                                             const string &value)
+{
+    lock_guard<mutex> lock(writerMutex);
+    bool changed = copies[PRIMARY].setCityAttribute(name, region, attribute, value);
+    syncMirror();
+    return changed;
+}
+
+/**
+ * Changes the listing order of both copies. The mirror is given the keys the primary
+ * settled on, so an invalid attribute is reported once.
+ */
+bool ConcurrentCityManager::sortCities(const vector<SortKey> &keys)
+{
+    lock_guard<mutex> lock(writerMutex);
+    bool sorted = copies[PRIMARY].sortCities(keys);
+    copies[PRIMARY].buildIndexes();
+    publish(PRIMARY);
+    copies[MIRROR].sortCities(copies[PRIMARY].listingKeys());
+    copies[MIRROR].buildIndexes();
+    publish(MIRROR);
+    return sorted;
+}
+
+/**
+ * Bulk-loads cities into both copies. Bulk loads are not recorded as changes, so the
+ * mirror loads the same file itself.
+ */
+bool ConcurrentCityManager::loadFromFile(const string &filename, DuplicatePolicy policy)
+{
+    lock_guard<mutex> lock(writerMutex);
+    if (!copies[PRIMARY].loadFromFile(filename, policy))
+        return false;
+    copies[PRIMARY].buildIndexes();
+    publish(PRIMARY);
+    copies[MIRROR].loadFromFile(filename, policy);
+    copies[MIRROR].buildIndexes();
+    publish(MIRROR);
+    return true;
+}
+
+/**
+ * Opens the journal of a data file in the primary and replays it into both copies.
+ */
+bool ConcurrentCityManager::openJournal(const string &filename)
+{
+    lock_guard<mutex> lock(writerMutex);
+    bool opened = copies[PRIMARY].openJournal(filename);
+    syncMirror();
+    return opened;
+}
+
+/**
+ * Makes journaled changes durable, compacting the journal once it grows large.
+ */
+void ConcurrentCityManager::commitJournal()
+{
+    lock_guard<mutex> lock(writerMutex);
+    copies[PRIMARY].commitJournal();
+}
+
+/**
+ * Rewrites the data file with every change and empties the journal.
+ */
+bool ConcurrentCityManager::checkpoint()
+{
+    lock_guard<mutex> lock(writerMutex);
+    return copies[PRIMARY].checkpoint();
+}
+
+/**
+ * Turns the primary copy's status messages off or on; the mirror is always quiet.
+ */
+void ConcurrentCityManager::setQuiet(bool enabled)
+{
+    lock_guard<mutex> lock(writerMutex);
+    copies[PRIMARY].setQuiet(enabled);
+}
@@ -0,0 +1,135 @@
+#ifndef CONCURRENTCITYMANAGER_H
+#define CONCURRENTCITYMANAGER_H
+
+#include "CityManager.h"
+#include "Journal.h"
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * CityManager shared by many reader threads and one writer at a time.
+ * Uses the left-right technique: two complete copies of the cities are kept. Readers
+ * run on whichever copy is published and never wait; the writer changes the copy no
+ * reader can reach, publishes it, waits for readers of the other copy to finish and
+ * then repeats the change there. Every read therefore sees the state after some whole
+ * number of writes, at the cost of holding the data twice.
+ *
+ * The primary copy takes each change first: it validates it, prints its messages and
+ * owns the journal. The changes it records are replayed quietly on the mirror copy.
+ */
+class ConcurrentCityManager
+{
+private:
+    CityManager copies[2];        // Primary and mirror copies of the cities
+    atomic<int> published;        // Copy new reads start on
+    atomic<int> versionIndex;     // Which set of reader counters new reads register in
+    mutex writerMutex;            // Serializes writers
+    vector<JournalEntry> changes; // Changes made to the primary and not yet to the mirror
+
+    static const int PRIMARY = 0;
+    static const int MIRROR = 1;
+    static const size_t READER_SLOTS = 16;
+
+    // A reader counter on its own cache line, so readers on different slots do not contend
+    struct alignas(64) ReaderSlot
+    {
+        atomic<int64_t> count{0};
+    };
+    mutable ReaderSlot readers[2][READER_SLOTS]; // Readers in progress, per version
+
+    // Returns the reader slot of the calling thread
+    static size_t readerSlot();
+
+    // Waits until no reader registered under a version is still running
+    void waitForReaders(int version) const;
+
+    // Publishes a copy to new readers and waits until no reader can still be on the other one
+    void publish(int copy);
+
+    // Repeats the recorded changes on the mirror, so both copies agree again
+    void syncMirror();
+
+public:
+    /**
+     * Constructor creates two empty copies, with readers on the mirror.
+     */
+    ConcurrentCityManager();
+
+    ConcurrentCityManager(const ConcurrentCityManager &) = delete;
+    ConcurrentCityManager &operator=(const ConcurrentCityManager &) = delete;
+
+    /**
+     * Runs reader(const CityManager &) against a consistent copy and returns its result.
+     * Never blocks; any number of threads may read at once, including during a write.
+     */
+    template <typename Reader>
+    auto read(Reader reader) const
+    {
+        // Register under the current version before looking at which copy is published;
+        // the writer waits for both versions to drain before it touches a copy
+        const int version = versionIndex.load();
+        atomic<int64_t> &count = readers[version][readerSlot()].count;
+        count.fetch_add(1);
+        struct Departure
+        {
+            atomic<int64_t> &count;
+            ~Departure() { count.fetch_sub(1); }
+        } departure{count};
+        return reader(static_cast<const CityManager &>(copies[published.load()]));
+    }
+
+    /**
+     * Adds a city without prompting, resolving an existing (name, region) by policy.
+     */
+    bool insertCity(CityRecord record, DuplicatePolicy policy);
+
+    /**
+     * Deletes a city by name and region. Returns false if it does not exist.
+     */
+    bool deleteCity(const string &name, const string &region);
+
+    /**
+     * Sets an attribute of a city to a value given as text. Returns false if it is rejected.
+     */
+    bool setCityAttribute(const string &name, const string &region, const string &attribute, const string &value);
+
+    /**
+     * Lists cities of both copies by a list of keys from now on (none restores insertion order).
+     * Returns false and leaves the order unchanged if a key is unknown.
+     */
+    bool sortCities(const vector<SortKey> &keys);
+
+    /**
+     * Bulk-loads cities from a CSV file or binary snapshot into both copies.
+     * Returns false if the file could not be read or the load was rejected.
+     */
+    bool loadFromFile(const string &filename, DuplicatePolicy policy = DuplicatePolicy::KeepLast);
+
+    /**
+     * Opens the journal of a data file and replays it into both copies.
+     */
+    bool openJournal(const string &filename);
+
+    /**
+     * Makes journaled changes durable, compacting the journal once it grows large.
+     */
+    void commitJournal();
+
+    /**
+     * Rewrites the data file with every change and empties the journal.
+     */
+    bool checkpoint();
+
+    /**
+     * Turns the primary copy's status messages off or on; the mirror is always quiet.
+     */
+    void setQuiet(bool enabled);
+};
+
+#endif // CONCURRENTCITYMANAGER_H
@@ -0,0 +1,211 @@
+#include "DatasetGenerator.h"
+#include "Utilities.h"
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+// Name syllables are a consonant followed by a vowel; both tables hold whole UTF-8
+// characters, so concatenated syllables can be split back uniquely
+const char *const CONSONANTS[] = {"b", "d", "k", "l", "m", "n", "r", "s", "t", "v", "ł", "ñ"};
+const char *const VOWELS[] = {"a", "e", "i", "o", "u", "ô", "é", "ü"};
+const size_t CONSONANT_COUNT = sizeof(CONSONANTS) / sizeof(CONSONANTS[0]);
+const size_t VOWEL_COUNT = sizeof(VOWELS) / sizeof(VOWELS[0]);
+const size_t SYLLABLE_COUNT = CONSONANT_COUNT * VOWEL_COUNT;
+
+const char *const QUALIFIERS[] = {"", "", " de ville", " sur-mer", " do sul", " an der oder", " nad wisłą",
+                                  " hôtel de ville"};
+const size_t QUALIFIER_COUNT = sizeof(QUALIFIERS) / sizeof(QUALIFIERS[0]);
+
+const char *const REGION_NAMES[] = {"usa", "china", "india", "brasil", "méxico", "españa", "france", "deutschland",
+                                    "österreich", "türkiye", "polska", "españa insular", "côte d'ivoire",
+                                    "são tomé", "québec", "nigeria", "japan", "россия", "ελλάδα", "uk",
+                                    "italia", "perú", "argentina", "colombia", "sverige", "norge", "danmark",
+                                    "suomi", "éire", "portugal", "česko", "magyarország", "românia", "egypt",
+                                    "kenya", "south africa", "australia", "new zealand", "canada", "chile"};
+const size_t REGION_NAME_COUNT = sizeof(REGION_NAMES) / sizeof(REGION_NAMES[0]);
+
+const char *const FIRST_NAMES[] = {"josé", "françois", "anna", "søren", "zoë", "łukasz", "maría", "jürgen",
+                                   "aiko", "chloé", "joão", "oğuz", "amélie", "nikolai", "fatima", "li"};
+const char *const LAST_NAMES[] = {"müller", "gonçalves", "nowak", "garcía", "dubois", "kowalski", "øster",
+                                  "yılmaz", "rossi", "smith", "tanaka", "novák", "szabó", "pérez", "okafor"};
+const char *const STREETS[] = {"rue de la paix", "hauptstraße", "avenida paulista", "ulica długa", "calle mayor",
+                               "city hall plaza", "place de l'hôtel de ville", "via roma", "rådhuspladsen"};
+const char *const HISTORIES[] = {"founded as a river crossing", "a former \"free city\" of the empire",
+                                 "grew around its harbour and shipyards", "known for its cathédrale and old town",
+                                 "an industrial centre since the 1800s", "rebuilt after the great fire",
+                                 "market town on the old salt road", "university city, \"the athens of the north\""};
+
+template <typename T, size_t N>
+constexpr size_t countOf(const T (&)[N])
+{
+    return N;
+}
+
+/**
+ * Returns syllable i of the consonant-vowel table.
+ */
+string syllable(size_t i)
+{
+    return string(CONSONANTS[i / VOWEL_COUNT]) + VOWELS[i % VOWEL_COUNT];
+}
+} // namespace
+
+/**
+ * Constructor sets up regionCount regions with Zipf exponent skew, each with a random centre.
+ */
+DatasetGenerator::DatasetGenerator(uint64_t seed, size_t regionCount, double skew) : random(seed), produced(0)
+{
+    regionCount = max<size_t>(regionCount, 1);
+    uniform_real_distribution<double> unit(-1.0, 1.0);
+    uniform_real_distribution<double> longitude(-180.0, 180.0);
+    double total = 0.0;
+    for (size_t r = 0; r < regionCount; ++r)
+    {
+        string name = REGION_NAMES[r % REGION_NAME_COUNT];
+        if (r >= REGION_NAME_COUNT)
+            name += " " + to_string(r / REGION_NAME_COUNT + 1);
+        regions.push_back(name);
+        total += 1.0 / pow(static_cast<double>(r + 1), skew);
+        regionCumulative.push_back(total);
+        regionCentres.emplace_back(asin(unit(random)) * 180.0 / M_PI, longitude(random));
+    }
+}
+
+/**
+ * Picks a region index with Zipf-distributed probability.
+ */
+size_t DatasetGenerator::pickRegion()
+{
+    uniform_real_distribution<double> pick(0.0, regionCumulative.back());
+    size_t region = upper_bound(regionCumulative.begin(), regionCumulative.end(), pick(random)) - regionCumulative.begin();
+    return min(region, regions.size() - 1);
+}
+
+/**
+ * Builds the unique name of the index-th city. The index is scrambled by an affine map
+ * that is a bijection modulo the number of names, then read as mixed-radix digits
+ * selecting two to three syllables, an optional hyphenated syllable and a qualifier.
+ */
+string DatasetGenerator::cityName(size_t index)
+{
+    const uint64_t NAME_COUNT = SYLLABLE_COUNT * SYLLABLE_COUNT * (SYLLABLE_COUNT + 1) * (SYLLABLE_COUNT + 1) *
+                                QUALIFIER_COUNT;
+    const uint64_t MULTIPLIER = 1000003; // Prime not dividing NAME_COUNT
+    uint64_t code = (static_cast<uint64_t>(index % NAME_COUNT) * MULTIPLIER + 12345) % NAME_COUNT;
+
+    string name = syllable(code % SYLLABLE_COUNT);
+    code /= SYLLABLE_COUNT;
+    name += syllable(code % SYLLABLE_COUNT);
+    code /= SYLLABLE_COUNT;
+    if (code % (SYLLABLE_COUNT + 1) != 0)
+        name += syllable(code % (SYLLABLE_COUNT + 1) - 1);
+    code /= SYLLABLE_COUNT + 1;
+    if (code % (SYLLABLE_COUNT + 1) != 0)
+        name += "-" + syllable(code % (SYLLABLE_COUNT + 1) - 1);
+    code /= SYLLABLE_COUNT + 1;
+    name += QUALIFIERS[code % QUALIFIER_COUNT];
+
+    // Beyond the name space, a numeric suffix keeps names unique
+    if (index >= NAME_COUNT)
+        name += " " + to_string(index / NAME_COUNT + 1);
+    return name;
+}
+
+/**
+ * Generates the next city.
+ */
+CityRecord DatasetGenerator::next()
+{
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    normal_distribution<double> spread(0.0, 2.0);
+    CityRecord record;
+    size_t region = pickRegion();
+    record.name = cityName(produced++);
+    record.region = regions[region];
+
+    // Populations are log-uniform, so small towns far outnumber large cities
+    record.population = static_cast<int>(exp(log(1000.0) + unit(random) * (log(40000000.0) - log(1000.0))));
+    record.year = 1980 + static_cast<int>(random() % 45);
+    record.mayorName = string(FIRST_NAMES[random() % countOf(FIRST_NAMES)]) + " " +
+                       LAST_NAMES[random() % countOf(LAST_NAMES)];
+    record.mayorAddress = to_string(1 + random() % 200) + " " + STREETS[random() % countOf(STREETS)] + ", " +
+                          to_string(10000 + random() % 90000);
+    record.history = HISTORIES[random() % countOf(HISTORIES)];
+
+    // Most cities cluster around their region's centre; the rest are spread over the globe
+    if (unit(random) < 0.8)
+    {
+        record.latitude = clamp(regionCentres[region].first + spread(random), -90.0, 90.0);
+        record.longitude = remainder(regionCentres[region].second + spread(random), 360.0);
+    }
+    else
+    {
+        record.latitude = asin(2.0 * unit(random) - 1.0) * 180.0 / M_PI;
+        record.longitude = 360.0 * unit(random) - 180.0;
+    }
+    record.latitude = round(record.latitude * 10000.0) / 10000.0;
+    record.longitude = round(record.longitude * 10000.0) / 10000.0;
+    return record;
+}
+
+/**
+ * Generates rows cities, appending them to records.
+ */
+void DatasetGenerator::generate(size_t rows, vector<CityRecord> &records)
+{
+    records.reserve(records.size() + rows);
+    for (size_t i = 0; i < rows; ++i)
+    {
+        records.push_back(next());
+    }
+}
+
+/**
+ * Writes rows generated cities to a file in the data.txt format.
+ */
+bool DatasetGenerator::writeFile(const string &filename, size_t rows, string &error)
+{
+    ofstream outFile(filename, ios::trunc);
+    if (!outFile)
+    {
+        error = "Could not open file " + filename;
+        return false;
+    }
+    for (size_t i = 0; i < rows; ++i)
+    {
+        CityRecord record = next();
+        outFile << escapeQuotes(record.name) << ","
+                << escapeQuotes(record.region) << ","
+                << record.population << ","
+                << record.year << ","
+                << escapeQuotes(record.mayorName) << ","
+                << escapeQuotes(record.mayorAddress) << ","
+                << escapeQuotes(record.history) << ","
+                << formatDouble(record.latitude) << ","
+                << formatDouble(record.longitude) << '\n';
+    }
+    if (!outFile.flush())
+    {
+        error = "Could not write file " + filename;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Returns the name of a region; region 0 is the most populous.
+ */
+const string &DatasetGenerator::regionName(size_t region) const
+{
+    return regions[region];
+}
+
+/**
+ * Returns the number of regions.
+ */
+size_t DatasetGenerator::regionCount() const
+{
+    return regions.size();
+}
@@ -0,0 +1,68 @@
+#ifndef DATASETGENERATOR_H
+#define DATASETGENERATOR_H
+
+#include "City.h"
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Generates synthetic cities in the data.txt format for benchmarking.
+ * Region sizes follow a Zipf distribution, most cities cluster around their
+ * region's centre, and names are built from UTF-8 syllables so that every
+ * generated (name, region) pair is unique. The same seed yields the same data.
+ */
+class DatasetGenerator
+{
+private:
+    mt19937_64 random;
+    size_t produced; // Number of records generated so far
+
+    vector<string> regions;
+    vector<double> regionCumulative;          // Cumulative Zipf weights of the regions
+    vector<pair<double, double>> regionCentres; // Latitude and longitude each region clusters around
+
+    // Builds the unique name of the index-th city from its digits in the syllable tables
+    static string cityName(size_t index);
+
+    // Picks a region index with Zipf-distributed probability
+    size_t pickRegion();
+
+public:
+    /**
+     * Constructor sets up regionCount regions with Zipf exponent skew.
+     */
+    explicit DatasetGenerator(uint64_t seed = 5004, size_t regionCount = 500, double skew = 1.1);
+
+    /**
+     * Generates the next city.
+     */
+    CityRecord next();
+
+    /**
+     * Generates rows cities, appending them to records.
+     */
+    void generate(size_t rows, vector<CityRecord> &records);
+
+    /**
+     * Writes rows generated cities to a file in the data.txt format.
+     * Returns false and sets error on failure.
+     */
+    bool writeFile(const string &filename, size_t rows, string &error);
+
+    /**
+     * Returns the name of a region; region 0 is the most populous.
+     */
+    const string &regionName(size_t region) const;
+
+    /**
+     * Returns the number of regions.
+     */
+    size_t regionCount() const;
+};
+
+#endif // DATASETGENERATOR_H
@@ -0,0 +1,88 @@
+#include "Distance.h"
+#include "Utilities.h"
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+
+// Great-circle distance in km between two points given in degrees (scalar haversine)
+double haversineDistance(double latitude1, double longitude1, double latitude2, double longitude2)
+{
+    // Convert latitudes and longitudes from degrees to radians
+    double lat1 = toRadians(latitude1);
+    double lat2 = toRadians(latitude2);
+    double lon1 = toRadians(longitude1);
+    double lon2 = toRadians(longitude2);
+
+    // Haversine formula for distance
+    double dLat = lat2 - lat1;
+    double dLon = lon2 - lon1;
+
+    double a = sin(dLat / 2) * sin(dLat / 2) +
+               cos(lat1) * cos(lat2) *
+                   sin(dLon / 2) * sin(dLon / 2);
+    double c = 2 * atan2(sqrt(a), sqrt(1 - a));
+    return EARTH_RADIUS_KM * c;
+}
+
+// Unit-sphere position of a point given in degrees
+void toUnitVector(double latitude, double longitude, double &x, double &y, double &z)
+{
+    double lat = toRadians(latitude);
+    double lon = toRadians(longitude);
+    double cosLat = cos(lat);
+    x = cosLat * cos(lon);
+    y = cosLat * sin(lon);
+    z = sin(lat);
+}
+
+// Squared chord length from one unit vector to n others, stored in out.
+// The haversine term equals chord^2 / 4, so no trigonometry is needed per point.
+void chordSquaredFromPoint(double x0, double y0, double z0, const double *__restrict x, const double *__restrict y,
+                           const double *__restrict z, double *__restrict out, size_t n)
+{
+    size_t i = 0;
+#if defined(__GNUC__)
+    // Four lanes at a time using GCC/Clang vector extensions (SSE2 pairs or one AVX register)
+    typedef double Lanes __attribute__((vector_size(4 * sizeof(double))));
+    const Lanes px = {x0, x0, x0, x0};
+    const Lanes py = {y0, y0, y0, y0};
+    const Lanes pz = {z0, z0, z0, z0};
+    for (; i + 4 <= n; i += 4)
+    {
+        Lanes vx, vy, vz;
+        memcpy(&vx, x + i, sizeof(Lanes));
+        memcpy(&vy, y + i, sizeof(Lanes));
+        memcpy(&vz, z + i, sizeof(Lanes));
+        Lanes dx = vx - px;
+        Lanes dy = vy - py;
+        Lanes dz = vz - pz;
+        Lanes chord = dx * dx + dy * dy + dz * dz;
+        memcpy(out + i, &chord, sizeof(Lanes));
+    }
+#endif
+    for (; i < n; ++i)
+    {
+        double dx = x[i] - x0;
+        double dy = y[i] - y0;
+        double dz = z[i] - z0;
+        out[i] = dx * dx + dy * dy + dz * dz;
+    }
+}
+
+// Converts a squared unit-sphere chord length to a great-circle distance in km
+double chordSquaredToKm(double chordSquared)
+{
+    double halfChord = sqrt(chordSquared) / 2;
+    return 2 * EARTH_RADIUS_KM * asin(min(1.0, halfChord));
+}
+
+// Converts a great-circle distance in km to the equivalent squared unit-sphere chord length
+double kmToChordSquared(double km)
+{
+    // Squaring would drop the sign, so a negative (or NaN) radius matches nothing but the centre
+    if (!(km > 0))
+        return 0;
+    double angle = min(km / EARTH_RADIUS_KM, M_PI);
+    double chord = 2 * sin(angle / 2);
+    return chord * chord;
+}
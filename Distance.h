@@ -0,0 +1,28 @@
+#ifndef DISTANCE_H
+#define DISTANCE_H
+
+#include <cstddef>
+
+using namespace std;
+
+// Mean Earth radius used by all distance calculations
+const double EARTH_RADIUS_KM = 6371.0;
+
+// Great-circle distance in km between two points given in degrees (scalar haversine)
+double haversineDistance(double latitude1, double longitude1, double latitude2, double longitude2);
+
+// Unit-sphere position of a point given in degrees
+void toUnitVector(double latitude, double longitude, double &x, double &y, double &z);
+
+// Squared chord length from one unit vector to n others, stored in out.
+// Written as a branch-free loop over separate x/y/z arrays so the compiler vectorizes it.
+void chordSquaredFromPoint(double x0, double y0, double z0, const double *x, const double *y, const double *z,
+                           double *out, size_t n);
+
+// Converts a squared unit-sphere chord length to a great-circle distance in km
+double chordSquaredToKm(double chordSquared);
+
+// Converts a great-circle distance in km to the equivalent squared unit-sphere chord length
+double kmToChordSquared(double km);
+
+#endif // DISTANCE_H
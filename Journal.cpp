@@ -0,0 +1,327 @@
+#include "Journal.h"
+#include "Utilities.h"
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const size_t RECORD_HEADER_BYTES = sizeof(uint32_t) + sizeof(uint64_t);
+const size_t MAX_PAYLOAD_BYTES = 1 << 26;
+
+/**
+ * Appends the raw bytes of a fixed-width value.
+ */
+template <typename T>
+void putValue(string &out, T value)
+{
+    out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+/**
+ * Appends a length-prefixed string.
+ */
+void putString(string &out, const string &value)
+{
+    putValue(out, static_cast<uint32_t>(value.size()));
+    out.append(value);
+}
+
+/**
+ * Sequential decoder over one record payload; every read fails once the payload runs out.
+ */
+class PayloadReader
+{
+private:
+    const char *cursor;
+    const char *end;
+
+public:
+    PayloadReader(const char *data, size_t size) : cursor(data), end(data + size) {}
+
+    template <typename T>
+    bool get(T &value)
+    {
+        if (static_cast<size_t>(end - cursor) < sizeof(value))
+            return false;
+        memcpy(&value, cursor, sizeof(value));
+        cursor += sizeof(value);
+        return true;
+    }
+
+    bool get(string &value)
+    {
+        uint32_t length = 0;
+        if (!get(length) || static_cast<size_t>(end - cursor) < length)
+            return false;
+        value.assign(cursor, length);
+        cursor += length;
+        return true;
+    }
+
+    bool finished() const
+    {
+        return cursor == end;
+    }
+};
+
+/**
+ * Encodes the payload of one entry.
+ */
+void encodePayload(const JournalEntry &entry, string &out)
+{
+    putValue(out, static_cast<uint8_t>(entry.operation));
+    putString(out, entry.city.name);
+    putString(out, entry.city.region);
+    if (entry.operation == JournalOperation::Add)
+    {
+        putValue(out, static_cast<int32_t>(entry.city.population));
+        putValue(out, static_cast<int32_t>(entry.city.year));
+        putString(out, entry.city.mayorName);
+        putString(out, entry.city.mayorAddress);
+        putString(out, entry.city.history);
+        putValue(out, entry.city.latitude);
+        putValue(out, entry.city.longitude);
+    }
+    else if (entry.operation == JournalOperation::Set)
+    {
+        putString(out, entry.attribute);
+        putString(out, entry.value);
+    }
+}
+
+/**
+ * Decodes the payload of one entry; returns false if it is malformed.
+ */
+bool decodePayload(const char *data, size_t size, JournalEntry &entry)
+{
+    PayloadReader reader(data, size);
+    uint8_t operation = 0;
+    if (!reader.get(operation) || !reader.get(entry.city.name) || !reader.get(entry.city.region))
+        return false;
+    entry.operation = static_cast<JournalOperation>(operation);
+    switch (entry.operation)
+    {
+    case JournalOperation::Add:
+    {
+        int32_t population = 0;
+        int32_t year = 0;
+        if (!reader.get(population) || !reader.get(year) || !reader.get(entry.city.mayorName) ||
+            !reader.get(entry.city.mayorAddress) || !reader.get(entry.city.history) ||
+            !reader.get(entry.city.latitude) || !reader.get(entry.city.longitude))
+            return false;
+        entry.city.population = population;
+        entry.city.year = year;
+        break;
+    }
+    case JournalOperation::Delete:
+        break;
+    case JournalOperation::Set:
+        if (!reader.get(entry.attribute) || !reader.get(entry.value))
+            return false;
+        break;
+    default:
+        return false;
+    }
+    return reader.finished();
+}
+
+/**
+ * Reads a whole file into memory; a missing file reads as empty.
+ */
+bool readFile(int fd, string &contents)
+{
+    char buffer[1 << 16];
+    while (true)
+    {
+        ssize_t count = ::read(fd, buffer, sizeof(buffer));
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        if (count == 0)
+            return true;
+        contents.append(buffer, static_cast<size_t>(count));
+    }
+}
+} // namespace
+
+/**
+ * Constructor creates a journal with no file open.
+ */
+Journal::Journal() : fd(-1), pendingRecords(0), durableBytes(0), lastCommit(chrono::steady_clock::now()) {}
+
+/**
+ * Destructor commits any pending records and closes the file.
+ */
+Journal::~Journal()
+{
+    if (fd >= 0)
+    {
+        commit();
+        ::close(fd);
+    }
+}
+
+/**
+ * Opens or creates the journal, returning its intact records and truncating a torn tail.
+ */
+bool Journal::open(const string &filename, vector<JournalEntry> &entries, size_t &discardedBytes, string &error)
+{
+    discardedBytes = 0;
+    int descriptor = ::open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (descriptor < 0)
+    {
+        error = "Could not open journal " + filename;
+        return false;
+    }
+    string contents;
+    if (!readFile(descriptor, contents))
+    {
+        ::close(descriptor);
+        error = "Could not read journal " + filename;
+        return false;
+    }
+
+    size_t offset = 0;
+    while (contents.size() - offset >= RECORD_HEADER_BYTES)
+    {
+        uint32_t payloadSize = 0;
+        uint64_t checksum = 0;
+        memcpy(&payloadSize, contents.data() + offset, sizeof(payloadSize));
+        memcpy(&checksum, contents.data() + offset + sizeof(payloadSize), sizeof(checksum));
+        const char *payload = contents.data() + offset + RECORD_HEADER_BYTES;
+        if (payloadSize > MAX_PAYLOAD_BYTES || contents.size() - offset - RECORD_HEADER_BYTES < payloadSize ||
+            checksum64(payload, payloadSize) != checksum)
+            break;
+        JournalEntry entry;
+        if (!decodePayload(payload, payloadSize, entry))
+            break;
+        entries.push_back(move(entry));
+        offset += RECORD_HEADER_BYTES + payloadSize;
+    }
+
+    // Cut off a record torn by a crash so new records follow the intact ones
+    if (offset < contents.size())
+    {
+        discardedBytes = contents.size() - offset;
+        if (ftruncate(descriptor, static_cast<off_t>(offset)) != 0 || fdatasync(descriptor) != 0)
+        {
+            ::close(descriptor);
+            error = "Could not truncate journal " + filename;
+            return false;
+        }
+    }
+
+    fd = descriptor;
+    path = filename;
+    durableBytes = offset;
+    lastCommit = chrono::steady_clock::now();
+    return true;
+}
+
+/**
+ * Returns true if a journal file is open.
+ */
+bool Journal::isOpen() const
+{
+    return fd >= 0;
+}
+
+/**
+ * Buffers a record, committing the group once it is large or old enough.
+ */
+void Journal::append(const JournalEntry &entry)
+{
+    const size_t start = pending.size();
+    pending.append(RECORD_HEADER_BYTES, '\0');
+    encodePayload(entry, pending);
+    const uint32_t payloadSize = static_cast<uint32_t>(pending.size() - start - RECORD_HEADER_BYTES);
+    const uint64_t checksum = checksum64(pending.data() + start + RECORD_HEADER_BYTES, payloadSize);
+    memcpy(&pending[start], &payloadSize, sizeof(payloadSize));
+    memcpy(&pending[start + sizeof(payloadSize)], &checksum, sizeof(checksum));
+    pendingRecords++;
+
+    if (pendingRecords >= GROUP_RECORDS || pending.size() >= GROUP_BYTES ||
+        chrono::steady_clock::now() - lastCommit >= GROUP_INTERVAL)
+    {
+        commit();
+    }
+}
+
+/**
+ * Writes and syncs every pending record with a single write and fdatasync.
+ */
+bool Journal::commit()
+{
+    if (fd < 0 || pending.empty())
+        return true;
+    size_t written = 0;
+    while (written < pending.size())
+    {
+        ssize_t count = ::write(fd, pending.data() + written, pending.size() - written);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            discardUnsynced();
+            return false;
+        }
+        written += static_cast<size_t>(count);
+    }
+    if (fdatasync(fd) != 0)
+    {
+        discardUnsynced();
+        return false;
+    }
+    durableBytes += pending.size();
+    pending.clear();
+    pendingRecords = 0;
+    lastCommit = chrono::steady_clock::now();
+    return true;
+}
+
+/**
+ * Cuts the file back to its synced length after a failed commit, so a retry
+ * rewrites the pending records in place instead of after a partial copy.
+ */
+bool Journal::discardUnsynced()
+{
+    // With O_APPEND the next write lands at the new end of the file
+    return ftruncate(fd, static_cast<off_t>(durableBytes)) == 0;
+}
+
+/**
+ * Empties the journal once its changes are in the base data file.
+ */
+bool Journal::reset()
+{
+    if (fd < 0)
+        return true;
+    pending.clear();
+    pendingRecords = 0;
+    if (ftruncate(fd, 0) != 0 || fdatasync(fd) != 0)
+        return false;
+    durableBytes = 0;
+    return true;
+}
+
+/**
+ * Returns the journal size in bytes, including pending records.
+ */
+uint64_t Journal::size() const
+{
+    return durableBytes + pending.size();
+}
+
+/**
+ * Returns the path of the journal file.
+ */
+const string &Journal::filename() const
+{
+    return path;
+}
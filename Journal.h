@@ -0,0 +1,126 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "City.h"
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Write-ahead journal format (little-endian), appended to after every change:
+ *
+ *   record   uint32 payload size, uint64 checksum of the payload, payload
+ *   payload  uint8 operation, then its fields; strings are a uint32 length
+ *            followed by the bytes, numbers are stored in their binary form
+ *              add     name, region, population, year, mayor name,
+ *                      mayor address, history, latitude, longitude
+ *              delete  name, region
+ *              set     name, region, attribute, value
+ *
+ * Replaying the records over the base data file restores the latest state.
+ * A record cut short by a crash fails its size or checksum test; it and
+ * anything after it are discarded.
+ */
+
+// Kinds of change recorded in the journal
+enum class JournalOperation : uint8_t
+{
+    Add = 1,
+    Delete = 2,
+    Set = 3
+};
+
+/**
+ * One recorded change. Delete and Set use only city.name and city.region
+ * to identify the city; Set also carries the attribute and its new value.
+ */
+struct JournalEntry
+{
+    JournalOperation operation = JournalOperation::Add;
+    CityRecord city;
+    string attribute;
+    string value;
+};
+
+/**
+ * Append-only change log with group commit: records are buffered and made
+ * durable together by one write and fdatasync.
+ */
+class Journal
+{
+private:
+    int fd;                // Descriptor of the open journal file, or -1
+    string path;           // Path of the journal file
+    string pending;        // Encoded records not yet written
+    size_t pendingRecords; // Number of records in pending
+    uint64_t durableBytes; // Bytes already written and synced
+    chrono::steady_clock::time_point lastCommit;
+
+    /**
+     * Truncates the file back to durableBytes after a failed commit.
+     * Returns false if the truncate itself failed.
+     */
+    bool discardUnsynced();
+
+public:
+    // Group commit limits: a commit is forced once any of these is reached
+    static const size_t GROUP_RECORDS = 512;
+    static const size_t GROUP_BYTES = 1 << 20;
+    static constexpr chrono::milliseconds GROUP_INTERVAL{50};
+
+    /**
+     * Constructor creates a journal with no file open.
+     */
+    Journal();
+
+    /**
+     * Destructor commits any pending records and closes the file.
+     */
+    ~Journal();
+
+    Journal(const Journal &) = delete;
+    Journal &operator=(const Journal &) = delete;
+
+    /**
+     * Opens or creates the journal, returning its intact records in entries.
+     * A torn tail is truncated away and its size reported in discardedBytes.
+     * Returns false and sets error on failure.
+     */
+    bool open(const string &filename, vector<JournalEntry> &entries, size_t &discardedBytes, string &error);
+
+    /**
+     * Returns true if a journal file is open.
+     */
+    bool isOpen() const;
+
+    /**
+     * Buffers a record, committing the group once it is large or old enough.
+     */
+    void append(const JournalEntry &entry);
+
+    /**
+     * Writes and syncs every pending record. Returns false on an I/O error.
+     */
+    bool commit();
+
+    /**
+     * Empties the journal once its changes are in the base data file.
+     */
+    bool reset();
+
+    /**
+     * Returns the journal size in bytes, including pending records.
+     */
+    uint64_t size() const;
+
+    /**
+     * Returns the path of the journal file.
+     */
+    const string &filename() const;
+};
+
+#endif // JOURNAL_H
@@ -0,0 +1,420 @@
+#include "NameTrie.h"
+#include <algorithm>
+#include <limits>
+
+/**
+ * State of one edit-distance walk. rows holds one row of the edit-distance table per
+ * character of the path, each text.size() + 1 entries wide.
+ */
+struct NameTrie::Search
+{
+    string_view text;
+    bool prefix;
+    size_t limit;
+    int cutoff;                                // Largest distance that can still make the result
+    string path;                               // Characters from the root to the current position
+    vector<int> rows;                          // Edit-distance rows for path lengths 0..path.size()
+    vector<int> best;                          // Prefix walks: smallest final-column entry along the path
+    vector<vector<NameSuggestion>> byDistance; // Matches found so far, by distance, each in alphabetical order
+
+    // Extends the path by one character and returns a lower bound on the distance of any name continuing it
+    int extend(char c);
+
+    // Returns the distance of the name spelled by the path
+    int distance() const
+    {
+        return prefix ? best[path.size()] : rows[path.size() * (text.size() + 1) + text.size()];
+    }
+};
+
+/**
+ * Extends the path by one character and computes its edit-distance row. Row minimums never
+ * decrease further down, so the smallest entry bounds every name continuing the path.
+ */
+int NameTrie::Search::extend(char c)
+{
+    const size_t width = text.size() + 1;
+    const size_t depth = path.size();
+    rows.resize((depth + 2) * width);
+    const int *previous = &rows[depth * width];
+    int *row = &rows[(depth + 1) * width];
+    row[0] = static_cast<int>(depth + 1);
+    int bound = row[0];
+    for (size_t i = 1; i < width; ++i)
+    {
+        const int substitution = previous[i - 1] + (text[i - 1] == c ? 0 : 1);
+        row[i] = min({previous[i] + 1, row[i - 1] + 1, substitution});
+        // Two adjacent characters typed the wrong way round count as one edit
+        if (i > 1 && depth > 0 && text[i - 1] == path[depth - 1] && text[i - 2] == c)
+            row[i] = min(row[i], rows[(depth - 1) * width + i - 2] + 1);
+        bound = min(bound, row[i]);
+    }
+    path.push_back(c);
+    if (prefix)
+    {
+        // Every name below has this prefix, so no name below is farther than the best prefix so far
+        best.resize(depth + 2);
+        best[depth + 1] = min(best[depth], row[width - 1]);
+        bound = min(bound, best[depth + 1]);
+    }
+    return bound;
+}
+
+/**
+ * Constructor creates a trie that still needs building.
+ */
+NameTrie::NameTrie() : garbage(0), names(0), built(false)
+{
+}
+
+/**
+ * Returns the label of a node.
+ */
+string_view NameTrie::labelOf(uint32_t node) const
+{
+    return string_view(characters).substr(nodes[node].label, nodes[node].length);
+}
+
+/**
+ * Returns the child of node whose label starts with c, or NONE.
+ */
+uint32_t NameTrie::findChild(uint32_t node, char c) const
+{
+    uint32_t child = nodes[node].child;
+    while (child != NONE && static_cast<unsigned char>(characters[nodes[child].label]) < static_cast<unsigned char>(c))
+    {
+        child = nodes[child].sibling;
+    }
+    return child != NONE && characters[nodes[child].label] == c ? child : NONE;
+}
+
+/**
+ * Returns a cleared node, reusing an unlinked one if possible.
+ */
+uint32_t NameTrie::newNode()
+{
+    if (freeNodes.empty())
+    {
+        nodes.emplace_back();
+        return static_cast<uint32_t>(nodes.size() - 1);
+    }
+    uint32_t node = freeNodes.back();
+    freeNodes.pop_back();
+    nodes[node] = Node();
+    return node;
+}
+
+/**
+ * Adds count cities with a name. An edge that shares only part of its label with the
+ * name is split in two where they differ.
+ */
+void NameTrie::insert(string_view name, uint32_t count)
+{
+    uint32_t node = ROOT;
+    size_t at = 0;
+    while (at < name.size())
+    {
+        uint32_t child = findChild(node, name[at]);
+        if (child == NONE)
+        {
+            // The rest of the name becomes a new leaf, linked in label order
+            uint32_t leaf = newNode();
+            nodes[leaf].label = static_cast<uint32_t>(characters.size());
+            nodes[leaf].length = static_cast<uint32_t>(name.size() - at);
+            characters.append(name.substr(at));
+            uint32_t *link = &nodes[node].child;
+            while (*link != NONE && static_cast<unsigned char>(characters[nodes[*link].label]) <
+                                        static_cast<unsigned char>(name[at]))
+            {
+                link = &nodes[*link].sibling;
+            }
+            nodes[leaf].sibling = *link;
+            *link = leaf;
+            node = leaf;
+            break;
+        }
+
+        const string_view label = labelOf(child);
+        const string_view rest = name.substr(at);
+        size_t common = 0;
+        while (common < label.size() && common < rest.size() && label[common] == rest[common])
+        {
+            ++common;
+        }
+        if (common < label.size())
+        {
+            // The child keeps the shared part; a new node below it takes the remainder and the child's names
+            uint32_t lower = newNode();
+            nodes[lower].child = nodes[child].child;
+            nodes[lower].here = nodes[child].here;
+            nodes[lower].label = nodes[child].label + static_cast<uint32_t>(common);
+            nodes[lower].length = nodes[child].length - static_cast<uint32_t>(common);
+            nodes[child].child = lower;
+            nodes[child].here = 0;
+            nodes[child].length = static_cast<uint32_t>(common);
+        }
+        node = child;
+        at += common;
+    }
+    if (nodes[node].here == 0)
+        ++names;
+    nodes[node].here += count;
+}
+
+/**
+ * Appends the names below node in alphabetical order, until result holds limit names.
+ */
+void NameTrie::collect(uint32_t node, string &path, size_t limit, vector<NameSuggestion> &result) const
+{
+    if (nodes[node].here > 0)
+        result.push_back({path, nodes[node].here, 0});
+    for (uint32_t child = nodes[node].child; child != NONE && result.size() < limit; child = nodes[child].sibling)
+    {
+        const size_t length = path.size();
+        path.append(labelOf(child));
+        collect(child, path, limit, result);
+        path.resize(length);
+    }
+}
+
+/**
+ * Follows each child's label a character at a time, extending the edit-distance table,
+ * and leaves the edge as soon as no name below it can come within the cutoff.
+ */
+void NameTrie::walk(uint32_t node, Search &search) const
+{
+    for (uint32_t child = nodes[node].child; child != NONE; child = nodes[child].sibling)
+    {
+        const size_t length = search.path.size();
+        bool reachable = true;
+        for (char c : labelOf(child))
+        {
+            if (search.extend(c) > search.cutoff)
+            {
+                reachable = false;
+                break;
+            }
+        }
+        if (reachable)
+        {
+            const int distance = search.distance();
+            if (nodes[child].here > 0 && distance <= search.cutoff)
+            {
+                search.byDistance[distance].push_back({search.path, nodes[child].here, distance});
+                // Once the closer matches fill the result, farther ones need not be looked for
+                size_t closer = 0;
+                for (int d = 0; d <= search.cutoff; ++d)
+                {
+                    closer += search.byDistance[d].size();
+                    if (closer >= search.limit)
+                    {
+                        search.cutoff = d - 1;
+                        break;
+                    }
+                }
+            }
+            if (search.cutoff >= 0)
+                walk(child, search);
+        }
+        search.path.resize(length);
+        if (search.cutoff < 0)
+            return;
+    }
+}
+
+/**
+ * Returns true if the trie is up to date.
+ */
+bool NameTrie::isBuilt() const
+{
+    return built;
+}
+
+/**
+ * Drops all names; the trie is rebuilt on next use.
+ */
+void NameTrie::invalidate()
+{
+    nodes.clear();
+    nodes.shrink_to_fit();
+    freeNodes.clear();
+    freeNodes.shrink_to_fit();
+    characters.clear();
+    characters.shrink_to_fit();
+    garbage = 0;
+    names = 0;
+    built = false;
+}
+
+/**
+ * Rebuilds the trie from the cities stored by record ID (nullptr for free IDs).
+ */
+void NameTrie::rebuild(const vector<City *> &rows)
+{
+    invalidate();
+    nodes.emplace_back();
+    built = true;
+    for (const City *city : rows)
+    {
+        if (city != nullptr)
+            insert(city->name, 1);
+    }
+}
+
+/**
+ * Counts one more city with a name in a built trie.
+ */
+void NameTrie::add(string_view name)
+{
+    if (built)
+        insert(name, 1);
+}
+
+/**
+ * Counts one city fewer with a name in a built trie, removing the name when none is left.
+ * Nodes left without cities are unlinked and reused by later additions; once their labels
+ * outgrow the ones in use, the trie is rebuilt from its own names.
+ */
+void NameTrie::remove(string_view name)
+{
+    if (!built)
+        return;
+    vector<uint32_t> path{ROOT};
+    size_t at = 0;
+    while (at < name.size())
+    {
+        uint32_t child = findChild(path.back(), name[at]);
+        if (child == NONE || name.substr(at, nodes[child].length) != labelOf(child))
+            return;
+        at += nodes[child].length;
+        path.push_back(child);
+    }
+    Node &last = nodes[path.back()];
+    if (last.here == 0)
+        return;
+    if (--last.here > 0)
+        return;
+    --names;
+
+    // Unlink the nodes left with neither cities nor children, bottom up
+    size_t depth = path.size() - 1;
+    while (depth > 0 && nodes[path[depth]].here == 0 && nodes[path[depth]].child == NONE)
+    {
+        uint32_t *link = &nodes[path[depth - 1]].child;
+        while (*link != path[depth])
+        {
+            link = &nodes[*link].sibling;
+        }
+        *link = nodes[path[depth]].sibling;
+        garbage += nodes[path[depth]].length;
+        freeNodes.push_back(path[depth]);
+        --depth;
+    }
+
+    // A node left with one child and no cities of its own is merged with the child when their labels adjoin
+    Node &upper = nodes[path[depth]];
+    if (depth > 0 && upper.here == 0 && upper.child != NONE && nodes[upper.child].sibling == NONE &&
+        upper.label + upper.length == nodes[upper.child].label)
+    {
+        uint32_t lower = upper.child;
+        upper.length += nodes[lower].length;
+        upper.here = nodes[lower].here;
+        upper.child = nodes[lower].child;
+        freeNodes.push_back(lower);
+    }
+
+    if (garbage > GARBAGE_MIN_CHARACTERS && garbage > characters.size() - garbage)
+    {
+        vector<NameSuggestion> all;
+        string prefix;
+        collect(ROOT, prefix, numeric_limits<size_t>::max(), all);
+        invalidate();
+        nodes.emplace_back();
+        built = true;
+        for (const NameSuggestion &suggestion : all)
+        {
+            insert(suggestion.name, suggestion.cities);
+        }
+    }
+}
+
+/**
+ * Appends up to limit names starting with prefix, in alphabetical order.
+ */
+void NameTrie::complete(string_view prefix, size_t limit, vector<NameSuggestion> &result) const
+{
+    if (nodes.empty() || limit == 0)
+        return;
+    uint32_t node = ROOT;
+    string path;
+    size_t at = 0;
+    while (at < prefix.size())
+    {
+        // The prefix may end part way along the last label
+        node = findChild(node, prefix[at]);
+        if (node == NONE)
+            return;
+        const string_view label = labelOf(node);
+        const size_t compared = min(label.size(), prefix.size() - at);
+        if (label.substr(0, compared) != prefix.substr(at, compared))
+            return;
+        path.append(label);
+        at += compared;
+    }
+    collect(node, path, result.size() + limit, result);
+}
+
+/**
+ * Appends up to limit names within maxDistance edits (insertions, deletions, substitutions
+ * and swaps of adjacent characters) of text, closest first and alphabetical among equals.
+ * With prefix set, a name matches if any of its prefixes is close enough to text.
+ * The walk keeps one row of the edit-distance table per character of the path, so names
+ * sharing a prefix share its work, and it stops descending wherever the row exceeds the
+ * cutoff. The cutoff shrinks as closer matches fill the result.
+ */
+void NameTrie::similar(string_view text, int maxDistance, bool prefix, size_t limit,
+                       vector<NameSuggestion> &result) const
+{
+    if (nodes.empty() || limit == 0 || maxDistance < 0)
+        return;
+    Search search;
+    search.text = text;
+    search.prefix = prefix;
+    search.limit = limit;
+    search.cutoff = maxDistance;
+    search.byDistance.resize(maxDistance + 1);
+    search.rows.resize(text.size() + 1);
+    for (size_t i = 0; i <= text.size(); ++i)
+    {
+        search.rows[i] = static_cast<int>(i);
+    }
+    search.best.push_back(static_cast<int>(text.size()));
+    walk(ROOT, search);
+
+    size_t added = 0;
+    for (vector<NameSuggestion> &matches : search.byDistance)
+    {
+        for (NameSuggestion &suggestion : matches)
+        {
+            if (added++ == limit)
+                return;
+            result.push_back(move(suggestion));
+        }
+    }
+}
+
+/**
+ * Returns the number of distinct names.
+ */
+size_t NameTrie::size() const
+{
+    return names;
+}
+
+/**
+ * Returns the approximate memory used by the trie in bytes.
+ */
+size_t NameTrie::bytes() const
+{
+    return nodes.capacity() * sizeof(Node) + freeNodes.capacity() * sizeof(uint32_t) + characters.capacity();
+}
@@ -0,0 +1,131 @@
+#ifndef NAMETRIE_H
+#define NAMETRIE_H
+
+#include "City.h"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * A city name offered by the name trie, with the number of cities using it.
+ */
+struct NameSuggestion
+{
+    string name;
+    uint32_t cities = 0;
+    int distance = 0; // Edit distance from the text looked up; 0 for an exact prefix
+};
+
+/**
+ * Radix trie over the distinct lowercase city names, for autocompletion and typo-tolerant
+ * lookups. Each edge is labelled with a run of characters held in one shared buffer, so a
+ * name costs about one node beyond the prefix it shares with others. Nodes live in one
+ * array and link to their first child and next sibling, siblings sorted by the first
+ * character of their label, so a walk visits names in alphabetical order. Nodes left
+ * without cities are unlinked, so every branch a walk enters leads to a name.
+ * Like the sorted indexes, the trie is built on first use and maintained incrementally after that.
+ */
+class NameTrie
+{
+private:
+    // One edge and the node it leads to
+    struct Node
+    {
+        uint32_t child = NONE;   // First child, or NONE
+        uint32_t sibling = NONE; // Next sibling, whose label starts with a greater character, or NONE
+        uint32_t here = 0;       // Cities whose name ends at this node
+        uint32_t label = 0;      // Offset of the edge label in characters
+        uint32_t length = 0;     // Length of the edge label; 0 only for the root
+    };
+
+    static constexpr uint32_t NONE = UINT32_MAX;
+    static constexpr uint32_t ROOT = 0;
+
+    // Unused label characters that trigger a rebuild, beyond the characters in use
+    static const size_t GARBAGE_MIN_CHARACTERS = 1 << 16;
+
+    vector<Node> nodes;         // Every node; nodes[ROOT] is the empty name
+    vector<uint32_t> freeNodes; // Unlinked nodes ready for reuse
+    string characters;          // Edge labels, back to back
+    size_t garbage;             // Characters of labels no longer linked
+    size_t names;               // Distinct names with at least one city
+    bool built;                 // False until rebuilt; updates are skipped meanwhile
+
+    // Returns the label of a node
+    string_view labelOf(uint32_t node) const;
+
+    // Returns the child of node whose label starts with c, or NONE
+    uint32_t findChild(uint32_t node, char c) const;
+
+    // Returns a cleared node, reusing an unlinked one if possible
+    uint32_t newNode();
+
+    // Adds count cities with a name
+    void insert(string_view name, uint32_t count);
+
+    // Appends the names below node in alphabetical order, until result holds limit names
+    void collect(uint32_t node, string &path, size_t limit, vector<NameSuggestion> &result) const;
+
+    // Edit-distance walk below node; see similar
+    struct Search;
+    void walk(uint32_t node, Search &search) const;
+
+public:
+    /**
+     * Constructor creates a trie that still needs building.
+     */
+    NameTrie();
+
+    /**
+     * Returns true if the trie is up to date.
+     */
+    bool isBuilt() const;
+
+    /**
+     * Drops all names; the trie is rebuilt on next use.
+     */
+    void invalidate();
+
+    /**
+     * Rebuilds the trie from the cities stored by record ID (nullptr for free IDs).
+     */
+    void rebuild(const vector<City *> &rows);
+
+    /**
+     * Counts one more city with a name in a built trie.
+     */
+    void add(string_view name);
+
+    /**
+     * Counts one city fewer with a name in a built trie, removing the name when none is left.
+     */
+    void remove(string_view name);
+
+    /**
+     * Appends up to limit names starting with prefix, in alphabetical order.
+     */
+    void complete(string_view prefix, size_t limit, vector<NameSuggestion> &result) const;
+
+    /**
+     * Appends up to limit names within maxDistance edits (insertions, deletions, substitutions
+     * and swaps of adjacent characters) of text, closest first and alphabetical among equals.
+     * With prefix set, a name matches if any of its prefixes is close enough to text.
+     */
+    void similar(string_view text, int maxDistance, bool prefix, size_t limit, vector<NameSuggestion> &result) const;
+
+    /**
+     * Returns the number of distinct names.
+     */
+    size_t size() const;
+
+    /**
+     * Returns the approximate memory used by the trie in bytes.
+     */
+    size_t bytes() const;
+};
+
+#endif // NAMETRIE_H
@@ -0,0 +1,202 @@
+#include "NormalizedKeys.h"
+#include <algorithm>
+#include <numeric>
+#include <bit>
+#include <cstring>
+
+/**
+ * Reserves room for a number of rows of about bytesPerRow each.
+ */
+void NormalizedKeys::reserve(size_t rows, size_t bytesPerRow)
+{
+    bytes.reserve(rows * bytesPerRow);
+    ends.reserve(rows);
+}
+
+/**
+ * Appends the low size bytes of value, most significant first, complemented if descending.
+ */
+void NormalizedKeys::appendBigEndian(uint64_t value, size_t size, bool descending)
+{
+    if (descending)
+        value = ~value;
+    for (size_t shift = size * 8; shift > 0; shift -= 8)
+    {
+        bytes.push_back(static_cast<unsigned char>(value >> (shift - 8)));
+    }
+}
+
+/**
+ * Appends an integer field to the current row. Flipping the sign bit maps INT_MIN..INT_MAX
+ * onto 0..UINT32_MAX in order.
+ */
+void NormalizedKeys::appendInteger(int value, bool descending)
+{
+    appendBigEndian(static_cast<uint32_t>(value) ^ 0x80000000u, 4, descending);
+}
+
+/**
+ * Appends a real field to the current row. Positive doubles already order like their bits,
+ * so setting the sign bit puts them above every negative one; negative doubles order in
+ * reverse, which complementing every bit undoes. -0 is stored as 0 so the two are equal.
+ */
+void NormalizedKeys::appendReal(double value, bool descending)
+{
+    uint64_t bits = bit_cast<uint64_t>(value == 0.0 ? 0.0 : value);
+    bits = (bits >> 63) != 0 ? ~bits : bits | (uint64_t(1) << 63);
+    appendBigEndian(bits, 8, descending);
+}
+
+/**
+ * Appends a text field to the current row. The 00 00 terminator sorts below any byte of
+ * a longer text, so a prefix comes first, and escaping NUL keeps it from ending the text.
+ */
+void NormalizedKeys::appendText(string_view text, bool descending)
+{
+    const unsigned char mask = descending ? 0xFF : 0x00;
+    for (char c : text)
+    {
+        bytes.push_back(static_cast<unsigned char>(c) ^ mask);
+        if (c == '\0')
+            bytes.push_back(0xFF ^ mask);
+    }
+    bytes.push_back(mask);
+    bytes.push_back(mask);
+}
+
+/**
+ * Ends the current row; the next field starts a new one.
+ */
+void NormalizedKeys::endRow()
+{
+    ends.push_back(bytes.size());
+}
+
+/**
+ * Returns the number of rows ended so far.
+ */
+size_t NormalizedKeys::size() const
+{
+    return ends.size();
+}
+
+/**
+ * Returns the byte of a row's key at depth plus one, or 0 past its end, so a key that
+ * ends lands in the first bucket.
+ */
+unsigned NormalizedKeys::digit(uint32_t row, size_t depth) const
+{
+    const size_t position = (row == 0 ? 0 : ends[row - 1]) + depth;
+    return position < ends[row] ? bytes[position] + 1u : 0u;
+}
+
+/**
+ * Returns true if row a's key is less than row b's, both equal before depth.
+ */
+bool NormalizedKeys::less(uint32_t a, uint32_t b, size_t depth) const
+{
+    const size_t startA = (a == 0 ? 0 : ends[a - 1]) + depth;
+    const size_t startB = (b == 0 ? 0 : ends[b - 1]) + depth;
+    const size_t lengthA = ends[a] - startA;
+    const size_t lengthB = ends[b] - startB;
+    int order = memcmp(bytes.data() + startA, bytes.data() + startB, min(lengthA, lengthB));
+    return order != 0 ? order < 0 : lengthA < lengthB;
+}
+
+/**
+ * Insertion sort of count rows whose keys are equal before depth; stable, as it only moves
+ * a row past rows with greater keys.
+ */
+void NormalizedKeys::insertionSort(uint32_t *rows, size_t count, size_t depth) const
+{
+    for (size_t i = 1; i < count; ++i)
+    {
+        const uint32_t row = rows[i];
+        size_t j = i;
+        for (; j > 0 && less(row, rows[j - 1], depth); --j)
+        {
+            rows[j] = rows[j - 1];
+        }
+        rows[j] = row;
+    }
+}
+
+/**
+ * Stable radix sort of count rows. Each pass takes a bucket of rows whose keys are equal
+ * before some depth, counts its rows per byte at that depth, moves them into their buckets
+ * through buffer in their current order, then queues each new bucket for the following
+ * byte. Rows whose keys ended are equal and stay as they are; small buckets are finished
+ * by insertion sort. Buckets wait on an explicit stack rather than the call stack, since
+ * a key can be as long as its text and each pass needs its 257 counts.
+ */
+void NormalizedKeys::sortRows(uint32_t *rows, uint32_t *buffer, size_t count) const
+{
+    struct Bucket
+    {
+        size_t start; // First row of the bucket
+        size_t count; // Rows in the bucket
+        size_t depth; // Byte the rows may first differ at
+    };
+    vector<Bucket> pending;
+    pending.push_back({0, count, 0});
+    size_t counts[257];
+    size_t starts[257];
+
+    while (!pending.empty())
+    {
+        Bucket bucket = pending.back();
+        pending.pop_back();
+        uint32_t *first = rows + bucket.start;
+        if (bucket.count < INSERTION_SORT_ROWS)
+        {
+            insertionSort(first, bucket.count, bucket.depth);
+            continue;
+        }
+
+        fill(begin(counts), end(counts), 0);
+        for (size_t i = 0; i < bucket.count; ++i)
+        {
+            counts[digit(first[i], bucket.depth)]++;
+        }
+
+        // Every row has the same byte here: move on to the next byte without moving rows
+        const unsigned shared = digit(first[0], bucket.depth);
+        if (counts[shared] == bucket.count)
+        {
+            if (shared != 0)
+                pending.push_back({bucket.start, bucket.count, bucket.depth + 1});
+            continue;
+        }
+
+        size_t start = 0;
+        for (unsigned value = 0; value < 257; ++value)
+        {
+            starts[value] = start;
+            start += counts[value];
+        }
+        for (size_t i = 0; i < bucket.count; ++i)
+        {
+            buffer[starts[digit(first[i], bucket.depth)]++] = first[i];
+        }
+        memcpy(first, buffer, bucket.count * sizeof(uint32_t));
+
+        // starts now holds the end of each bucket; rows whose keys ended (digit 0) are done
+        for (unsigned value = 1; value < 257; ++value)
+        {
+            if (counts[value] > 1)
+                pending.push_back({bucket.start + starts[value] - counts[value], counts[value], bucket.depth + 1});
+        }
+    }
+}
+
+/**
+ * Sets order to the row numbers 0..size()-1 in key order. Rows with equal keys keep the
+ * order they were added in.
+ */
+void NormalizedKeys::sort(vector<uint32_t> &order) const
+{
+    order.resize(ends.size());
+    iota(order.begin(), order.end(), 0);
+    vector<uint32_t> buffer(order.size());
+    sortRows(order.data(), buffer.data(), order.size());
+}
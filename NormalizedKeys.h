@@ -0,0 +1,83 @@
+#ifndef NORMALIZEDKEYS_H
+#define NORMALIZEDKEYS_H
+
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Binary-comparable sort keys for a list of rows. Each row's fields are appended in order
+ * of significance and encoded so that comparing two keys byte by byte, a key that ends
+ * first being smaller, orders the rows as comparing the fields one by one would:
+ *     integers - sign bit flipped, big-endian
+ *     reals    - sign bit flipped for positive values, every bit for negative ones, big-endian
+ *     text     - its bytes with NUL escaped as 00 FF, ended by 00 00
+ * A descending field has every byte of its encoding complemented. Rows are then ordered
+ * by a most-significant-byte-first radix sort, which never compares two fields.
+ */
+class NormalizedKeys
+{
+private:
+    // Rows left in a bucket below which insertion sort takes over from radix passes
+    static const size_t INSERTION_SORT_ROWS = 32;
+
+    vector<unsigned char> bytes; // Every key, back to back
+    vector<size_t> ends;         // End offset in bytes of each row's key
+
+    // Appends the low size bytes of value, most significant first, complemented if descending
+    void appendBigEndian(uint64_t value, size_t size, bool descending);
+
+    // Returns the byte of a row's key at depth plus one, or 0 past its end
+    unsigned digit(uint32_t row, size_t depth) const;
+
+    // Returns true if row a's key is less than row b's, both equal before depth
+    bool less(uint32_t a, uint32_t b, size_t depth) const;
+
+    // Stable radix sort of count rows whose keys are equal before depth, using buffer as scratch
+    void sortRows(uint32_t *rows, uint32_t *buffer, size_t count) const;
+
+    // Insertion sort of count rows whose keys are equal before depth
+    void insertionSort(uint32_t *rows, size_t count, size_t depth) const;
+
+public:
+    /**
+     * Reserves room for a number of rows of about bytesPerRow each.
+     */
+    void reserve(size_t rows, size_t bytesPerRow);
+
+    /**
+     * Appends an integer field to the current row.
+     */
+    void appendInteger(int value, bool descending);
+
+    /**
+     * Appends a real field to the current row.
+     */
+    void appendReal(double value, bool descending);
+
+    /**
+     * Appends a text field to the current row.
+     */
+    void appendText(string_view text, bool descending);
+
+    /**
+     * Ends the current row; the next field starts a new one.
+     */
+    void endRow();
+
+    /**
+     * Returns the number of rows ended so far.
+     */
+    size_t size() const;
+
+    /**
+     * Sets order to the row numbers 0..size()-1 in key order. Rows with equal keys keep
+     * the order they were added in.
+     */
+    void sort(vector<uint32_t> &order) const;
+};
+
+#endif // NORMALIZEDKEYS_H
@@ -0,0 +1,511 @@
+#include "QueryServer.h"
+#include <iostream>
+#include <algorithm>
+#include <streambuf>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+namespace
+{
+/**
+ * Stream buffer installed on cout and cerr while the server runs. Output from a thread
+ * that is running a command goes into that command's response; output from any other
+ * thread passes through to the original stream.
+ */
+class CaptureBuffer : public streambuf
+{
+private:
+    streambuf *original;
+
+public:
+    // Response being built by the calling thread, or nullptr when not running a command
+    static thread_local string *target;
+
+    explicit CaptureBuffer(streambuf *original) : original(original) {}
+
+    // Returns the buffer that uncaptured output passes through to
+    streambuf *passthrough() const
+    {
+        return original;
+    }
+
+protected:
+    int overflow(int c) override
+    {
+        if (c == traits_type::eof())
+            return traits_type::not_eof(c);
+        if (target == nullptr)
+            return original->sputc(static_cast<char>(c));
+        target->push_back(static_cast<char>(c));
+        return c;
+    }
+
+    streamsize xsputn(const char *data, streamsize count) override
+    {
+        if (target == nullptr)
+            return original->sputn(data, count);
+        target->append(data, static_cast<size_t>(count));
+        return count;
+    }
+
+    int sync() override
+    {
+        return target == nullptr ? original->pubsync() : 0;
+    }
+};
+
+thread_local string *CaptureBuffer::target = nullptr;
+
+/**
+ * Installs capture buffers on cout and cerr for as long as it exists.
+ */
+class OutputCapture
+{
+private:
+    CaptureBuffer outBuffer;
+    CaptureBuffer errorBuffer;
+
+public:
+    OutputCapture() : outBuffer(cout.rdbuf()), errorBuffer(cerr.rdbuf())
+    {
+        cout.rdbuf(&outBuffer);
+        cerr.rdbuf(&errorBuffer);
+    }
+
+    ~OutputCapture()
+    {
+        cout.rdbuf(outBuffer.passthrough());
+        cerr.rdbuf(errorBuffer.passthrough());
+    }
+};
+
+/**
+ * Puts a descriptor in non-blocking mode.
+ */
+bool setNonBlocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+} // namespace
+
+/**
+ * Constructor creates a server that runs commands with handler on the given number of workers.
+ */
+QueryServer::QueryServer(CommandHandler handler, size_t workers)
+    : handler(move(handler)), workerCount(max<size_t>(1, workers)), listenFd(-1), epollFd(-1), wakeFd(-1),
+      signalFd(-1), nextGeneration(0), stopping(false)
+{
+}
+
+/**
+ * Destructor closes every socket and removes the Unix socket file.
+ */
+QueryServer::~QueryServer()
+{
+    for (auto &entry : connections)
+        ::close(entry.first);
+    for (int fd : {listenFd, epollFd, wakeFd, signalFd})
+    {
+        if (fd >= 0)
+            ::close(fd);
+    }
+    if (!socketPath.empty())
+        ::unlink(socketPath.c_str());
+}
+
+/**
+ * Adds the listening socket to a fresh event loop; returns false and sets error on failure.
+ */
+bool QueryServer::startListening(int fd, string &error)
+{
+    if (::listen(fd, SOMAXCONN) != 0 || !setNonBlocking(fd))
+    {
+        error = string("Could not listen: ") + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    listenFd = fd;
+    epollFd = epoll_create1(EPOLL_CLOEXEC);
+    wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd < 0 || wakeFd < 0)
+    {
+        error = string("Could not create the event loop: ") + strerror(errno);
+        return false;
+    }
+    for (int watched : {listenFd, wakeFd})
+    {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = watched;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, watched, &event);
+    }
+    return true;
+}
+
+/**
+ * Listens on a Unix domain socket at path, replacing a stale socket file.
+ */
+bool QueryServer::listenUnix(const string &path, string &error)
+{
+    sockaddr_un address{};
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        error = "Socket path is too long: " + path;
+        return false;
+    }
+    address.sun_family = AF_UNIX;
+    memcpy(address.sun_path, path.c_str(), path.size() + 1);
+
+    int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = string("Could not create socket: ") + strerror(errno);
+        return false;
+    }
+    ::unlink(path.c_str());
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        error = "Could not bind " + path + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    socketPath = path;
+    return startListening(fd, error);
+}
+
+/**
+ * Listens on a TCP port of the loopback interface.
+ */
+bool QueryServer::listenTcp(uint16_t port, string &error)
+{
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error = string("Could not create socket: ") + strerror(errno);
+        return false;
+    }
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        error = "Could not bind port " + to_string(port) + ": " + strerror(errno);
+        ::close(fd);
+        return false;
+    }
+    return startListening(fd, error);
+}
+
+/**
+ * Takes commands from the queue and runs them, capturing their output as the response,
+ * until the server stops.
+ */
+void QueryServer::workerLoop()
+{
+    while (true)
+    {
+        Job job;
+        {
+            unique_lock<mutex> lock(jobMutex);
+            jobReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            job = move(jobs.front());
+            jobs.pop_front();
+        }
+
+        string output;
+        bool close = false;
+        CaptureBuffer::target = &output;
+        bool succeeded = handler(job.command, close);
+        CaptureBuffer::target = nullptr;
+
+        string response = (succeeded ? "OK " : "ERR ") + to_string(output.size()) + "\n";
+        response += output;
+        {
+            lock_guard<mutex> lock(completionMutex);
+            completions.push_back({job.fd, job.generation, move(response), close});
+        }
+        uint64_t one = 1;
+        ssize_t ignored = ::write(wakeFd, &one, sizeof(one));
+        (void)ignored;
+    }
+}
+
+/**
+ * Accepts every pending client.
+ */
+void QueryServer::acceptClients()
+{
+    while (true)
+    {
+        int fd = ::accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return; // EAGAIN once the backlog is empty; other errors leave the client to retry
+        Connection &connection = connections[fd];
+        connection = {fd, nextGeneration++, string(), string(), false, false};
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+/**
+ * Reads what a client sent; returns false if the connection should be closed.
+ */
+bool QueryServer::readClient(Connection &connection)
+{
+    char buffer[1 << 16];
+    while (true)
+    {
+        ssize_t count = ::read(connection.fd, buffer, sizeof(buffer));
+        if (count > 0)
+        {
+            connection.input.append(buffer, static_cast<size_t>(count));
+            continue;
+        }
+        if (count == 0)
+        {
+            connection.closing = true; // Answer what was sent, then close
+            return true;
+        }
+        if (errno == EINTR)
+            continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+}
+
+/**
+ * Hands the client's next complete command line to the workers, if the client is idle.
+ * Blank lines and lines starting with '#' are skipped, as in batch mode. Once the client
+ * has hung up, a last line without a newline is run too.
+ */
+void QueryServer::dispatchNext(Connection &connection)
+{
+    while (!connection.busy && !connection.input.empty())
+    {
+        size_t end = connection.input.find('\n');
+        if (end == string::npos)
+        {
+            if (connection.input.size() > MAX_REQUEST_BYTES)
+            {
+                connection.closing = true;
+                connection.input.clear();
+                return;
+            }
+            if (!connection.closing)
+                return;
+            end = connection.input.size();
+        }
+        string command = connection.input.substr(0, end);
+        connection.input.erase(0, min(end + 1, connection.input.size()));
+        size_t first = command.find_first_not_of(" \t\r");
+        if (first == string::npos || command[first] == '#')
+            continue;
+        connection.busy = true;
+        {
+            lock_guard<mutex> lock(jobMutex);
+            jobs.push_back({connection.fd, connection.generation, move(command)});
+        }
+        jobReady.notify_one();
+    }
+}
+
+/**
+ * Sends as much buffered output as the socket takes; returns false on error.
+ */
+bool QueryServer::writeClient(Connection &connection)
+{
+    size_t sent = 0;
+    while (sent < connection.output.size())
+    {
+        ssize_t count = ::send(connection.fd, connection.output.data() + sent, connection.output.size() - sent,
+                               MSG_NOSIGNAL);
+        if (count < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            return false;
+        }
+        sent += static_cast<size_t>(count);
+    }
+    connection.output.erase(0, sent);
+    return true;
+}
+
+/**
+ * Watches a client for input, and for output space while it has output to send. A client
+ * that is closing and has nothing to send is not watched at all, so that its hang-up does
+ * not wake the loop over and over while its last command runs.
+ */
+void QueryServer::updateInterest(const Connection &connection)
+{
+    uint32_t interest = connection.closing ? 0u : static_cast<uint32_t>(EPOLLIN | EPOLLRDHUP);
+    if (!connection.output.empty())
+        interest |= EPOLLOUT;
+    if (interest == 0)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, connection.fd, nullptr);
+        return;
+    }
+    epoll_event event{};
+    event.events = interest;
+    event.data.fd = connection.fd;
+    if (epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event) != 0 && errno == ENOENT)
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, connection.fd, &event);
+}
+
+/**
+ * Closes a client and forgets its state.
+ */
+void QueryServer::closeConnection(int fd)
+{
+    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+    ::close(fd);
+    connections.erase(fd);
+}
+
+/**
+ * Moves finished responses into their connections' output, then sends them and
+ * dispatches each connection's next command.
+ */
+void QueryServer::collectCompletions()
+{
+    uint64_t count = 0;
+    ssize_t ignored = ::read(wakeFd, &count, sizeof(count));
+    (void)ignored;
+
+    vector<Completion> finished;
+    {
+        lock_guard<mutex> lock(completionMutex);
+        finished.swap(completions);
+    }
+    for (Completion &completion : finished)
+    {
+        auto it = connections.find(completion.fd);
+        if (it == connections.end() || it->second.generation != completion.generation)
+            continue; // The client is gone
+        Connection &connection = it->second;
+        connection.busy = false;
+        connection.output += completion.response;
+        if (completion.close)
+        {
+            connection.closing = true;
+            connection.input.clear();
+        }
+        dispatchNext(connection);
+        if (!writeClient(connection) ||
+            (connection.closing && !connection.busy && connection.output.empty()))
+        {
+            closeConnection(connection.fd);
+            continue;
+        }
+        updateInterest(connection);
+    }
+}
+
+/**
+ * Serves clients until SIGINT or SIGTERM, then lets running commands finish.
+ */
+int QueryServer::run()
+{
+    if (epollFd < 0)
+    {
+        cerr << "Error: The server is not listening." << endl;
+        return 1;
+    }
+
+    // Deliver SIGINT and SIGTERM through the event loop; workers inherit the mask
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    epoll_event signalEvent{};
+    signalEvent.events = EPOLLIN;
+    signalEvent.data.fd = signalFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, signalFd, &signalEvent);
+
+    OutputCapture capture;
+    vector<thread> workers;
+    for (size_t i = 0; i < workerCount; ++i)
+        workers.emplace_back(&QueryServer::workerLoop, this);
+
+    const int MAX_EVENTS = 256;
+    epoll_event events[MAX_EVENTS];
+    bool running = true;
+    while (running)
+    {
+        int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+        if (ready < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            cerr << "Error: epoll_wait failed: " << strerror(errno) << endl;
+            break;
+        }
+        for (int i = 0; i < ready; ++i)
+        {
+            const int fd = events[i].data.fd;
+            if (fd == signalFd)
+            {
+                running = false;
+            }
+            else if (fd == listenFd)
+            {
+                acceptClients();
+            }
+            else if (fd == wakeFd)
+            {
+                collectCompletions();
+            }
+            else
+            {
+                auto it = connections.find(fd);
+                if (it == connections.end())
+                    continue;
+                Connection &connection = it->second;
+                bool healthy = true;
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                    healthy = readClient(connection);
+                if (healthy && (events[i].events & EPOLLOUT))
+                    healthy = writeClient(connection);
+                if (healthy)
+                    dispatchNext(connection);
+                if (!healthy || (connection.closing && !connection.busy && connection.output.empty()))
+                {
+                    closeConnection(fd);
+                    continue;
+                }
+                updateInterest(connection);
+            }
+        }
+    }
+
+    {
+        lock_guard<mutex> lock(jobMutex);
+        stopping = true;
+    }
+    jobReady.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+    return 0;
+}
@@ -0,0 +1,142 @@
+#ifndef QUERYSERVER_H
+#define QUERYSERVER_H
+
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Runs one command. Everything the command writes to cout or cerr becomes its response.
+ * Returns false if the command failed; sets closeConnection to end the client's session.
+ */
+using CommandHandler = function<bool(const string &command, bool &closeConnection)>;
+
+/**
+ * Long-running query server for local clients.
+ * One thread runs an epoll event loop over a Unix domain socket or a localhost TCP port,
+ * and a pool of worker threads runs the commands. A client sends one command per line and
+ * receives one response per command, in order, framed as a header line followed by the
+ * command's output:
+ *     OK <bytes>\n<output>     or     ERR <bytes>\n<output>
+ * Commands from different clients run in parallel; each client's commands run one at a time.
+ */
+class QueryServer
+{
+private:
+    // One client socket and its buffered input and output
+    struct Connection
+    {
+        int fd;
+        uint64_t generation; // Distinguishes this client from later ones given the same fd
+        string input;        // Bytes received and not yet dispatched
+        string output;       // Framed responses not yet sent
+        bool busy;           // True while one of its commands is with a worker
+        bool closing;        // True once the client hung up or asked to close
+    };
+
+    // A command waiting for a worker
+    struct Job
+    {
+        int fd;
+        uint64_t generation;
+        string command;
+    };
+
+    // A finished command waiting for the event loop to send its response
+    struct Completion
+    {
+        int fd;
+        uint64_t generation;
+        string response;
+        bool close;
+    };
+
+    CommandHandler handler;
+    size_t workerCount;
+    int listenFd;      // Listening socket, or -1
+    int epollFd;       // Event loop
+    int wakeFd;        // eventfd that workers signal when a command completes
+    int signalFd;      // signalfd receiving SIGINT and SIGTERM
+    string socketPath; // Unix socket file to remove on shutdown, if any
+
+    unordered_map<int, Connection> connections;
+    uint64_t nextGeneration;
+
+    mutex jobMutex;
+    condition_variable jobReady;
+    deque<Job> jobs;
+    bool stopping;
+
+    mutex completionMutex;
+    vector<Completion> completions;
+
+    // A request line longer than this closes the connection
+    static const size_t MAX_REQUEST_BYTES = 1 << 20;
+
+    // Takes commands from the queue and runs them until the server stops
+    void workerLoop();
+
+    // Accepts every pending client
+    void acceptClients();
+
+    // Reads what a client sent; returns false if the connection should be closed
+    bool readClient(Connection &connection);
+
+    // Hands the client's next complete command line to the workers, if it is idle
+    void dispatchNext(Connection &connection);
+
+    // Sends as much buffered output as the socket takes; returns false on error
+    bool writeClient(Connection &connection);
+
+    // Moves finished responses into their connections' output
+    void collectCompletions();
+
+    // Closes a client and forgets its state
+    void closeConnection(int fd);
+
+    // Watches a client for input, and for output space while it has output
+    void updateInterest(const Connection &connection);
+
+    // Adds the listening socket to a fresh event loop; returns false and sets error on failure
+    bool startListening(int fd, string &error);
+
+public:
+    /**
+     * Constructor creates a server that runs commands with handler on the given number of workers.
+     */
+    QueryServer(CommandHandler handler, size_t workers);
+
+    /**
+     * Destructor closes every socket and removes the Unix socket file.
+     */
+    ~QueryServer();
+
+    QueryServer(const QueryServer &) = delete;
+    QueryServer &operator=(const QueryServer &) = delete;
+
+    /**
+     * Listens on a Unix domain socket at path, replacing a stale socket file.
+     */
+    bool listenUnix(const string &path, string &error);
+
+    /**
+     * Listens on a TCP port of the loopback interface.
+     */
+    bool listenTcp(uint16_t port, string &error);
+
+    /**
+     * Serves clients until SIGINT or SIGTERM, then lets running commands finish. Returns the exit status.
+     */
+    int run();
+};
+
+#endif // QUERYSERVER_H
@@ -0,0 +1,128 @@
+#include "RegionDictionary.h"
+#include <algorithm>
+
+/**
+ * Constructor creates an empty dictionary.
+ */
+RegionDictionary::RegionDictionary() : characterCount(0) {}
+
+/**
+ * Returns the ID of a region name, adding the name if needed.
+ */
+uint32_t RegionDictionary::intern(const string &name)
+{
+    auto it = ids.find(name);
+    if (it != ids.end())
+    {
+        return it->second;
+    }
+    const uint32_t region = static_cast<uint32_t>(names.size());
+    names.push_back(name);
+    ids.emplace(names.back(), region);
+    postings.emplace_back();
+    unsorted.push_back(0);
+    characterCount += name.size();
+    return region;
+}
+
+/**
+ * Returns the ID of a region name, or NONE if it was never added.
+ */
+uint32_t RegionDictionary::find(const string &name) const
+{
+    auto it = ids.find(name);
+    return it == ids.end() ? NONE : it->second;
+}
+
+/**
+ * Returns the stored name of a region ID.
+ */
+const string *RegionDictionary::name(uint32_t region) const
+{
+    return &names[region];
+}
+
+/**
+ * Adds a record ID to the posting list of its region. New record IDs are usually the
+ * largest so far, which keeps the list in order; a reused smaller ID marks it unsorted.
+ */
+void RegionDictionary::add(uint32_t region, uint32_t recordId)
+{
+    vector<uint32_t> &list = postings[region];
+    if (recordId >= slots.size())
+    {
+        slots.resize(recordId + 1);
+    }
+    if (!list.empty() && list.back() > recordId)
+    {
+        unsorted[region] = 1;
+    }
+    slots[recordId] = static_cast<uint32_t>(list.size());
+    list.push_back(recordId);
+}
+
+/**
+ * Removes a record ID from the posting list of its region by moving the last entry
+ * into its place, which leaves the list unsorted until it is next read.
+ */
+void RegionDictionary::remove(uint32_t region, uint32_t recordId)
+{
+    vector<uint32_t> &list = postings[region];
+    const uint32_t position = slots[recordId];
+    const uint32_t last = list.back();
+    list.pop_back();
+    if (last != recordId)
+    {
+        list[position] = last;
+        slots[last] = position;
+        unsorted[region] = 1;
+    }
+}
+
+/**
+ * Returns the record IDs of a region's cities in ascending order, sorting the posting
+ * list first if changes have left it out of order.
+ */
+const vector<uint32_t> &RegionDictionary::cities(uint32_t region) const
+{
+    vector<uint32_t> &list = postings[region];
+    if (unsorted[region])
+    {
+        sort(list.begin(), list.end());
+        for (size_t i = 0; i < list.size(); ++i)
+        {
+            slots[list[i]] = static_cast<uint32_t>(i);
+        }
+        unsorted[region] = 0;
+    }
+    return list;
+}
+
+/**
+ * Sorts every posting list that changes have left out of order, so that later reads
+ * modify nothing.
+ */
+void RegionDictionary::sortPostings() const
+{
+    for (uint32_t region = 0; region < postings.size(); ++region)
+    {
+        if (unsorted[region])
+            cities(region);
+    }
+}
+
+/**
+ * Returns the number of distinct regions.
+ */
+size_t RegionDictionary::size() const
+{
+    return names.size();
+}
+
+/**
+ * Returns the total number of characters across all region names.
+ */
+size_t RegionDictionary::characters() const
+{
+    return characterCount;
+}
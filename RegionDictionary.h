@@ -0,0 +1,86 @@
+#ifndef REGIONDICTIONARY_H
+#define REGIONDICTIONARY_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Dictionary encoding of region names.
+ * Each distinct region is stored once and numbered with a small integer ID, so regions
+ * compare as integers. Every region also keeps a posting list of the record IDs of its
+ * cities, so the cities of one region are found without scanning the others.
+ */
+class RegionDictionary
+{
+private:
+    deque<string> names;                      // Name of each region ID; a deque keeps the strings in place
+    unordered_map<string_view, uint32_t> ids; // Region ID of each name, keyed by views into names
+    size_t characterCount;                    // Total characters across all region names
+
+    mutable vector<vector<uint32_t>> postings; // Record IDs of the cities in each region
+    mutable vector<unsigned char> unsorted;    // 1 when a posting list is out of record ID order
+    mutable vector<uint32_t> slots;            // Position of each record ID in its region's posting list
+
+public:
+    // Region ID returned by find for a name that was never added
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    /**
+     * Constructor creates an empty dictionary.
+     */
+    RegionDictionary();
+
+    /**
+     * Returns the ID of a region name, adding the name if needed.
+     */
+    uint32_t intern(const string &name);
+
+    /**
+     * Returns the ID of a region name, or NONE if it was never added.
+     */
+    uint32_t find(const string &name) const;
+
+    /**
+     * Returns the stored name of a region ID. The pointer stays valid for the lifetime of the dictionary.
+     */
+    const string *name(uint32_t region) const;
+
+    /**
+     * Adds a record ID to the posting list of its region.
+     */
+    void add(uint32_t region, uint32_t recordId);
+
+    /**
+     * Removes a record ID from the posting list of its region in constant time.
+     */
+    void remove(uint32_t region, uint32_t recordId);
+
+    /**
+     * Returns the record IDs of a region's cities in ascending order.
+     */
+    const vector<uint32_t> &cities(uint32_t region) const;
+
+    /**
+     * Sorts every posting list that changes have left out of order.
+     */
+    void sortPostings() const;
+
+    /**
+     * Returns the number of distinct regions.
+     */
+    size_t size() const;
+
+    /**
+     * Returns the total number of characters across all region names.
+     */
+    size_t characters() const;
+};
+
+#endif // REGIONDICTIONARY_H
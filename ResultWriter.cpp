@@ -0,0 +1,169 @@
+#include "ResultWriter.h"
+#include "Utilities.h"
+#include <charconv>
+
+/**
+ * Constructor writes to out with the given format and window.
+ */
+ResultWriter::ResultWriter(ostream &out, const OutputOptions &options)
+    : out(out), options(options), matched(0), written(0)
+{
+    buffer.reserve(BUFFER_BYTES + 4096);
+}
+
+/**
+ * Destructor writes out any buffered rows.
+ */
+ResultWriter::~ResultWriter()
+{
+    flush();
+}
+
+/**
+ * Appends a number as printed by an ostream with default formatting (six significant digits).
+ */
+void ResultWriter::appendNumber(double value)
+{
+    char digits[32];
+    auto result = to_chars(digits, digits + sizeof(digits), value, chars_format::general, 6);
+    buffer.append(digits, result.ptr);
+}
+
+/**
+ * Appends a string as a quoted JSON string, escaping quotes, backslashes and control characters.
+ */
+void ResultWriter::appendJson(const string &value)
+{
+    static const char HEX[] = "0123456789abcdef";
+    buffer.push_back('"');
+    for (char c : value)
+    {
+        unsigned char byte = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\')
+        {
+            buffer.push_back('\\');
+            buffer.push_back(c);
+        }
+        else if (byte < 0x20)
+        {
+            buffer.append("\\u00");
+            buffer.push_back(HEX[byte >> 4]);
+            buffer.push_back(HEX[byte & 0xF]);
+        }
+        else
+        {
+            buffer.push_back(c);
+        }
+    }
+    buffer.push_back('"');
+}
+
+/**
+ * Offers one matching city. Returns false once the limit is reached, so callers can stop.
+ */
+bool ResultWriter::write(const City &city, int population, int year, double latitude, double longitude)
+{
+    if (written >= options.limit)
+        return false;
+    if (matched++ < options.offset)
+        return true;
+
+    switch (options.format)
+    {
+    case OutputFormat::Table:
+        buffer.append("City: ").append(city.name);
+        buffer.append(", Region: ").append(*city.region);
+        buffer.append(", Population: ").append(to_string(population));
+        buffer.append(", Year: ").append(to_string(year));
+        buffer.append(", Mayor: ").append(city.mayorName);
+        buffer.append(", History: ").append(city.history);
+        buffer.append(", Latitude: ");
+        appendNumber(latitude);
+        buffer.append(", Longitude: ");
+        appendNumber(longitude);
+        break;
+    case OutputFormat::Csv:
+        // The data file format, so a listing can be loaded back in
+        buffer.append(escapeQuotes(city.name)).push_back(',');
+        buffer.append(escapeQuotes(*city.region)).push_back(',');
+        buffer.append(to_string(population)).push_back(',');
+        buffer.append(to_string(year)).push_back(',');
+        buffer.append(escapeQuotes(city.mayorName)).push_back(',');
+        buffer.append(escapeQuotes(city.mayorAddress)).push_back(',');
+        buffer.append(escapeQuotes(city.history)).push_back(',');
+        buffer.append(formatDouble(latitude)).push_back(',');
+        buffer.append(formatDouble(longitude));
+        break;
+    case OutputFormat::JsonLines:
+        buffer.append("{\"name\":");
+        appendJson(city.name);
+        buffer.append(",\"region\":");
+        appendJson(*city.region);
+        buffer.append(",\"population\":").append(to_string(population));
+        buffer.append(",\"year\":").append(to_string(year));
+        buffer.append(",\"mayorName\":");
+        appendJson(city.mayorName);
+        buffer.append(",\"mayorAddress\":");
+        appendJson(city.mayorAddress);
+        buffer.append(",\"history\":");
+        appendJson(city.history);
+        buffer.append(",\"latitude\":").append(formatDouble(latitude));
+        buffer.append(",\"longitude\":").append(formatDouble(longitude));
+        buffer.push_back('}');
+        break;
+    }
+    buffer.push_back('\n');
+    written++;
+
+    if (buffer.size() >= BUFFER_BYTES)
+        flush();
+    return written < options.limit;
+}
+
+/**
+ * Writes the number of matching rows instead of the rows themselves.
+ */
+void ResultWriter::writeCount(size_t count)
+{
+    switch (options.format)
+    {
+    case OutputFormat::Table:
+        buffer.append("Matching cities: ").append(to_string(count));
+        break;
+    case OutputFormat::Csv:
+        buffer.append(to_string(count));
+        break;
+    case OutputFormat::JsonLines:
+        buffer.append("{\"count\":").append(to_string(count)).push_back('}');
+        break;
+    }
+    buffer.push_back('\n');
+}
+
+/**
+ * Returns the number of rows offered so far, including those skipped by the offset.
+ */
+size_t ResultWriter::matchedRows() const
+{
+    return matched;
+}
+
+/**
+ * Returns the number of rows rendered so far.
+ */
+size_t ResultWriter::writtenRows() const
+{
+    return written;
+}
+
+/**
+ * Writes buffered rows to the stream in one block.
+ */
+void ResultWriter::flush()
+{
+    if (buffer.empty())
+        return;
+    out.write(buffer.data(), static_cast<streamsize>(buffer.size()));
+    out.flush();
+    buffer.clear();
+}
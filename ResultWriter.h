@@ -0,0 +1,94 @@
+#ifndef RESULTWRITER_H
+#define RESULTWRITER_H
+
+#include "City.h"
+#include <string>
+#include <ostream>
+#include <limits>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * How result rows are rendered.
+ */
+enum class OutputFormat
+{
+    Table,    // "City: ..., Region: ..." lines, as printed by display
+    Csv,      // Every field in the data file format
+    JsonLines // One JSON object per city
+};
+
+/**
+ * Format and window of the rows a listing command prints.
+ */
+struct OutputOptions
+{
+    OutputFormat format = OutputFormat::Table;
+    size_t offset = 0;                            // Matching rows to skip first
+    size_t limit = numeric_limits<size_t>::max(); // Most rows to print
+    bool countOnly = false;                       // Print only the number of matching rows
+};
+
+/**
+ * Renders result rows into a large buffer that is written out in big blocks,
+ * skipping rows before the offset and stopping at the limit.
+ */
+class ResultWriter
+{
+private:
+    ostream &out;
+    OutputOptions options;
+    string buffer;  // Rendered rows not yet written
+    size_t matched; // Rows offered so far, including skipped ones
+    size_t written; // Rows rendered so far
+
+    static const size_t BUFFER_BYTES = 1 << 20;
+
+    // Appends a number as printed by an ostream with default formatting
+    void appendNumber(double value);
+
+    // Appends a string as a quoted JSON string
+    void appendJson(const string &value);
+
+public:
+    /**
+     * Constructor writes to out with the given format and window.
+     */
+    ResultWriter(ostream &out, const OutputOptions &options);
+
+    /**
+     * Destructor writes out any buffered rows.
+     */
+    ~ResultWriter();
+
+    ResultWriter(const ResultWriter &) = delete;
+    ResultWriter &operator=(const ResultWriter &) = delete;
+
+    /**
+     * Offers one matching city. Returns false once the limit is reached, so callers can stop.
+     */
+    bool write(const City &city, int population, int year, double latitude, double longitude);
+
+    /**
+     * Writes the number of matching rows instead of the rows themselves.
+     */
+    void writeCount(size_t count);
+
+    /**
+     * Returns the number of rows offered so far, including those skipped by the offset.
+     */
+    size_t matchedRows() const;
+
+    /**
+     * Returns the number of rows rendered so far.
+     */
+    size_t writtenRows() const;
+
+    /**
+     * Writes buffered rows to the stream.
+     */
+    void flush();
+};
+
+#endif // RESULTWRITER_H
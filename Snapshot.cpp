@@ -0,0 +1,297 @@
+#include "Snapshot.h"
+#include "Utilities.h"
+#include <fstream>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+const char SNAPSHOT_MAGIC[8] = {'C', 'I', 'T', 'Y', 'S', 'N', 'A', 'P'};
+const uint32_t SNAPSHOT_VERSION = 1;
+const size_t STRINGS_PER_CITY = 4;
+
+/**
+ * Fixed-size file header preceding the payload.
+ */
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t cityCount;
+    uint64_t regionCount;
+    uint64_t heapBytes;
+    uint64_t payloadBytes;
+    uint64_t checksum; // checksum64 of the payload
+    uint64_t padding;
+};
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header must stay 64 bytes");
+
+/**
+ * Byte offsets of each payload section, relative to the start of the payload.
+ */
+struct SnapshotLayout
+{
+    size_t population, year, latitude, longitude, unitX, unitY, unitZ, region, offsets, heap, end;
+};
+
+size_t align8(size_t value)
+{
+    return (value + 7) & ~static_cast<size_t>(7);
+}
+
+SnapshotLayout layoutFor(size_t cities, size_t strings, size_t heapBytes)
+{
+    SnapshotLayout layout;
+    size_t at = 0;
+    layout.population = at;
+    at = align8(at + cities * sizeof(int32_t));
+    layout.year = at;
+    at = align8(at + cities * sizeof(int32_t));
+    layout.latitude = at;
+    at += cities * sizeof(double);
+    layout.longitude = at;
+    at += cities * sizeof(double);
+    layout.unitX = at;
+    at += cities * sizeof(double);
+    layout.unitY = at;
+    at += cities * sizeof(double);
+    layout.unitZ = at;
+    at += cities * sizeof(double);
+    layout.region = at;
+    at = align8(at + cities * sizeof(uint32_t));
+    layout.offsets = at;
+    at += (strings + 1) * sizeof(uint64_t);
+    layout.heap = at;
+    at += heapBytes;
+    layout.end = at;
+    return layout;
+}
+} // namespace
+
+/**
+ * Writes the snapshot to a temporary file and renames it into place.
+ */
+bool SnapshotData::write(const string &filename, string &error) const
+{
+    const size_t cities = population.size();
+    size_t heapBytes = 0;
+    for (string_view value : regions)
+        heapBytes += value.size();
+    for (string_view value : strings)
+        heapBytes += value.size();
+
+    const size_t stringCount = regions.size() + strings.size();
+    const SnapshotLayout layout = layoutFor(cities, stringCount, heapBytes);
+    vector<char> payload(layout.end, 0);
+    char *base = payload.data();
+    memcpy(base + layout.population, population.data(), cities * sizeof(int32_t));
+    memcpy(base + layout.year, year.data(), cities * sizeof(int32_t));
+    memcpy(base + layout.latitude, latitude.data(), cities * sizeof(double));
+    memcpy(base + layout.longitude, longitude.data(), cities * sizeof(double));
+    memcpy(base + layout.unitX, unitX.data(), cities * sizeof(double));
+    memcpy(base + layout.unitY, unitY.data(), cities * sizeof(double));
+    memcpy(base + layout.unitZ, unitZ.data(), cities * sizeof(double));
+    memcpy(base + layout.region, region.data(), cities * sizeof(uint32_t));
+
+    // String table: offsets array followed by the concatenated bytes
+    uint64_t *offsets = reinterpret_cast<uint64_t *>(base + layout.offsets);
+    char *heap = base + layout.heap;
+    uint64_t at = 0;
+    size_t index = 0;
+    auto append = [&](string_view value)
+    {
+        offsets[index++] = at;
+        memcpy(heap + at, value.data(), value.size());
+        at += value.size();
+    };
+    for (string_view value : regions)
+        append(value);
+    for (string_view value : strings)
+        append(value);
+    offsets[index] = at;
+
+    SnapshotHeader header = {};
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.cityCount = cities;
+    header.regionCount = regions.size();
+    header.heapBytes = heapBytes;
+    header.payloadBytes = payload.size();
+    header.checksum = checksum64(payload.data(), payload.size());
+
+    string temporary = filename + ".tmp";
+    {
+        ofstream outFile(temporary, ios::binary | ios::trunc);
+        if (!outFile)
+        {
+            error = "Could not open file " + temporary;
+            return false;
+        }
+        outFile.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        outFile.write(payload.data(), static_cast<streamsize>(payload.size()));
+        if (!outFile.flush())
+        {
+            error = "Could not write file " + temporary;
+            return false;
+        }
+    }
+    if (!replaceFileDurably(temporary, filename))
+    {
+        error = "Could not replace file " + filename;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Constructor creates a reader with no file open.
+ */
+SnapshotReader::SnapshotReader()
+    : mapping(nullptr), mappingSize(0), cities(0), regionTotal(0), populationColumn(nullptr), yearColumn(nullptr),
+      latitudeColumn(nullptr), longitudeColumn(nullptr), unitXColumn(nullptr), unitYColumn(nullptr),
+      unitZColumn(nullptr), regionColumn(nullptr), offsets(nullptr), heap(nullptr)
+{
+}
+
+/**
+ * Destructor unmaps the file.
+ */
+SnapshotReader::~SnapshotReader()
+{
+    if (mapping != nullptr)
+    {
+        munmap(const_cast<char *>(mapping), mappingSize);
+    }
+}
+
+/**
+ * Returns true if the file starts with the snapshot magic.
+ */
+bool SnapshotReader::isSnapshot(const string &filename)
+{
+    ifstream inFile(filename, ios::binary);
+    char magic[sizeof(SNAPSHOT_MAGIC)] = {};
+    inFile.read(magic, sizeof(magic));
+    return inFile.gcount() == sizeof(magic) && memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) == 0;
+}
+
+/**
+ * Maps a snapshot and validates its header, bounds and checksum.
+ */
+bool SnapshotReader::open(const string &filename, string &error)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        error = "Could not open file " + filename;
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) < sizeof(SnapshotHeader))
+    {
+        ::close(fd);
+        error = "File " + filename + " is too short to be a snapshot";
+        return false;
+    }
+    mappingSize = static_cast<size_t>(info.st_size);
+    void *address = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        mappingSize = 0;
+        error = "Could not map file " + filename;
+        return false;
+    }
+    mapping = static_cast<const char *>(address);
+    madvise(address, mappingSize, MADV_SEQUENTIAL);
+
+    SnapshotHeader header;
+    memcpy(&header, mapping, sizeof(header));
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+    {
+        error = "File " + filename + " is not a snapshot";
+        return false;
+    }
+    if (header.version != SNAPSHOT_VERSION)
+    {
+        error = "Snapshot version " + to_string(header.version) + " is not supported";
+        return false;
+    }
+
+    // Reject counts that cannot fit in the file before computing the layout from them
+    const size_t payloadBytes = mappingSize - sizeof(SnapshotHeader);
+    if (header.payloadBytes != payloadBytes || header.cityCount > payloadBytes ||
+        header.regionCount > payloadBytes || header.heapBytes > payloadBytes)
+    {
+        error = "Snapshot " + filename + " is truncated or corrupt";
+        return false;
+    }
+    cities = header.cityCount;
+    regionTotal = header.regionCount;
+    const size_t stringCount = regionTotal + cities * STRINGS_PER_CITY;
+    const SnapshotLayout layout = layoutFor(cities, stringCount, header.heapBytes);
+    if (layout.end != payloadBytes)
+    {
+        error = "Snapshot " + filename + " is truncated or corrupt";
+        return false;
+    }
+
+    const char *payload = mapping + sizeof(SnapshotHeader);
+    if (checksum64(payload, payloadBytes) != header.checksum)
+    {
+        error = "Snapshot " + filename + " failed its checksum";
+        return false;
+    }
+
+    populationColumn = reinterpret_cast<const int32_t *>(payload + layout.population);
+    yearColumn = reinterpret_cast<const int32_t *>(payload + layout.year);
+    latitudeColumn = reinterpret_cast<const double *>(payload + layout.latitude);
+    longitudeColumn = reinterpret_cast<const double *>(payload + layout.longitude);
+    unitXColumn = reinterpret_cast<const double *>(payload + layout.unitX);
+    unitYColumn = reinterpret_cast<const double *>(payload + layout.unitY);
+    unitZColumn = reinterpret_cast<const double *>(payload + layout.unitZ);
+    regionColumn = reinterpret_cast<const uint32_t *>(payload + layout.region);
+    offsets = reinterpret_cast<const uint64_t *>(payload + layout.offsets);
+    heap = payload + layout.heap;
+
+    // The checksum catches damage; these checks keep a crafted file from reading out of bounds
+    bool valid = offsets[0] == 0 && offsets[stringCount] == header.heapBytes;
+    for (size_t i = 0; valid && i < stringCount; ++i)
+        valid = offsets[i] <= offsets[i + 1];
+    for (size_t i = 0; valid && i < cities; ++i)
+        valid = regionColumn[i] < regionTotal;
+    if (!valid)
+    {
+        error = "Snapshot " + filename + " has an invalid string table";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Returns string number i of the snapshot's string table.
+ */
+string_view SnapshotReader::stringAt(size_t i) const
+{
+    return string_view(heap + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+/**
+ * Returns entry r of the region table.
+ */
+string_view SnapshotReader::regionName(size_t r) const
+{
+    return stringAt(r);
+}
+
+/**
+ * Returns a string field of a city.
+ */
+string_view SnapshotReader::cityString(size_t city, SnapshotField field) const
+{
+    return stringAt(regionTotal + city * STRINGS_PER_CITY + static_cast<size_t>(field));
+}
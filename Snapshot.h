@@ -0,0 +1,133 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Binary snapshot format (version 1, little-endian):
+ *
+ *   header   64 bytes: magic "CITYSNAP", version, city count, region count,
+ *            string heap size, payload size and a checksum of the payload
+ *   payload  fixed-width columns, each starting on an 8-byte boundary:
+ *              int32  population[cities], year[cities]
+ *              double latitude[cities], longitude[cities]
+ *              double unitX[cities], unitY[cities], unitZ[cities]
+ *              uint32 region[cities]      index into the region table
+ *              uint64 offsets[strings+1]  string i is heap[offsets[i], offsets[i+1])
+ *              char   heap[heapBytes]
+ *
+ * Strings are the region table followed by name, mayor name, mayor address and
+ * history of each city in turn. A reader maps the file and uses the columns in
+ * place, so loading needs no per-record parsing.
+ */
+
+// String fields stored per city, in storage order
+enum class SnapshotField
+{
+    Name = 0,
+    MayorName = 1,
+    MayorAddress = 2,
+    History = 3
+};
+
+/**
+ * In-memory contents of a snapshot, filled in by the caller and written in one go.
+ */
+struct SnapshotData
+{
+    vector<int32_t> population;
+    vector<int32_t> year;
+    vector<double> latitude;
+    vector<double> longitude;
+    vector<double> unitX;
+    vector<double> unitY;
+    vector<double> unitZ;
+    vector<uint32_t> region;
+    vector<string_view> regions; // Region table
+    vector<string_view> strings; // Four per city, in SnapshotField order
+
+    /**
+     * Writes the snapshot to a temporary file and renames it into place.
+     * Returns false and sets error on failure.
+     */
+    bool write(const string &filename, string &error) const;
+};
+
+/**
+ * Read-only view of a memory-mapped snapshot file.
+ */
+class SnapshotReader
+{
+private:
+    const char *mapping; // Start of the mapped file
+    size_t mappingSize;
+    size_t cities;
+    size_t regionTotal;
+    const int32_t *populationColumn;
+    const int32_t *yearColumn;
+    const double *latitudeColumn;
+    const double *longitudeColumn;
+    const double *unitXColumn;
+    const double *unitYColumn;
+    const double *unitZColumn;
+    const uint32_t *regionColumn;
+    const uint64_t *offsets;
+    const char *heap;
+
+    // Returns string number i of the snapshot's string table
+    string_view stringAt(size_t i) const;
+
+public:
+    /**
+     * Constructor creates a reader with no file open.
+     */
+    SnapshotReader();
+
+    /**
+     * Destructor unmaps the file.
+     */
+    ~SnapshotReader();
+
+    SnapshotReader(const SnapshotReader &) = delete;
+    SnapshotReader &operator=(const SnapshotReader &) = delete;
+
+    /**
+     * Returns true if the file starts with the snapshot magic.
+     */
+    static bool isSnapshot(const string &filename);
+
+    /**
+     * Maps a snapshot and validates its header, bounds and checksum.
+     * Returns false and sets error if the file is not a usable snapshot.
+     */
+    bool open(const string &filename, string &error);
+
+    size_t cityCount() const { return cities; }
+    size_t regionCount() const { return regionTotal; }
+    const int32_t *population() const { return populationColumn; }
+    const int32_t *year() const { return yearColumn; }
+    const double *latitude() const { return latitudeColumn; }
+    const double *longitude() const { return longitudeColumn; }
+    const double *unitX() const { return unitXColumn; }
+    const double *unitY() const { return unitYColumn; }
+    const double *unitZ() const { return unitZColumn; }
+    const uint32_t *region() const { return regionColumn; }
+
+    /**
+     * Returns entry r of the region table.
+     */
+    string_view regionName(size_t r) const;
+
+    /**
+     * Returns a string field of a city.
+     */
+    string_view cityString(size_t city, SnapshotField field) const;
+};
+
+#endif // SNAPSHOT_H
@@ -0,0 +1,135 @@
+#ifndef SORTEDINDEX_H
+#define SORTEDINDEX_H
+
+#include <vector>
+#include <algorithm>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Ordered secondary index over one city attribute.
+ * Entries are kept as parallel key / record ID arrays sorted by (key, ID), so ordered
+ * scans are contiguous and range lookups are binary searches over the key array.
+ * An index that has not been built ignores updates and is rebuilt in one sort when
+ * first needed, which keeps bulk loads linear.
+ */
+template <typename Key>
+class SortedIndex
+{
+private:
+    vector<Key> keys;     // Sorted attribute values
+    vector<uint32_t> ids; // Record ID of each entry, parallel to keys
+    bool built;           // False until rebuilt; updates are skipped meanwhile
+
+    // Position of the first entry not less than (key, id)
+    size_t position(const Key &key, uint32_t id) const
+    {
+        size_t low = lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+        size_t high = upper_bound(keys.begin() + low, keys.end(), key) - keys.begin();
+        return lower_bound(ids.begin() + low, ids.begin() + high, id) - ids.begin();
+    }
+
+public:
+    /**
+     * Constructor creates an index that still needs building.
+     */
+    SortedIndex() : built(false) {}
+
+    /**
+     * Returns true if the index is up to date.
+     */
+    bool isBuilt() const
+    {
+        return built;
+    }
+
+    /**
+     * Drops all entries; the index is rebuilt on next use.
+     */
+    void invalidate()
+    {
+        keys.clear();
+        ids.clear();
+        keys.shrink_to_fit();
+        ids.shrink_to_fit();
+        built = false;
+    }
+
+    /**
+     * Rebuilds the index from (key, record ID) entries.
+     */
+    void rebuild(vector<pair<Key, uint32_t>> entries)
+    {
+        sort(entries.begin(), entries.end());
+        keys.resize(entries.size());
+        ids.resize(entries.size());
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            keys[i] = entries[i].first;
+            ids[i] = entries[i].second;
+        }
+        built = true;
+    }
+
+    /**
+     * Adds an entry, keeping the arrays sorted.
+     */
+    void insert(const Key &key, uint32_t id)
+    {
+        if (!built)
+            return;
+        size_t at = position(key, id);
+        keys.insert(keys.begin() + at, key);
+        ids.insert(ids.begin() + at, id);
+    }
+
+    /**
+     * Removes an entry previously added with the same key and record ID.
+     */
+    void erase(const Key &key, uint32_t id)
+    {
+        if (!built)
+            return;
+        size_t at = position(key, id);
+        if (at < ids.size() && ids[at] == id)
+        {
+            keys.erase(keys.begin() + at);
+            ids.erase(ids.begin() + at);
+        }
+    }
+
+    /**
+     * Returns the record IDs in ascending key order.
+     */
+    const vector<uint32_t> &orderedIds() const
+    {
+        return ids;
+    }
+
+    /**
+     * Returns the half-open range of entry positions whose keys lie in [minKey, maxKey].
+     */
+    pair<size_t, size_t> range(const Key &minKey, const Key &maxKey) const
+    {
+        size_t first = lower_bound(keys.begin(), keys.end(), minKey) - keys.begin();
+        size_t last = upper_bound(keys.begin() + first, keys.end(), maxKey) - keys.begin();
+        return {first, last};
+    }
+
+    /**
+     * Returns the half-open range of entry positions whose keys start with prefix (string keys only).
+     */
+    pair<size_t, size_t> prefixRange(const Key &prefix) const
+    {
+        size_t first = lower_bound(keys.begin(), keys.end(), prefix) - keys.begin();
+        size_t last = upper_bound(keys.begin() + first, keys.end(), prefix,
+                                  [](const Key &wanted, const Key &key) { return wanted < key.substr(0, wanted.size()); }) -
+                      keys.begin();
+        return {first, last};
+    }
+};
+
+#endif // SORTEDINDEX_H
@@ -0,0 +1,125 @@
+#include "SpatialGrid.h"
+#include "Distance.h"
+#include "Utilities.h"
+#include <algorithm>
+#include <cmath>
+
+/**
+ * Constructor creates an empty grid.
+ */
+SpatialGrid::SpatialGrid() : cells(LAT_CELLS * LON_CELLS) {}
+
+/**
+ * Maps a coordinate to the index of the cell containing it.
+ */
+int SpatialGrid::cellIndex(double latitude, double longitude)
+{
+    int row = static_cast<int>(floor(latitude + 90.0));
+    int column = static_cast<int>(floor(longitude + 180.0));
+    row = clamp(row, 0, LAT_CELLS - 1);
+    column = ((column % LON_CELLS) + LON_CELLS) % LON_CELLS;
+    return row * LON_CELLS + column;
+}
+
+/**
+ * Adds a record ID at the given coordinates.
+ */
+void SpatialGrid::insert(uint32_t id, double latitude, double longitude)
+{
+    cells[cellIndex(latitude, longitude)].push_back(id);
+}
+
+/**
+ * Removes a record ID previously inserted at the given coordinates.
+ */
+void SpatialGrid::remove(uint32_t id, double latitude, double longitude)
+{
+    vector<uint32_t> &cell = cells[cellIndex(latitude, longitude)];
+    auto it = find(cell.begin(), cell.end(), id);
+    if (it != cell.end())
+    {
+        // Order within a cell does not matter, so swap with the last entry
+        *it = cell.back();
+        cell.pop_back();
+    }
+}
+
+/**
+ * Appends (squared chord length, ID) for every record within maxDistance km of a point.
+ */
+void SpatialGrid::queryRadius(const CityStore &store, double latitude, double longitude, double maxDistance,
+                              vector<pair<double, uint32_t>> &results) const
+{
+    double x0, y0, z0;
+    toUnitVector(latitude, longitude, x0, y0, z0);
+    const double limit = kmToChordSquared(maxDistance);
+
+    // Angular radius of the search cap, padded slightly against rounding at cell edges
+    const double angle = maxDistance / EARTH_RADIUS_KM;
+    const double angleDegrees = angle * 180.0 / M_PI + 1e-9;
+    const double minLatitude = latitude - angleDegrees;
+    const double maxLatitude = latitude + angleDegrees;
+
+    // The cap's longitude extent; it spans every longitude once it reaches a pole
+    int firstColumn = 0;
+    int columnCount = LON_CELLS;
+    if (minLatitude > -90.0 && maxLatitude < 90.0 && angle < M_PI / 2)
+    {
+        double spread = asin(sin(angle) / cos(toRadians(latitude))) * 180.0 / M_PI + 1e-9;
+        if (spread < 180.0)
+        {
+            firstColumn = static_cast<int>(floor(longitude - spread + 180.0));
+            int lastColumn = static_cast<int>(floor(longitude + spread + 180.0));
+            columnCount = min(lastColumn - firstColumn + 1, LON_CELLS);
+        }
+    }
+
+    const int firstRow = clamp(static_cast<int>(floor(minLatitude + 90.0)), 0, LAT_CELLS - 1);
+    const int lastRow = clamp(static_cast<int>(floor(maxLatitude + 90.0)), 0, LAT_CELLS - 1);
+    for (int row = firstRow; row <= lastRow; ++row)
+    {
+        for (int offset = 0; offset < columnCount; ++offset)
+        {
+            int column = (((firstColumn + offset) % LON_CELLS) + LON_CELLS) % LON_CELLS;
+            for (uint32_t id : cells[row * LON_CELLS + column])
+            {
+                double dx = store.unitX[id] - x0;
+                double dy = store.unitY[id] - y0;
+                double dz = store.unitZ[id] - z0;
+                double chord = dx * dx + dy * dy + dz * dz;
+                if (chord <= limit)
+                {
+                    results.emplace_back(chord, id);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Returns the k records nearest to a point as (squared chord length, ID), nearest first.
+ * Runs radius queries of growing size until at least k records fall inside; every record
+ * nearer than the k-th is then guaranteed to be among them.
+ */
+void SpatialGrid::queryNearest(const CityStore &store, double latitude, double longitude, size_t k,
+                               vector<pair<double, uint32_t>> &results) const
+{
+    results.clear();
+    if (k == 0)
+        return;
+
+    const double halfCircumference = M_PI * EARTH_RADIUS_KM;
+    double radius = 50.0;
+    while (true)
+    {
+        results.clear();
+        queryRadius(store, latitude, longitude, radius, results);
+        if (results.size() >= k || radius >= halfCircumference)
+            break;
+        radius = min(radius * 4, halfCircumference);
+    }
+
+    size_t count = min(k, results.size());
+    partial_sort(results.begin(), results.begin() + count, results.end());
+    results.resize(count);
+}
@@ -0,0 +1,56 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include "CityStore.h"
+#include <vector>
+#include <utility>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * Spatial index bucketing record IDs into one-degree latitude/longitude cells.
+ * Radius queries visit only the cells overlapping the search cap and refine the
+ * candidates with exact great-circle distances from the CityStore unit vectors.
+ */
+class SpatialGrid
+{
+private:
+    static constexpr int LAT_CELLS = 180; // One-degree bands from -90 to 90
+    static constexpr int LON_CELLS = 360; // One-degree bands from -180 to 180
+
+    vector<vector<uint32_t>> cells; // Record IDs per cell, row-major by latitude band
+
+    // Maps a coordinate to the index of the cell containing it
+    static int cellIndex(double latitude, double longitude);
+
+public:
+    /**
+     * Constructor creates an empty grid.
+     */
+    SpatialGrid();
+
+    /**
+     * Adds a record ID at the given coordinates.
+     */
+    void insert(uint32_t id, double latitude, double longitude);
+
+    /**
+     * Removes a record ID previously inserted at the given coordinates.
+     */
+    void remove(uint32_t id, double latitude, double longitude);
+
+    /**
+     * Appends (squared chord length, ID) for every record within maxDistance km of a point.
+     */
+    void queryRadius(const CityStore &store, double latitude, double longitude, double maxDistance,
+                     vector<pair<double, uint32_t>> &results) const;
+
+    /**
+     * Returns the k records nearest to a point as (squared chord length, ID), nearest first.
+     */
+    void queryNearest(const CityStore &store, double latitude, double longitude, size_t k,
+                      vector<pair<double, uint32_t>> &results) const;
+};
+
+#endif // SPATIALGRID_H
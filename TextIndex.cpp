@@ -0,0 +1,500 @@
+#include "TextIndex.h"
+#include "Utilities.h"
+#include <algorithm>
+#include <cctype>
+
+namespace
+{
+    // Overlay entries that trigger a merge, beyond one per eight compressed entries
+    const size_t OVERLAY_MIN_ENTRIES = 16;
+
+    // Returns true for characters that belong to words; bytes of multi-byte UTF-8 characters do
+    bool isWordCharacter(char c)
+    {
+        return isalnum(static_cast<unsigned char>(c)) || static_cast<unsigned char>(c) >= 0x80;
+    }
+
+    // Reads one varint, advancing at
+    uint64_t readVarint(const uint8_t *&at)
+    {
+        uint64_t value = 0;
+        int shift = 0;
+        while (*at & 0x80)
+        {
+            value |= static_cast<uint64_t>(*at++ & 0x7f) << shift;
+            shift += 7;
+        }
+        return value | static_cast<uint64_t>(*at++) << shift;
+    }
+}
+
+/**
+ * Parses search text. Returns false and sets error if it holds no words or names an unknown field.
+ */
+bool TextQuery::parse(const string &text, TextQuery &query, string &error)
+{
+    query = TextQuery();
+    size_t i = 0;
+    while (i < text.size())
+    {
+        if (isspace(static_cast<unsigned char>(text[i])))
+        {
+            i++;
+            continue;
+        }
+        if (text.compare(i, 2, "--") == 0)
+        {
+            size_t end = text.find_first_of(" \t", i);
+            end = end == string::npos ? text.size() : end;
+            query.options.push_back(text.substr(i, end - i));
+            i = end;
+            continue;
+        }
+
+        Clause clause;
+        // An optional field name, e.g. history:"trade hub"
+        size_t colon = text.find(':', i);
+        size_t space = text.find_first_of(" \t\"", i);
+        if (colon != string::npos && colon < space)
+        {
+            const string field = toLowerCase(text.substr(i, colon - i));
+            if (field == "history")
+                clause.fields = HISTORY_FIELD;
+            else if (field == "mayor" || field == "mayorname")
+                clause.fields = MAYOR_NAME_FIELD;
+            else if (field == "address" || field == "mayoraddress")
+                clause.fields = MAYOR_ADDRESS_FIELD;
+            else
+            {
+                error = "unknown field '" + field + "'; use history, mayor or address";
+                return false;
+            }
+            i = colon + 1;
+        }
+
+        // A quoted phrase, or a bare word that may end in '*'
+        string body;
+        if (i < text.size() && text[i] == '"')
+        {
+            size_t close = text.find('"', i + 1);
+            close = close == string::npos ? text.size() : close;
+            body = text.substr(i + 1, close - i - 1);
+            i = min(close + 1, text.size());
+        }
+        else
+        {
+            size_t end = text.find_first_of(" \t", i);
+            end = end == string::npos ? text.size() : end;
+            body = text.substr(i, end - i);
+            i = end;
+            if (!body.empty() && body.back() == '*')
+            {
+                clause.prefix = true;
+                body.pop_back();
+            }
+        }
+
+        toLowerInPlace(body);
+        vector<string_view> words;
+        TextIndex::tokenize(body, words);
+        if (words.empty())
+            continue;
+        for (string_view word : words)
+            clause.words.emplace_back(word);
+        // A prefix applies to a single word only
+        clause.prefix = clause.prefix && clause.words.size() == 1;
+        query.clauses.push_back(move(clause));
+    }
+    if (query.clauses.empty())
+    {
+        error = "no words to search for";
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Constructor creates an index that still needs building.
+ */
+TextIndex::TextIndex() : encodedBytes(0), built(false), wordsSorted(false) {}
+
+/**
+ * Splits text into words: runs of letters, digits and non-ASCII characters. The views
+ * point into text. City text is stored in lowercase, so no case folding is needed.
+ */
+void TextIndex::tokenize(string_view text, vector<string_view> &result)
+{
+    result.clear();
+    size_t i = 0;
+    while (i < text.size())
+    {
+        while (i < text.size() && !isWordCharacter(text[i]))
+            i++;
+        size_t start = i;
+        while (i < text.size() && isWordCharacter(text[i]))
+            i++;
+        if (i > start)
+            result.push_back(text.substr(start, i - start));
+    }
+}
+
+/**
+ * Returns true if text contains the words in sequence.
+ */
+bool TextIndex::containsPhrase(const string &text, const vector<string> &phrase)
+{
+    vector<string_view> words;
+    tokenize(text, words);
+    if (phrase.size() > words.size())
+        return false;
+    for (size_t start = 0; start + phrase.size() <= words.size(); ++start)
+    {
+        size_t matched = 0;
+        while (matched < phrase.size() && words[start + matched] == phrase[matched])
+            matched++;
+        if (matched == phrase.size())
+            return true;
+    }
+    return false;
+}
+
+/**
+ * Collects the distinct words of a city, each with the mask of fields it appears in.
+ */
+void TextIndex::cityWords(const City &city, vector<pair<string_view, uint8_t>> &result)
+{
+    result.clear();
+    vector<string_view> fieldWords;
+    const pair<const string *, uint8_t> fields[] = {
+        {&city.history, HISTORY_FIELD}, {&city.mayorName, MAYOR_NAME_FIELD}, {&city.mayorAddress, MAYOR_ADDRESS_FIELD}};
+    for (const auto &[text, field] : fields)
+    {
+        tokenize(*text, fieldWords);
+        for (string_view word : fieldWords)
+            result.emplace_back(word, field);
+    }
+    sort(result.begin(), result.end());
+    size_t kept = 0;
+    for (size_t i = 0; i < result.size(); ++i)
+    {
+        if (kept > 0 && result[kept - 1].first == result[i].first)
+            result[kept - 1].second |= result[i].second;
+        else
+            result[kept++] = result[i];
+    }
+    result.resize(kept);
+}
+
+/**
+ * Returns the ID of a word, adding it if needed. Once the words are sorted, a new word is
+ * inserted at its place in the order.
+ */
+uint32_t TextIndex::intern(string_view word)
+{
+    auto it = ids.find(word);
+    if (it != ids.end())
+        return it->second;
+    const uint32_t id = static_cast<uint32_t>(words.size());
+    words.emplace_back(word);
+    ids.emplace(words.back(), id);
+    postings.emplace_back();
+    if (wordsSorted)
+    {
+        auto at = lower_bound(sortedWords.begin(), sortedWords.end(), words.back(),
+                              [this](uint32_t other, const string &wanted) { return words[other] < wanted; });
+        sortedWords.insert(at, id);
+    }
+    return id;
+}
+
+/**
+ * Appends one entry to a compressed posting list. The record ID must follow its last one.
+ */
+void TextIndex::append(Postings &list, uint32_t id, uint8_t fields)
+{
+    const size_t before = list.encoded.size();
+    uint64_t value = (static_cast<uint64_t>(list.count == 0 ? id : id - list.lastId) << 3) | fields;
+    while (value >= 0x80)
+    {
+        list.encoded.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    list.encoded.push_back(static_cast<uint8_t>(value));
+    list.count++;
+    list.lastId = id;
+    encodedBytes += list.encoded.size() - before;
+}
+
+/**
+ * Decodes a posting list with its overlay applied into (record ID, field mask) pairs, ascending.
+ */
+void TextIndex::decode(uint32_t word, vector<pair<uint32_t, uint8_t>> &entries) const
+{
+    entries.clear();
+    const Postings &list = postings[word];
+    entries.reserve(list.count);
+    const uint8_t *at = list.encoded.data();
+    uint32_t id = 0;
+    for (uint32_t i = 0; i < list.count; ++i)
+    {
+        uint64_t value = readVarint(at);
+        id = i == 0 ? static_cast<uint32_t>(value >> 3) : id + static_cast<uint32_t>(value >> 3);
+        entries.emplace_back(id, static_cast<uint8_t>(value & ALL_TEXT_FIELDS));
+    }
+
+    auto overlay = overlays.find(word);
+    if (overlay == overlays.end())
+        return;
+    // Drop removed and replaced entries, then merge in the added ones
+    const auto &added = overlay->second.added;
+    const auto &removed = overlay->second.removed;
+    entries.erase(remove_if(entries.begin(), entries.end(),
+                            [&](const pair<uint32_t, uint8_t> &entry)
+                            {
+                                return binary_search(removed.begin(), removed.end(), entry.first) ||
+                                       binary_search(added.begin(), added.end(), make_pair(entry.first, uint8_t(0)),
+                                                     [](const auto &a, const auto &b) { return a.first < b.first; });
+                            }),
+                  entries.end());
+    const size_t middle = entries.size();
+    entries.insert(entries.end(), added.begin(), added.end());
+    inplace_merge(entries.begin(), entries.begin() + middle, entries.end());
+}
+
+/**
+ * Rewrites a posting list with its overlay merged in.
+ */
+void TextIndex::compact(uint32_t word)
+{
+    vector<pair<uint32_t, uint8_t>> entries;
+    decode(word, entries);
+    overlays.erase(word);
+    Postings &list = postings[word];
+    encodedBytes -= list.encoded.size();
+    list = Postings();
+    for (const auto &[id, fields] : entries)
+        append(list, id, fields);
+    list.encoded.shrink_to_fit();
+}
+
+/**
+ * Adds or replaces one city's entry in a word's posting list.
+ */
+void TextIndex::addEntry(uint32_t word, uint32_t id, uint8_t fields)
+{
+    Postings &list = postings[word];
+    if (list.count == 0 || id > list.lastId)
+    {
+        append(list, id, fields);
+        return;
+    }
+    Overlay &overlay = overlays[word];
+    auto removed = lower_bound(overlay.removed.begin(), overlay.removed.end(), id);
+    if (removed != overlay.removed.end() && *removed == id)
+        overlay.removed.erase(removed);
+    auto added = lower_bound(overlay.added.begin(), overlay.added.end(), make_pair(id, uint8_t(0)));
+    if (added != overlay.added.end() && added->first == id)
+        added->second = fields;
+    else
+        overlay.added.insert(added, {id, fields});
+    if (overlay.added.size() + overlay.removed.size() > OVERLAY_MIN_ENTRIES + list.count / 8)
+        compact(word);
+}
+
+/**
+ * Removes one city's entry from a word's posting list. Its record ID is at most the list's
+ * last one, because entries beyond it are appended; so a later append never meets it.
+ */
+void TextIndex::removeEntry(uint32_t word, uint32_t id)
+{
+    Postings &list = postings[word];
+    Overlay &overlay = overlays[word];
+    auto added = lower_bound(overlay.added.begin(), overlay.added.end(), make_pair(id, uint8_t(0)));
+    if (added != overlay.added.end() && added->first == id)
+        overlay.added.erase(added);
+    auto removed = lower_bound(overlay.removed.begin(), overlay.removed.end(), id);
+    if (removed == overlay.removed.end() || *removed != id)
+        overlay.removed.insert(removed, id);
+    if (overlay.added.size() + overlay.removed.size() > OVERLAY_MIN_ENTRIES + list.count / 8)
+        compact(word);
+}
+
+/**
+ * Appends the record IDs of a word's entries that match fields.
+ */
+void TextIndex::collect(uint32_t word, uint8_t fields, vector<uint32_t> &result) const
+{
+    vector<pair<uint32_t, uint8_t>> entries;
+    decode(word, entries);
+    for (const auto &[id, mask] : entries)
+    {
+        if (mask & fields)
+            result.push_back(id);
+    }
+}
+
+/**
+ * Returns true if the index is up to date.
+ */
+bool TextIndex::isBuilt() const
+{
+    return built;
+}
+
+/**
+ * Drops all entries; the index is rebuilt on next use.
+ */
+void TextIndex::invalidate()
+{
+    words.clear();
+    ids.clear();
+    postings.clear();
+    postings.shrink_to_fit();
+    overlays.clear();
+    sortedWords.clear();
+    sortedWords.shrink_to_fit();
+    wordsSorted = false;
+    encodedBytes = 0;
+    built = false;
+}
+
+/**
+ * Rebuilds the index from the cities stored by record ID. Cities are visited in record ID
+ * order, so every entry is an append.
+ */
+void TextIndex::rebuild(const vector<City *> &rows)
+{
+    invalidate();
+    built = true;
+    vector<pair<string_view, uint8_t>> cityWordList;
+    for (const City *city : rows)
+    {
+        if (city == nullptr)
+            continue;
+        cityWords(*city, cityWordList);
+        for (const auto &[word, fields] : cityWordList)
+            append(postings[intern(word)], city->id, fields);
+    }
+}
+
+/**
+ * Adds a city's words to a built index.
+ */
+void TextIndex::add(const City &city)
+{
+    if (!built)
+        return;
+    vector<pair<string_view, uint8_t>> cityWordList;
+    cityWords(city, cityWordList);
+    for (const auto &[word, fields] : cityWordList)
+        addEntry(intern(word), city.id, fields);
+}
+
+/**
+ * Removes a city's words from a built index. The city must still hold the text it was added with.
+ */
+void TextIndex::remove(const City &city)
+{
+    if (!built)
+        return;
+    vector<pair<string_view, uint8_t>> cityWordList;
+    cityWords(city, cityWordList);
+    for (const auto &[word, fields] : cityWordList)
+    {
+        auto it = ids.find(word);
+        if (it != ids.end())
+            removeEntry(it->second, city.id);
+    }
+}
+
+/**
+ * Sorts the words for prefix lookups if they are not sorted yet.
+ */
+void TextIndex::sortWords() const
+{
+    if (wordsSorted)
+        return;
+    sortedWords.resize(words.size());
+    for (uint32_t id = 0; id < sortedWords.size(); ++id)
+        sortedWords[id] = id;
+    sort(sortedWords.begin(), sortedWords.end(), [this](uint32_t a, uint32_t b) { return words[a] < words[b]; });
+    wordsSorted = true;
+}
+
+/**
+ * Returns the half-open range of positions in sortedWords of the words starting with prefix.
+ */
+pair<size_t, size_t> TextIndex::prefixRange(const string &prefix) const
+{
+    sortWords();
+    auto first = lower_bound(sortedWords.begin(), sortedWords.end(), prefix,
+                             [this](uint32_t word, const string &wanted) { return words[word] < wanted; });
+    auto last = upper_bound(first, sortedWords.end(), prefix,
+                            [this](const string &wanted, uint32_t word)
+                            { return wanted < string_view(words[word]).substr(0, wanted.size()); });
+    return {static_cast<size_t>(first - sortedWords.begin()), static_cast<size_t>(last - sortedWords.begin())};
+}
+
+/**
+ * Returns about how many cities use a word, or every word with a prefix (overlays not counted).
+ */
+size_t TextIndex::estimate(const string &word, bool prefix) const
+{
+    if (!prefix)
+    {
+        auto it = ids.find(word);
+        return it == ids.end() ? 0 : postings[it->second].count;
+    }
+    auto [first, last] = prefixRange(word);
+    size_t total = 0;
+    for (size_t i = first; i < last; ++i)
+        total += postings[sortedWords[i]].count;
+    return total;
+}
+
+/**
+ * Returns the record IDs, ascending, of cities using a word (or a word with a prefix) in one of fields.
+ */
+void TextIndex::matches(const string &word, bool prefix, uint8_t fields, vector<uint32_t> &result) const
+{
+    result.clear();
+    if (!prefix)
+    {
+        auto it = ids.find(word);
+        if (it != ids.end())
+            collect(it->second, fields, result);
+        return;
+    }
+    auto [first, last] = prefixRange(word);
+    for (size_t i = first; i < last; ++i)
+        collect(sortedWords[i], fields, result);
+    if (last - first > 1)
+    {
+        sort(result.begin(), result.end());
+        result.erase(unique(result.begin(), result.end()), result.end());
+    }
+}
+
+/**
+ * Returns the number of distinct words.
+ */
+size_t TextIndex::size() const
+{
+    return words.size();
+}
+
+/**
+ * Returns the approximate memory used by the index in bytes: the words, their dictionary
+ * entries, the posting list headers and the compressed entries.
+ */
+size_t TextIndex::bytes() const
+{
+    size_t total = encodedBytes + postings.capacity() * sizeof(Postings) + sortedWords.capacity() * sizeof(uint32_t);
+    const size_t inlineCapacity = string().capacity();
+    for (const string &word : words)
+        total += sizeof(string) + (word.size() > inlineCapacity ? word.size() + 1 : 0);
+    total += ids.size() * (sizeof(string_view) + sizeof(uint32_t) + 2 * sizeof(void *));
+    for (const auto &[word, overlay] : overlays)
+        total += overlay.added.capacity() * sizeof(pair<uint32_t, uint8_t>) + overlay.removed.capacity() * sizeof(uint32_t);
+    return total;
+}
@@ -0,0 +1,183 @@
+#ifndef TEXTINDEX_H
+#define TEXTINDEX_H
+
+#include "City.h"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <deque>
+#include <vector>
+#include <utility>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+/**
+ * Fields of a city covered by the text index, as bits of a field mask.
+ */
+enum TextField : uint8_t
+{
+    HISTORY_FIELD = 1,
+    MAYOR_NAME_FIELD = 2,
+    MAYOR_ADDRESS_FIELD = 4,
+    ALL_TEXT_FIELDS = 7
+};
+
+/**
+ * A parsed text search: every clause must match.
+ *     word       - a word in any indexed field
+ *     word*      - a word starting with word
+ *     "a b c"    - the words in sequence
+ *     field:...  - any of the above, in history, mayor (mayor's name) or address only
+ */
+struct TextQuery
+{
+    struct Clause
+    {
+        vector<string> words;             // Lowercase words; more than one makes a phrase
+        bool prefix = false;              // True if the single word is a prefix
+        uint8_t fields = ALL_TEXT_FIELDS; // Fields the clause may match in
+    };
+
+    vector<Clause> clauses;
+    vector<string> options; // Output options such as --format=csv, left to the caller
+
+    /**
+     * Parses search text. Returns false and sets error if it holds no words or names an unknown field.
+     */
+    static bool parse(const string &text, TextQuery &query, string &error);
+};
+
+/**
+ * Inverted index over the history, mayor's name and mayor's address of every city.
+ * Each distinct word is stored once and maps to a posting list of the record IDs of the
+ * cities using it. A posting list is compressed: one varint per city holding the gap
+ * to the previous record ID and the mask of fields the word appears in. Changes in
+ * record ID order are appended; others, such as a reused record ID, are held in a small
+ * uncompressed overlay that is merged in once it grows. Like the sorted indexes, the
+ * index is built on first use and maintained incrementally after that.
+ */
+class TextIndex
+{
+private:
+    // Compressed posting list of one word
+    struct Postings
+    {
+        vector<uint8_t> encoded; // Varint of (record ID gap << 3 | field mask) per city
+        uint32_t count = 0;      // Cities in encoded
+        uint32_t lastId = 0;     // Last record ID in encoded
+    };
+
+    // Changes to a posting list that arrived out of record ID order
+    struct Overlay
+    {
+        vector<pair<uint32_t, uint8_t>> added; // (record ID, field mask), sorted; replaces encoded entries
+        vector<uint32_t> removed;              // Record IDs dropped from encoded, sorted
+    };
+
+    deque<string> words;                       // Each distinct word; a deque keeps the strings in place
+    unordered_map<string_view, uint32_t> ids;  // Word ID of each word, keyed by views into words
+    vector<Postings> postings;                 // Posting list of each word ID
+    unordered_map<uint32_t, Overlay> overlays; // Overlays of the word IDs that have one
+    size_t encodedBytes;                       // Total size of every encoded posting list
+    bool built;                                // False until rebuilt; updates are skipped meanwhile
+
+    mutable vector<uint32_t> sortedWords; // Word IDs in word order, for prefix lookups
+    mutable bool wordsSorted;             // False until sortedWords is built; then kept up to date
+
+    // Collects the distinct words of a city with the mask of fields each appears in
+    static void cityWords(const City &city, vector<pair<string_view, uint8_t>> &result);
+
+    // Returns the ID of a word, adding it if needed
+    uint32_t intern(string_view word);
+
+    // Appends one entry to a compressed posting list
+    void append(Postings &list, uint32_t id, uint8_t fields);
+
+    // Decodes a posting list with its overlay applied into (record ID, field mask) pairs
+    void decode(uint32_t word, vector<pair<uint32_t, uint8_t>> &entries) const;
+
+    // Rewrites a posting list with its overlay merged in
+    void compact(uint32_t word);
+
+    // Adds or replaces one city's entry in a word's posting list
+    void addEntry(uint32_t word, uint32_t id, uint8_t fields);
+
+    // Removes one city's entry from a word's posting list
+    void removeEntry(uint32_t word, uint32_t id);
+
+    // Appends the record IDs of a word's entries that match fields
+    void collect(uint32_t word, uint8_t fields, vector<uint32_t> &result) const;
+
+    // Returns the positions in sortedWords of the words starting with prefix, sorting them first if needed
+    pair<size_t, size_t> prefixRange(const string &prefix) const;
+
+public:
+    /**
+     * Constructor creates an index that still needs building.
+     */
+    TextIndex();
+
+    /**
+     * Splits text into words: runs of letters, digits and non-ASCII characters.
+     */
+    static void tokenize(string_view text, vector<string_view> &result);
+
+    /**
+     * Returns true if text contains the words in sequence.
+     */
+    static bool containsPhrase(const string &text, const vector<string> &phrase);
+
+    /**
+     * Returns true if the index is up to date.
+     */
+    bool isBuilt() const;
+
+    /**
+     * Drops all entries; the index is rebuilt on next use.
+     */
+    void invalidate();
+
+    /**
+     * Rebuilds the index from the cities stored by record ID (nullptr for free IDs).
+     */
+    void rebuild(const vector<City *> &rows);
+
+    /**
+     * Adds a city's words to a built index.
+     */
+    void add(const City &city);
+
+    /**
+     * Removes a city's words from a built index. The city must still hold the text it was added with.
+     */
+    void remove(const City &city);
+
+    /**
+     * Sorts the words for prefix lookups if they are not sorted yet.
+     */
+    void sortWords() const;
+
+    /**
+     * Returns about how many cities use a word, or every word with a prefix.
+     */
+    size_t estimate(const string &word, bool prefix) const;
+
+    /**
+     * Returns the record IDs, ascending, of cities using a word (or a word with a prefix) in one of fields.
+     */
+    void matches(const string &word, bool prefix, uint8_t fields, vector<uint32_t> &result) const;
+
+    /**
+     * Returns the number of distinct words.
+     */
+    size_t size() const;
+
+    /**
+     * Returns the approximate memory used by the index in bytes.
+     */
+    size_t bytes() const;
+};
+
+#endif // TEXTINDEX_H
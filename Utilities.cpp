@@ -1,4 +1,9 @@
 #include "Utilities.h"
+#include <cstring>
+#include <cstdio>
+#include <charconv>
+#include <fcntl.h>
+#include <unistd.h>
 
 // Function to convert a character to lowercase
 char toLowerChar(char c)
@@ -21,6 +26,15 @@ string toLowerCase(const string &str)
     return lowerStr;
 }
 
+// Function to convert a string to lowercase without copying it
+void toLowerInPlace(string &str)
+{
+    for (char &c : str)
+    {
+        c = toLowerChar(c);
+    }
+}
+
 // Function to compare strings case-insensitively
 bool equalsIgnoreCase(const string &str1, const string &str2)
 {
@@ -64,3 +78,55 @@ string escapeQuotes(const string &field)
     }
     return "\"" + escaped + "\"";
 }
+
+// Function to compute a 64-bit FNV-1a style checksum, consuming eight bytes per step
+uint64_t checksum64(const void *data, size_t size)
+{
+    const uint64_t PRIME = 0x100000001b3ULL;
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    uint64_t hash = 0xcbf29ce484222325ULL ^ size;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, bytes + i, sizeof(word));
+        hash = (hash ^ word) * PRIME;
+        hash ^= hash >> 32;
+    }
+    for (; i < size; ++i)
+    {
+        hash = (hash ^ bytes[i]) * PRIME;
+    }
+    return hash;
+}
+
+// Function to format a double in the shortest form that reads back to the same value
+string formatDouble(double value)
+{
+    char buffer[32];
+    auto result = to_chars(buffer, buffer + sizeof(buffer), value);
+    return string(buffer, result.ptr);
+}
+
+// Function to sync a finished temporary file and atomically rename it over the target
+bool replaceFileDurably(const string &temporary, const string &filename)
+{
+    int fd = open(temporary.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    bool synced = fsync(fd) == 0;
+    close(fd);
+    if (!synced || rename(temporary.c_str(), filename.c_str()) != 0)
+        return false;
+
+    // Sync the directory so the rename itself survives a crash
+    size_t slash = filename.find_last_of('/');
+    string directory = slash == string::npos ? "." : (slash == 0 ? "/" : filename.substr(0, slash));
+    int dirFd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0)
+    {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return true;
+}
@@ -3,6 +3,8 @@
 
 #include <string>
 #include <cmath>
+#include <cstdint>
+#include <cstddef>
 
 
 using namespace std;
@@ -10,9 +12,13 @@ using namespace std;
 // Function declarations
 char toLowerChar(char c);
 string toLowerCase(const string &str);
+void toLowerInPlace(string &str);
 bool equalsIgnoreCase(const string &str1, const string &str2);
 string trim(const string &str);
 double toRadians(double degrees);
 string escapeQuotes(const string &field);
+uint64_t checksum64(const void *data, size_t size);
+string formatDouble(double value);
+bool replaceFileDurably(const string &temporary, const string &filename);
 
 #endif // UTILITIES_H
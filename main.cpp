@@ -1,9 +1,20 @@
 #include <iostream>
 #include <string>
 #include "CityManager.h"
+#include "ConcurrentCityManager.h"
+#include "QueryServer.h"
 #include "InputHandler.h"
 #include "Utilities.h"
 #include <cstdlib>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <charconv>
+#include <cmath>
+#include <thread>
+#include <algorithm>
 
 using namespace std;
 
@@ -52,18 +63,364 @@ int parseCommand(const string &command, string tokens[], int maxTokens)
 }
 
 /**
- *Processes user commands and interacts with the CityManager.
+ * Returns the raw text after the command word, for commands with a grammar of their own.
  */
-void processCommand(const string &command, CityManager &manager, const string &filename)
+string commandArguments(const string &command)
 {
-    const int MAX_TOKENS = 10;
+    size_t start = command.find_first_not_of(" \t");
+    size_t end = start == string::npos ? string::npos : command.find_first_of(" \t", start);
+    return end == string::npos ? "" : command.substr(end);
+}
+
+/**
+ * Converts a whole token to a finite number, rejecting any trailing characters.
+ */
+bool parseNumber(const string &token, double &value)
+{
+    try
+    {
+        size_t used = 0;
+        value = stod(token, &used);
+        return used == token.size() && isfinite(value);
+    }
+    catch (...)
+    {
+        return false;
+    }
+}
+
+/**
+ * Options that change how commands run.
+ */
+struct SessionOptions
+{
+    bool batch = false;                                     // Arguments inline, no prompts or status chatter
+    DuplicatePolicy duplicates = DuplicatePolicy::KeepLast; // How a batch add treats an existing city
+    bool exitRequested = false;                             // Set by the exit command
+};
+
+/**
+ * Converts a whole token to an integer within [min, max].
+ */
+bool parseInteger(const string &token, int &value, int min, int max)
+{
+    auto result = from_chars(token.data(), token.data() + token.size(), value);
+    return result.ec == errc() && result.ptr == token.data() + token.size() && value >= min && value <= max;
+}
+
+/**
+ * Checks a query point's latitude and longitude are in range, reporting the first bad one.
+ */
+bool validCoordinates(double latitude, double longitude)
+{
+    if (latitude < -90 || latitude > 90)
+    {
+        cout << "Invalid latitude. Please enter a number between -90 and 90." << endl;
+        return false;
+    }
+    if (longitude < -180 || longitude > 180)
+    {
+        cout << "Invalid longitude. Please enter a number between -180 and 180." << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Validates the inline fields of "add" (tokens 1 to 9) into a record, reporting the first bad field.
+ */
+bool parseCityFields(const string tokens[], CityRecord &record)
+{
+    const int MAX_POPULATION = 40000000;
+    const int MIN_YEAR = 1980;
+    const int MAX_YEAR = 2024;
+    for (int i : {1, 2, 5, 6, 7})
+    {
+        if (trim(tokens[i]).empty())
+        {
+            cout << "City name, region, mayor's name, mayor's address and history cannot be empty." << endl;
+            return false;
+        }
+    }
+    if (!parseInteger(tokens[3], record.population, 1, MAX_POPULATION))
+    {
+        cout << "Invalid population. Please enter an integer between 1 and " << MAX_POPULATION << "." << endl;
+        return false;
+    }
+    if (!parseInteger(tokens[4], record.year, MIN_YEAR, MAX_YEAR))
+    {
+        cout << "Invalid year. Please enter a year between " << MIN_YEAR << " and " << MAX_YEAR << "." << endl;
+        return false;
+    }
+    if (!parseNumber(tokens[8], record.latitude) || record.latitude < -90 || record.latitude > 90)
+    {
+        cout << "Invalid latitude. Please enter a number between -90 and 90." << endl;
+        return false;
+    }
+    if (!parseNumber(tokens[9], record.longitude) || record.longitude < -180 || record.longitude > 180)
+    {
+        cout << "Invalid longitude. Please enter a number between -180 and 180." << endl;
+        return false;
+    }
+    record.name = tokens[1];
+    record.region = tokens[2];
+    record.mayorName = tokens[5];
+    record.mayorAddress = tokens[6];
+    record.history = tokens[7];
+    return true;
+}
+
+/**
+ * Removes "--format=", "--limit=", "--offset=", "--page=" and "--count" options from the tokens
+ * of a listing command into output. A page is a window of limit rows (20 unless given).
+ */
+bool parseOutputOptions(string tokens[], int &tokenCount, OutputOptions &output)
+{
+    const size_t DEFAULT_PAGE_SIZE = 20;
+    size_t page = 0;
+    bool limited = false;
+    int kept = 0;
+    for (int i = 0; i < tokenCount; ++i)
+    {
+        const string option = toLowerCase(tokens[i]);
+        if (option == "--count")
+        {
+            output.countOnly = true;
+            continue;
+        }
+        size_t equals = option.find('=');
+        if (option.rfind("--", 0) != 0 || equals == string::npos)
+        {
+            tokens[kept++] = tokens[i];
+            continue;
+        }
+        const string name = option.substr(0, equals);
+        const string value = option.substr(equals + 1);
+        int number = 0;
+        if (name == "--format")
+        {
+            if (value == "table")
+                output.format = OutputFormat::Table;
+            else if (value == "csv")
+                output.format = OutputFormat::Csv;
+            else if (value == "json" || value == "jsonl")
+                output.format = OutputFormat::JsonLines;
+            else
+            {
+                cout << "Invalid format '" << value << "'. Available formats: table, csv, json" << endl;
+                return false;
+            }
+        }
+        else if ((name == "--limit" || name == "--offset" || name == "--page") &&
+                 parseInteger(value, number, name == "--page" ? 1 : 0, numeric_limits<int>::max()))
+        {
+            if (name == "--limit")
+            {
+                output.limit = static_cast<size_t>(number);
+                limited = true;
+            }
+            else if (name == "--offset")
+                output.offset = static_cast<size_t>(number);
+            else
+                page = static_cast<size_t>(number);
+        }
+        else
+        {
+            cout << "Invalid option '" << tokens[i] << "'. Options: --format=table|csv|json, --limit=<n>, --offset=<n>, --page=<n>, --count" << endl;
+            return false;
+        }
+    }
+    if (page > 0)
+    {
+        if (!limited)
+            output.limit = DEFAULT_PAGE_SIZE;
+        output.offset += (page - 1) * output.limit;
+    }
+    tokenCount = kept;
+    return true;
+}
+
+/**
+ * Moves the output options a command's own parser set aside into output, reporting any invalid one.
+ */
+bool parseSetAsideOptions(const vector<string> &options, OutputOptions &output)
+{
+    const int MAX_OPTIONS = 8;
+    string tokens[MAX_OPTIONS];
+    int optionCount = static_cast<int>(min(options.size(), static_cast<size_t>(MAX_OPTIONS)));
+    copy(options.begin(), options.begin() + optionCount, tokens);
+    if (!parseOutputOptions(tokens, optionCount, output))
+        return false;
+    if (optionCount > 0)
+    {
+        cout << "Invalid option '" << tokens[0] << "'. Options: --format=table|csv|json, --limit=<n>, --offset=<n>, --page=<n>, --count" << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * The commands of a server session, run against a ConcurrentCityManager shared by every client.
+ * Reads run on a consistent copy without waiting; writes are applied to both copies in turn.
+ * Prompting variants are never reached because server sessions run in batch mode.
+ */
+class SharedCities
+{
+private:
+    ConcurrentCityManager &cities;
+    bool changed; // True once a command of this session changed the cities
+
+public:
+    explicit SharedCities(ConcurrentCityManager &cities) : cities(cities), changed(false) {}
+
+    bool hasChanged() const { return changed; }
+
+    bool insertCity(CityRecord record, DuplicatePolicy policy)
+    {
+        changed = true;
+        return cities.insertCity(move(record), policy);
+    }
+
+    void addCity(string name, string region, int population, int year, string mayorName,
+                 string mayorAddress, string history, double latitude, double longitude)
+    {
+        insertCity(CityRecord{move(name), move(region), population, year, move(mayorName), move(mayorAddress),
+                              move(history), latitude, longitude},
+                   DuplicatePolicy::KeepLast);
+    }
+
+    bool deleteCity(const string &name, const string &region)
+    {
+        changed = true;
+        return cities.deleteCity(name, region);
+    }
+
+    bool setCityAttribute(const string &name, const string &region, const string &attribute, const string &value)
+    {
+        changed = true;
+        return cities.setCityAttribute(name, region, attribute, value);
+    }
+
+    void modifyCityAttribute(const string &, const string &, const string &)
+    {
+        cout << "Usage: modify <cityname> <region> <attribute> <value>" << endl;
+    }
+
+    bool sortCities(const vector<SortKey> &keys) { return cities.sortCities(keys); }
+
+    bool loadFromFile(const string &filename, DuplicatePolicy policy)
+    {
+        changed = true;
+        return cities.loadFromFile(filename, policy);
+    }
+
+    bool checkpoint() { return cities.checkpoint(); }
+
+    void searchCityAttribute(const string &name, const string &region, const string &attribute) const
+    {
+        cities.read([&](const CityManager &manager) { manager.searchCityAttribute(name, region, attribute); });
+    }
+
+    void displayCities(const OutputOptions &output) const
+    {
+        cities.read([&](const CityManager &manager) { manager.displayCities(output); });
+    }
+
+    void displayCity(const string &name, const string &region) const
+    {
+        cities.read([&](const CityManager &manager) { manager.displayCity(name, region); });
+    }
+
+    void filterCitiesByPopulation(int minPopulation, int maxPopulation, const OutputOptions &output) const
+    {
+        cities.read([&](const CityManager &manager)
+                    { manager.filterCitiesByPopulation(minPopulation, maxPopulation, output); });
+    }
+
+    void filterCitiesByRegion(const string &region, const OutputOptions &output) const
+    {
+        cities.read([&](const CityManager &manager) { manager.filterCitiesByRegion(region, output); });
+    }
+
+    void showMemoryUsage() const
+    {
+        cities.read([&](const CityManager &manager) { manager.showMemoryUsage(); });
+    }
+
+    bool showStatistics(bool verify) const
+    {
+        return cities.read([&](const CityManager &manager) { return manager.showStatistics(verify); });
+    }
+
+    bool showGroupStatistics(const string &attribute) const
+    {
+        return cities.read([&](const CityManager &manager) { return manager.showGroupStatistics(attribute); });
+    }
+
+    void calculateDistance(const string &city1Name, const string &region1, const string &city2Name,
+                           const string &region2) const
+    {
+        cities.read([&](const CityManager &manager)
+                    { manager.calculateDistance(city1Name, region1, city2Name, region2); });
+    }
+
+    void showDistancesFrom(const string &name, const string &region, double maxDistance, bool sorted) const
+    {
+        cities.read([&](const CityManager &manager) { manager.showDistancesFrom(name, region, maxDistance, sorted); });
+    }
+
+    template <typename... Place>
+    void showNearest(const Place &...place) const
+    {
+        cities.read([&](const CityManager &manager) { manager.showNearest(place...); });
+    }
+
+    template <typename... Place>
+    void showWithin(const Place &...place) const
+    {
+        cities.read([&](const CityManager &manager) { manager.showWithin(place...); });
+    }
+
+    void searchText(const TextQuery &query, const OutputOptions &output) const
+    {
+        cities.read([&](const CityManager &manager) { manager.searchText(query, output); });
+    }
+
+    void suggestCities(const string &prefix, size_t limit) const
+    {
+        cities.read([&](const CityManager &manager) { manager.suggestCities(prefix, limit); });
+    }
+
+    void runQuery(const CityQuery &query, const OutputOptions &output) const
+    {
+        cities.read([&](const CityManager &manager) { manager.runQuery(query, output); });
+    }
+
+    void explainQuery(const CityQuery &query) const
+    {
+        cities.read([&](const CityManager &manager) { manager.explainQuery(query); });
+    }
+
+    void saveSnapshot(const string &filename) const
+    {
+        cities.read([&](const CityManager &manager) { manager.saveSnapshot(filename); });
+    }
+};
+
+/**
+ *Processes user commands and interacts with the CityManager, or with the SharedCities of a server session.
+ */
+template <typename Manager>
+bool processCommand(const string &command, Manager &manager, const string &filename, SessionOptions &options)
+{
+    const int MAX_TOKENS = 16;
     string tokens[MAX_TOKENS];
     int tokenCount = parseCommand(command, tokens, MAX_TOKENS);
 
     if (tokenCount == 0)
     {
         cout << "No command entered!" << endl;
-        return;
+        return false;
     }
 
 
@@ -71,12 +428,26 @@ void processCommand(const string &command, CityManager &manager, const string &f
 
     if (cmd == "add")
     {
-        // Handle "add <cityname>"
-        if (tokenCount < 2)
+        // Handle "add <cityname>", or the whole city inline:
+        // add <cityname> <region> <population> <year> <mayorname> <mayoraddress> <history> <latitude> <longitude>
+        if (tokenCount >= 10)
+        {
+            CityRecord record;
+            if (!parseCityFields(tokens, record))
+                return false;
+            if (options.batch)
+                return manager.insertCity(move(record), options.duplicates);
+            manager.addCity(record.name, record.region, record.population, record.year, record.mayorName,
+                            record.mayorAddress, record.history, record.latitude, record.longitude);
+            cout << "City Is Added Successfully " << endl;
+            return true;
+        }
+        if (tokenCount < 2 || options.batch)
         {
             cout << "Usage: add <cityname>" << endl;
+            cout << "       add <cityname> <region> <population> <year> <mayorname> <mayoraddress> <history> <latitude> <longitude>" << endl;
             cout << "Note: If the city name consists of multiple words, enclose it in double quotes (\")." << endl;
-            return;
+            return false;
         }
         string cityName = tokens[1]; // Preserve original case for display
 
@@ -131,26 +502,29 @@ void processCommand(const string &command, CityManager &manager, const string &f
         {
             cout << "Usage: delete <cityname> <region>" << endl;
             cout << "Note: If the city name consists of multiple words, enclose it in double quotes (\")." << endl;
-            return;
+            return false;
         }
         string cityName = tokens[1];
         string region = tokens[2];
 
-        manager.deleteCity(cityName, region);
+        return manager.deleteCity(cityName, region);
     }
     else if (cmd == "modify")
     {
-        // Expected format: modify <cityname> <region> <attribute>
-        if (tokenCount < 4)
+        // Expected format: modify <cityname> <region> <attribute> [value]
+        if (tokenCount < 4 || (options.batch && tokenCount < 5))
         {
-            cout << "Usage: modify <cityname> <region> <attribute>" << endl;
+            cout << "Usage: modify <cityname> <region> <attribute> [value]" << endl;
             cout << "Note: If the city name consists of multiple words, enclose it in double quotes (\")." << endl;
-            return;
+            return false;
         }
         string cityName = tokens[1];
         string region = tokens[2];
         string attribute = toLowerCase(tokens[3]);
 
+        // An inline value is applied directly; otherwise prompt for it
+        if (tokenCount >= 5)
+            return manager.setCityAttribute(cityName, region, attribute, tokens[4]);
         manager.modifyCityAttribute(cityName, region, attribute);
     }
     else if (cmd == "search")
@@ -160,7 +534,7 @@ void processCommand(const string &command, CityManager &manager, const string &f
         {
             cout << "Usage: search <cityname> <region> <attribute>" << endl;
             cout << "Note: If the city name consists of multiple words, enclose it in double quotes (\")." << endl;
-            return;
+            return false;
         }
         string cityName = tokens[1];
         string region = tokens[2];
@@ -169,10 +543,13 @@ void processCommand(const string &command, CityManager &manager, const string &f
     }
     else if (cmd == "display")
     {
+        OutputOptions output;
+        if (!parseOutputOptions(tokens, tokenCount, output))
+            return false;
         if (tokenCount == 1)
         {
             // Display all cities
-            manager.displayCities();
+            manager.displayCities(output);
         }
         else if (tokenCount == 3)
         {
@@ -184,42 +561,113 @@ void processCommand(const string &command, CityManager &manager, const string &f
         else
         {
             cout << "Usage:" << endl;
-            cout << "  display                      - Display all cities." << endl;
+            cout << "  display [options]            - Display all cities." << endl;
             cout << "  display <cityname> <region>  - Display a specific city." << endl;
             cout << "Note: If the city name consists of multiple words, enclose it in double quotes (\")." << endl;
         }
     }
     else if (cmd == "save")
     {
-        manager.saveToFile(filename);
+        // Fold the journal into the data file
+        if (!manager.checkpoint())
+            return false;
+        if (!options.batch)
+            cout << "Cities saved to file successfully!" << endl;
+    }
+    else if (cmd == "snapshot")
+    {
+        // Expected format: snapshot <filename>
+        if (tokenCount < 2)
+        {
+            cout << "Usage: snapshot <filename>" << endl;
+            return false;
+        }
+        manager.saveSnapshot(tokens[1]);
     }
     else if (cmd == "load")
     {
-        manager.loadFromFile(filename);
+        // Expected format: load [keep-first|keep-last|reject]
+        // Keep-first by default: the file is older than any journaled edit to the same city
+        DuplicatePolicy policy = DuplicatePolicy::KeepFirst;
+        if (tokenCount >= 2)
+        {
+            string policyName = toLowerCase(tokens[1]);
+            if (policyName == "keep-first")
+                policy = DuplicatePolicy::KeepFirst;
+            else if (policyName == "keep-last")
+                policy = DuplicatePolicy::KeepLast;
+            else if (policyName == "reject")
+                policy = DuplicatePolicy::Reject;
+            else
+            {
+                cout << "Usage: load [keep-first|keep-last|reject]" << endl;
+                return false;
+            }
+        }
+        if (!manager.loadFromFile(filename, policy))
+            return false;
+        // Loaded rows are not journaled, so write them through to the data file
+        if (!manager.checkpoint())
+            return false;
     }
     else if (cmd == "sort")
     {
-        // Expected format: sort <attribute>
+        // Expected format: sort <attribute> [asc|desc] [, <attribute> [asc|desc]]...
+        const string usage = "Usage: sort <attribute> [asc|desc] [, <attribute> [asc|desc]]...";
         if (tokenCount < 2)
         {
-            cout << "Usage: sort <attribute>" << endl;
-            cout << "Available attributes: name, population, year, latitude, longitude" << endl;
-            return;
+            cout << usage << endl;
+            cout << "Available attributes: name, region, population, year, mayorname, mayoraddress, history, latitude, "
+                    "longitude, none"
+                 << endl;
+            return false;
         }
-        string sortAttribute = toLowerCase(tokens[1]);
-        manager.sortCities(sortAttribute);
+
+        // Commas between keys are optional; a direction applies to the attribute before it
+        vector<SortKey> keys;
+        for (int i = 1; i < tokenCount; ++i)
+        {
+            const string words = toLowerCase(tokens[i]);
+            for (size_t start = 0; start <= words.size();)
+            {
+                size_t comma = min(words.find(',', start), words.size());
+                string word = words.substr(start, comma - start);
+                start = comma + 1;
+                if (word.empty())
+                    continue;
+                if (word != "asc" && word != "desc")
+                    keys.push_back({word, false});
+                else if (!keys.empty())
+                    keys.back().descending = word == "desc";
+                else
+                {
+                    cout << usage << endl;
+                    return false;
+                }
+            }
+        }
+        if (keys.empty())
+        {
+            cout << usage << endl;
+            return false;
+        }
+        return manager.sortCities(keys);
     }
     else if (cmd == "filter")
     {
         // Expected formats:
         // filter population <min> <max>
         // filter region <region>
+        // followed by any output options
 
+        OutputOptions output;
+        if (!parseOutputOptions(tokens, tokenCount, output))
+            return false;
         if (tokenCount < 2)
         {
             cout << "Usage: filter <attribute> [parameters]" << endl;
             cout << "Available attributes: population, region" << endl;
-            return;
+            return false;
         }
 
         string filterAttribute = toLowerCase(tokens[1]);
@@ -229,7 +677,7 @@ void processCommand(const string &command, CityManager &manager, const string &f
             if (tokenCount < 4)
             {
                 cout << "Usage: filter population <min> <max>" << endl;
-                return;
+                return false;
             }
             int minPop = 0;
             int maxPop = 0;
@@ -241,34 +689,167 @@ void processCommand(const string &command, CityManager &manager, const string &f
             catch (...)
             {
                 cout << "Invalid population range. Please enter valid integers." << endl;
-                return;
+                return false;
             }
             if (minPop > maxPop)
             {
                 cout << "Minimum population cannot be greater than maximum population." << endl;
-                return;
+                return false;
             }
-            manager.filterCitiesByPopulation(minPop, maxPop);
+            manager.filterCitiesByPopulation(minPop, maxPop, output);
         }
         else if (filterAttribute == "region")
         {
             if (tokenCount < 3)
             {
                 cout << "Usage: filter region <region>" << endl;
-                return;
+                return false;
             }
             string region = toLowerCase(tokens[2]);
-            manager.filterCitiesByRegion(region);
+            manager.filterCitiesByRegion(region, output);
         }
         else
         {
             cout << "Invalid filter attribute. Available attributes: population, region" << endl;
         }
     }
+    else if (cmd == "query" || cmd == "explain")
+    {
+        // Expected format: query [where] <condition> [order by <attribute> [asc|desc]] [limit <n>] [options]
+        // The query is parsed from the raw text, which may hold more words than the command tokens
+        CityQuery query;
+        string error;
+        if (tokenCount < 2 || !CityQuery::parse(commandArguments(command), query, error))
+        {
+            if (!error.empty())
+                cout << "Invalid query: " << error << endl;
+            cout << "Usage: " << cmd << " [where] <condition> [order by <attribute> [asc|desc]] [limit <n>]" << endl;
+            cout << "Conditions combine these with and, or and parentheses:" << endl;
+            cout << "  population|year|latitude|longitude (=|<|<=|>|>=) <number>" << endl;
+            cout << "  population|year|latitude|longitude between <low> and <high>" << endl;
+            cout << "  region = <region>, region in (<region>, ...), name = <name>, name prefix <text>" << endl;
+            cout << "  within <km> of <latitude> <longitude>, box <lat1> <lon1> <lat2> <lon2>" << endl;
+            return false;
+        }
+        if (cmd == "explain")
+        {
+            manager.explainQuery(query);
+            return true;
+        }
+        OutputOptions output;
+        if (!parseSetAsideOptions(query.options, output))
+            return false;
+        manager.runQuery(query, output);
+    }
+    else if (cmd == "top")
+    {
+        // Expected format: top <k> <attribute> [asc|desc] [region <region>] [population <min> <max>] [options]
+        // Runs as a query ordered by the attribute and limited to k, so the stored order is left alone
+        OutputOptions output;
+        if (!parseOutputOptions(tokens, tokenCount, output))
+            return false;
+        CityQuery query;
+        query.descending = true;
+        int k = 0;
+        bool valid = tokenCount >= 3 && parseInteger(tokens[1], k, 1, numeric_limits<int>::max());
+        if (valid)
+        {
+            query.orderBy = toLowerCase(tokens[2]);
+            query.limit = static_cast<size_t>(k);
+            const FieldDescriptor *field = findField(query.orderBy);
+            valid = field != nullptr && field->ordered;
+        }
+        int i = 3;
+        if (valid && i < tokenCount && (toLowerCase(tokens[i]) == "asc" || toLowerCase(tokens[i]) == "desc"))
+            query.descending = toLowerCase(tokens[i++]) == "desc";
+        vector<QueryCondition> filters;
+        while (valid && i < tokenCount)
+        {
+            QueryCondition filter;
+            const string word = toLowerCase(tokens[i]);
+            if (word == "region" && i + 1 < tokenCount)
+            {
+                filter.kind = QueryCondition::Kind::Region;
+                filter.text = toLowerCase(tokens[i + 1]);
+                i += 2;
+            }
+            else if (word == "population" && i + 2 < tokenCount)
+            {
+                int low = 0;
+                int high = 0;
+                valid = parseInteger(tokens[i + 1], low, numeric_limits<int>::min(), numeric_limits<int>::max()) &&
+                        parseInteger(tokens[i + 2], high, low, numeric_limits<int>::max());
+                filter.kind = QueryCondition::Kind::Range;
+                filter.field = CityField::Population;
+                filter.attribute = "population";
+                filter.low = low;
+                filter.high = high;
+                i += 3;
+            }
+            else
+                valid = false;
+            filters.push_back(filter);
+        }
+        if (!valid)
+        {
+            cout << "Usage: top <k> <attribute> [asc|desc] [region <region>] [population <min> <max>] [options]" << endl;
+            cout << "Available attributes: name, population, year, latitude, longitude (largest first unless asc)" << endl;
+            return false;
+        }
+        if (filters.size() == 1)
+            query.where = filters[0];
+        else if (filters.size() > 1)
+        {
+            query.where.kind = QueryCondition::Kind::And;
+            query.where.children = filters;
+        }
+        manager.runQuery(query, output);
+    }
+    else if (cmd == "text")
+    {
+        // Expected format: text <word|word*|"phrase"|field:...>... [options]
+        TextQuery query;
+        string error;
+        if (tokenCount < 2 || !TextQuery::parse(commandArguments(command), query, error))
+        {
+            if (!error.empty())
+                cout << "Invalid search: " << error << endl;
+            cout << "Usage: text <word|word*|\"phrase\">... [options]" << endl;
+            cout << "Prefix a word or phrase with history:, mayor: or address: to search one field." << endl;
+            return false;
+        }
+        OutputOptions output;
+        if (!parseSetAsideOptions(query.options, output))
+            return false;
+        manager.searchText(query, output);
+    }
+    else if (cmd == "suggest")
+    {
+        // Expected format: suggest <prefix> [count]
+        int count = 10;
+        if (tokenCount < 2 || (tokenCount >= 3 && !parseInteger(tokens[2], count, 1, numeric_limits<int>::max())))
+        {
+            cout << "Usage: suggest <prefix> [count]" << endl;
+            cout << "Note: If the prefix consists of multiple words, enclose it in double quotes (\")." << endl;
+            return false;
+        }
+        manager.suggestCities(tokens[1], static_cast<size_t>(count));
+    }
     else if (cmd == "stats")
     {
-        // Display statistical summaries
-        manager.showStatistics();
+        // Expected formats: stats | stats memory | stats --verify | stats by region|year
+        if (tokenCount >= 2 && toLowerCase(tokens[1]) == "memory")
+            manager.showMemoryUsage();
+        else if (tokenCount >= 2 && toLowerCase(tokens[1]) == "by")
+        {
+            if (tokenCount < 3 || !manager.showGroupStatistics(toLowerCase(tokens[2])))
+            {
+                cout << "Usage: stats by region|year" << endl;
+                return false;
+            }
+        }
+        else
+            return manager.showStatistics(tokenCount >= 2 && toLowerCase(tokens[1]) == "--verify");
     }
     else if (cmd == "help")
     {
@@ -277,42 +858,84 @@ void processCommand(const string &command, CityManager &manager, const string &f
         cout << "Available Commands:\n";
         cout << "-----------------------------------------------\n";
         cout << "add <cityname>                   - Add a new city to the database.\n";
+        cout << "add <cityname> <region> <population> <year> <mayorname> <mayoraddress> <history> <latitude> <longitude>\n";
+        cout << "                                 - Add a new city with every field given inline.\n";
         cout << "                                   Note: If the city name consists of multiple words,\n";
         cout << "                                   enclose it in double quotes (\").\n\n";
         cout << "delete <cityname> <region>       - Delete a city from the database.\n";
         cout << "                                   Note: If the city name consists of multiple words,\n";
         cout << "                                   enclose it in double quotes (\").\n\n";
-        cout << "modify <cityname> <region> <attribute> - Modify a specific attribute of a city.\n";
+        cout << "modify <cityname> <region> <attribute> [value] - Modify a specific attribute of a city.\n";
+        cout << "                                       Without a value, the new value is prompted for.\n";
         cout << "                                       Note: If the city name consists of multiple words,\n";
         cout << "                                       enclose it in double quotes (\").\n\n";
         cout << "search <cityname> <region> <attribute> - Search for a specific attribute of a city.\n";
         cout << "                                       Note: If the city name consists of multiple words,\n";
         cout << "                                       enclose it in double quotes (\").\n\n";
-        cout << "display                          - Display all cities in the database.\n";
+        cout << "display [options]                - Display all cities in the database.\n";
         cout << "display <cityname> <region>      - Display a specific city.\n";
         cout << "                                   Note: If the city name consists of multiple words,\n";
         cout << "                                   enclose it in double quotes (\").\n\n";
-        cout << "sort <attribute>                 - Sort cities based on the specified attribute.\n";
-        cout << "                                   Available attributes: name, population, year, latitude, longitude.\n\n";
+        cout << "sort <attribute> [asc|desc] [, <attribute> [asc|desc]]...\n";
+        cout << "                                 - Sort cities based on the specified attributes, each one\n";
+        cout << "                                   breaking ties of the one before it.\n";
+        cout << "                                   Available attributes: name, region, population, year,\n";
+        cout << "                                   mayorname, mayoraddress, history, latitude, longitude.\n";
+        cout << "                                   'sort none' lists cities in insertion order again.\n\n";
         cout << "filter <attribute> [parameters]   - Filter and display cities based on the specified attribute.\n";
         cout << "                                   Available attributes:\n";
         cout << "                                     - population <min> <max>\n";
-        cout << "                                     - region <region>\n\n";
-        cout << "stats                            - Display statistical summaries of the cities.\n\n";
-        cout << "save                             - Save the current list of cities to the data file.\n\n";
-        cout << "load                             - Load cities from the data file.\n\n";
+        cout << "                                     - region <region>\n";
+        cout << "                                   display and filter accept the options\n";
+        cout << "                                   --format=table|csv|json, --limit=<n>, --offset=<n>, --page=<n>\n";
+        cout << "                                   and --count to print only the number of matches.\n\n";
+        cout << "query [where] <condition> [order by <attribute> [asc|desc]] [limit <n>] [options]\n";
+        cout << "                                 - List the cities matching a condition, e.g.\n";
+        cout << "                                   query population > 100000 and (region = france or region in (spain, italy))\n";
+        cout << "                                   Predicates: population, year, latitude and longitude compared\n";
+        cout << "                                   with =, <, <=, >, >= or between; region = r; region in (r, ...);\n";
+        cout << "                                   name = n; name prefix p; within <km> of <lat> <lon>;\n";
+        cout << "                                   box <lat1> <lon1> <lat2> <lon2>. Accepts the display options.\n";
+        cout << "explain <query>                  - Show how a query would be answered, without running it.\n\n";
+        cout << "top <k> <attribute> [asc|desc] [region <region>] [population <min> <max>]\n";
+        cout << "                                 - List the k cities with the largest (or with asc, smallest)\n";
+        cout << "                                   values of an attribute, optionally within a region and\n";
+        cout << "                                   population range, without changing the sort order.\n";
+        cout << "                                   Accepts the display options.\n\n";
+        cout << "text <word|word*|\"phrase\">...   - List the cities whose history, mayor's name or address\n";
+        cout << "                                   contain every word, prefix and phrase. Prefix one with\n";
+        cout << "                                   history:, mayor: or address: to search that field only.\n";
+        cout << "                                   Accepts the display options.\n\n";
+        cout << "suggest <prefix> [count]         - List up to count (default 10) city names starting with a\n";
+        cout << "                                   prefix, then names within a typo or two of it. Lookups\n";
+        cout << "                                   that find no city also suggest close names.\n\n";
+        cout << "stats                            - Display statistical summaries of the cities.\n";
+        cout << "stats memory                     - Display memory used by the city data.\n";
+        cout << "stats --verify                   - Check the statistics against a full recompute.\n";
+        cout << "stats by region|year             - Display the number of cities, population totals, average,\n";
+        cout << "                                   minimum and maximum, and centroid of each region or year.\n\n";
+        cout << "save                             - Write every change into the data file and clear the journal.\n\n";
+        cout << "snapshot <filename>              - Save the cities to a binary snapshot for fast startup.\n\n";
+        cout << "load [keep-first|keep-last|reject] - Load cities from the data file. Duplicates keep the\n";
+        cout << "                                   existing city (default), replace it, or abort the load.\n\n";
         cout << "distance <city1name> <region1> <city2name> <region2> - Calculate the distance between two cities.\n";
         cout << "                                   Note: If city names consist of multiple words,\n";
         cout << "                                   enclose them in double quotes (\").\n\n";
+        cout << "distances <cityname> <region> [sorted] [max <km>] - Distances from one city to all others,\n";
+        cout << "                                   optionally sorted and limited to a radius in km.\n\n";
+        cout << "nearest <k> <cityname> <region>  - List the k cities nearest to a city.\n";
+        cout << "nearest <k> <latitude> <longitude> - List the k cities nearest to a point.\n\n";
+        cout << "within <km> <cityname> <region>  - List all cities within a radius of a city.\n";
+        cout << "within <km> <latitude> <longitude> - List all cities within a radius of a point.\n\n";
         cout << "help                             - Display this help menu.\n";
         cout << "exit                             - Save changes and exit the program.\n";
         cout << "=================================================\n";
     }
     else if (cmd == "exit")
     {
-        cout << "Terminating program and saving any changes..." << endl;
-        manager.saveToFile(filename);
-        exit(0);
+        if (!options.batch)
+            cout << "Terminating program and saving any changes..." << endl;
+        options.exitRequested = true;
     }
     else if (cmd == "distance")
     {
@@ -321,7 +944,7 @@ void processCommand(const string &command, CityManager &manager, const string &f
         {
             cout << "Usage: distance <city1name> <region1> <city2name> <region2>" << endl;
             cout << "Note: If city names consist of multiple words, enclose them in double quotes (\")." << endl;
-            return;
+            return false;
         }
         string city1Name = tokens[1];
         string region1 = tokens[2];
@@ -330,31 +953,286 @@ void processCommand(const string &command, CityManager &manager, const string &f
 
         manager.calculateDistance(city1Name, region1, city2Name, region2);
     }
+    else if (cmd == "distances")
+    {
+        // Expected format: distances <cityname> <region> [sorted] [max <km>]
+        if (tokenCount < 3)
+        {
+            cout << "Usage: distances <cityname> <region> [sorted] [max <km>]" << endl;
+            cout << "Note: If the city name consists of multiple words, enclose it in double quotes (\")." << endl;
+            return false;
+        }
+        bool sorted = false;
+        double maxDistance = numeric_limits<double>::infinity();
+        for (int i = 3; i < tokenCount; ++i)
+        {
+            string option = toLowerCase(tokens[i]);
+            if (option == "sorted")
+            {
+                sorted = true;
+            }
+            else if (option == "max" && i + 1 < tokenCount)
+            {
+                if (!parseNumber(tokens[++i], maxDistance) || !isfinite(maxDistance) || maxDistance < 0)
+                {
+                    cout << "Invalid maximum distance. Please enter a non-negative number of km." << endl;
+                    return false;
+                }
+            }
+            else
+            {
+                cout << "Usage: distances <cityname> <region> [sorted] [max <km>]" << endl;
+                return false;
+            }
+        }
+        manager.showDistancesFrom(tokens[1], tokens[2], maxDistance, sorted);
+    }
+    else if (cmd == "nearest")
+    {
+        // Expected formats: nearest <k> <cityname> <region> | nearest <k> <latitude> <longitude>
+        int k = 0;
+        if (tokenCount < 4 || !parseInteger(tokens[1], k, 1, numeric_limits<int>::max()))
+        {
+            cout << "Usage: nearest <k> <cityname> <region>" << endl;
+            cout << "       nearest <k> <latitude> <longitude>" << endl;
+            return false;
+        }
+        double latitude = 0;
+        double longitude = 0;
+        if (parseNumber(tokens[2], latitude) && parseNumber(tokens[3], longitude))
+        {
+            if (!validCoordinates(latitude, longitude))
+                return false;
+            manager.showNearest(latitude, longitude, static_cast<size_t>(k));
+        }
+        else
+        {
+            manager.showNearest(tokens[2], tokens[3], static_cast<size_t>(k));
+        }
+    }
+    else if (cmd == "within")
+    {
+        // Expected formats: within <km> <cityname> <region> | within <km> <latitude> <longitude>
+        double radius = 0;
+        if (tokenCount < 4 || !parseNumber(tokens[1], radius) || radius < 0)
+        {
+            cout << "Usage: within <km> <cityname> <region>" << endl;
+            cout << "       within <km> <latitude> <longitude>" << endl;
+            return false;
+        }
+        double latitude = 0;
+        double longitude = 0;
+        if (parseNumber(tokens[2], latitude) && parseNumber(tokens[3], longitude))
+        {
+            if (!validCoordinates(latitude, longitude))
+                return false;
+            manager.showWithin(latitude, longitude, radius);
+        }
+        else
+        {
+            manager.showWithin(tokens[2], tokens[3], radius);
+        }
+    }
     else
     {
         cout << "Unknown command! Type 'help' to see available commands." << endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Runs every command of a script without prompts, then reports throughput on stderr.
+ * Blank lines and lines starting with '#' are skipped. Returns the exit status.
+ */
+int runBatch(istream &in, CityManager &manager, const string &filename, SessionOptions &options)
+{
+    size_t commands = 0;
+    size_t failed = 0;
+    size_t lineNumber = 0;
+    auto start = chrono::steady_clock::now();
+    string line;
+    while (!options.exitRequested && getline(in, line))
+    {
+        lineNumber++;
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        commands++;
+        if (!processCommand(line, manager, filename, options))
+        {
+            failed++;
+            cerr << "Line " << lineNumber << ": command failed: " << line << endl;
+        }
     }
+    // Journal records are committed in groups while the script runs; sync the last one
+    manager.commitJournal();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    ostringstream summary;
+    summary << "Batch complete: " << commands << " command(s), " << failed << " failed, in " << fixed
+            << setprecision(1) << seconds * 1000.0 << " ms (" << setprecision(0)
+            << (seconds > 0 ? commands / seconds : 0.0) << " commands/sec)";
+    cerr << summary.str() << endl;
+    return failed == 0 ? 0 : 1;
+}
+
+/**
+ * Serves the commands of local clients until SIGINT or SIGTERM. Each client gets its own
+ * batch session; reads from different clients run in parallel. Returns the exit status.
+ */
+int runServer(const string &filename, const string &socketPath, int port, size_t workers)
+{
+    ConcurrentCityManager cities;
+    cities.setQuiet(true);
+    cities.loadFromFile(filename);
+    cities.openJournal(filename);
+
+    QueryServer server(
+        [&](const string &command, bool &closeConnection)
+        {
+            SessionOptions options;
+            options.batch = true;
+            SharedCities session(cities);
+            bool succeeded = processCommand(command, session, filename, options);
+            if (session.hasChanged())
+                cities.commitJournal();
+            closeConnection = options.exitRequested;
+            return succeeded;
+        },
+        workers);
+
+    string error;
+    bool listening = socketPath.empty() ? server.listenTcp(static_cast<uint16_t>(port), error)
+                                        : server.listenUnix(socketPath, error);
+    if (!listening)
+    {
+        cerr << "Error: " << error << endl;
+        return 2;
+    }
+    if (socketPath.empty())
+        cerr << "Serving " << filename << " on 127.0.0.1:" << port << " with " << workers << " worker(s)" << endl;
+    else
+        cerr << "Serving " << filename << " on " << socketPath << " with " << workers << " worker(s)" << endl;
+    int status = server.run();
+    cities.commitJournal();
+    return status;
 }
 
 /**
  * Main function to run the program.
+ * The data file defaults to data.txt; a file saved with 'snapshot' (or any name ending
+ * in .snap) is loaded and saved in the binary snapshot format.
+ * Usage: 5004_CW [datafile] [--batch [commandfile]] [--duplicates keep-first|keep-last|reject]
+ *        5004_CW [datafile] --socket <path> | --port <n> [--workers <n>]
  */
-int main()
+int main(int argc, char *argv[])
 {
-    CityManager manager;
     string filename = "data.txt";
-    // Load cities from the file at the start
+    string commandFile;
+    SessionOptions options;
+    string socketPath;
+    int port = 0;
+    int workers = static_cast<int>(max(2u, thread::hardware_concurrency()));
+    for (int i = 1; i < argc; ++i)
+    {
+        string argument = argv[i];
+        if (argument == "--socket" && i + 1 < argc)
+        {
+            socketPath = argv[++i];
+        }
+        else if (argument == "--port" && i + 1 < argc)
+        {
+            if (!parseInteger(argv[++i], port, 1, 65535))
+            {
+                cerr << "Invalid port '" << argv[i] << "'. Use a number from 1 to 65535." << endl;
+                return 2;
+            }
+        }
+        else if (argument == "--workers" && i + 1 < argc)
+        {
+            if (!parseInteger(argv[++i], workers, 1, 256))
+            {
+                cerr << "Invalid worker count '" << argv[i] << "'. Use a number from 1 to 256." << endl;
+                return 2;
+            }
+        }
+        else if (argument == "--batch")
+        {
+            options.batch = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                commandFile = argv[++i];
+        }
+        else if (argument == "--duplicates" && i + 1 < argc)
+        {
+            string policyName = toLowerCase(argv[++i]);
+            if (policyName == "keep-first")
+                options.duplicates = DuplicatePolicy::KeepFirst;
+            else if (policyName == "keep-last")
+                options.duplicates = DuplicatePolicy::KeepLast;
+            else if (policyName == "reject")
+                options.duplicates = DuplicatePolicy::Reject;
+            else
+            {
+                cerr << "Unknown duplicate policy '" << policyName << "'. Use keep-first, keep-last or reject." << endl;
+                return 2;
+            }
+        }
+        else if (argument == "-")
+        {
+            options.batch = true; // Commands from stdin
+        }
+        else if (!argument.empty() && argument[0] != '-')
+        {
+            filename = argument;
+        }
+        else
+        {
+            cerr << "Usage: " << argv[0] << " [datafile] [--batch [commandfile]] [--duplicates keep-first|keep-last|reject]" << endl;
+            cerr << "       " << argv[0] << " [datafile] --socket <path> | --port <n> [--workers <n>]" << endl;
+            return 2;
+        }
+    }
+
+    if (!socketPath.empty() || port != 0)
+    {
+        if (!socketPath.empty() && port != 0)
+        {
+            cerr << "Use either --socket or --port, not both." << endl;
+            return 2;
+        }
+        return runServer(filename, socketPath, port, static_cast<size_t>(workers));
+    }
+
+    CityManager manager;
+    manager.setQuiet(options.batch);
+    // Load cities from the file at the start, then replay changes journaled since it was written
     manager.loadFromFile(filename);
+    manager.openJournal(filename);
+
+    if (options.batch)
+    {
+        if (commandFile.empty())
+            return runBatch(cin, manager, filename, options);
+        ifstream script(commandFile);
+        if (!script)
+        {
+            cerr << "Error: Could not open command file " << commandFile << endl;
+            return 2;
+        }
+        return runBatch(script, manager, filename, options);
+    }
 
     string command;
     cout << "Hello, Welcome to our City Management Program! Type 'help' to see available commands." << endl;
 
-    while (true)
+    while (!options.exitRequested)
     {
         cout << "\nEnter command: ";
         getline(cin, command);
         command = trim(command);
-        processCommand(command, manager, filename);
+        processCommand(command, manager, filename, options);
+        manager.commitJournal();
     }
 
     return 0;
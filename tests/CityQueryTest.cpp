@@ -0,0 +1,174 @@
+#include "TestSupport.h"
+#include "CityQuery.h"
+#include "CityManager.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Parses query text and returns its condition written back in canonical form, or
+ * "error: " and the message if it does not parse.
+ */
+static string canonical(const string &text)
+{
+    CityQuery query;
+    string error;
+    if (!CityQuery::parse(text, query, error))
+        return "error: " + error;
+    return CityQuery::describe(query.where);
+}
+
+/**
+ * Checks each kind of predicate and how comparisons are normalized.
+ */
+static void testPredicates()
+{
+    CHECK(canonical("") == "all cities");
+    CHECK(canonical("population = 5000") == "population = 5000");
+    CHECK(canonical("population > 1000") == "population >= 1001");
+    CHECK(canonical("population < 1000.5") == "population <= 1000");
+    CHECK(canonical("year >= 2000") == "year >= 2000");
+    CHECK(canonical("latitude between 10 and 20.5") == "latitude between 10 and 20.5");
+    CHECK(canonical("REGION = \"New South Wales\"") == "region = new south wales");
+    CHECK(canonical("region in (france, \"united kingdom\")") == "region = france or region = united kingdom");
+    CHECK(canonical("region in (france)") == "region = france");
+    CHECK(canonical("name = \"New York\"") == "name = new york");
+    CHECK(canonical("name prefix san") == "name prefix san");
+    CHECK(canonical("within 25 of 51.5 -0.12") == "within 25 of 51.5 -0.12");
+}
+
+/**
+ * Checks that and binds tighter than or and that parentheses override it.
+ */
+static void testPrecedence()
+{
+    CHECK(canonical("population >= 1000 and year = 2000 or region = france") ==
+          "(population >= 1000 and year = 2000) or region = france");
+    CHECK(canonical("population >= 1000 and (year = 2000 or region = france)") ==
+          "population >= 1000 and (year = 2000 or region = france)");
+    CHECK(canonical("where ((name prefix a))") == "name prefix a");
+}
+
+/**
+ * Checks the clauses that follow the condition and the output options set aside.
+ */
+static void testClauses()
+{
+    CityQuery query;
+    string error;
+    CHECK(CityQuery::parse("where population > 5 order by name desc limit 10 --format=csv --limit=3", query, error));
+    CHECK(query.orderBy == "name");
+    CHECK(query.descending);
+    CHECK(query.limit == 10);
+    CHECK((query.options == vector<string>{"--format=csv", "--limit=3"}));
+
+    CHECK(CityQuery::parse("order by year asc", query, error));
+    CHECK(query.where.kind == QueryCondition::Kind::All);
+    CHECK(query.orderBy == "year" && !query.descending);
+
+    CHECK(CityQuery::parse("limit 0", query, error));
+    CHECK(query.limit == 0);
+}
+
+/**
+ * Checks that malformed queries are rejected with a message naming the problem.
+ */
+static void testErrors()
+{
+    CHECK(canonical("population").find("expected a comparison after 'population'") != string::npos);
+    CHECK(canonical("population > many").find("expected a number") != string::npos);
+    CHECK(canonical("name ~ paris").find("expected '=' or 'prefix' after 'name'") != string::npos);
+    CHECK(canonical("region in (france").rfind("error: ", 0) == 0);
+    CHECK(canonical("within -5 of 0 0").find("cannot be negative") != string::npos);
+    CHECK(canonical("box 1 2 3").find("expected a number") != string::npos);
+    CHECK(canonical("order by history").find("after 'order by'") != string::npos);
+    CHECK(canonical("limit -1").find("whole number after 'limit'") != string::npos);
+    CHECK(canonical("limit 2.5").find("whole number after 'limit'") != string::npos);
+    CHECK(canonical("limit 1e30").find("whole number after 'limit'") != string::npos);
+    CHECK(canonical("population > 5 extra") == "error: unexpected 'extra'");
+    CHECK(canonical("(population > 5").rfind("error: ", 0) == 0);
+}
+
+/**
+ * Checks how box corners become ranges: latitudes in either order, and longitudes that
+ * run east from the first to the second, crossing the 180th meridian if the first is larger.
+ */
+static void testBox()
+{
+    CHECK(canonical("box 10 20 30 40") == "latitude between 10 and 30 and longitude between 20 and 40");
+    CHECK(canonical("box 30 20 10 40") == "latitude between 10 and 30 and longitude between 20 and 40");
+    CHECK(canonical("box 0 5 10 5") == "latitude between 0 and 10 and longitude = 5");
+    CHECK(canonical("box -90 -180 90 180") == "latitude between -90 and 90 and longitude between -180 and 180");
+    CHECK(canonical("box -50 170 0 -170") ==
+          "latitude between -50 and 0 and (longitude between 170 and 180 or longitude between -180 and -170)");
+    CHECK(canonical("box 0 40 10 20") ==
+          "latitude between 0 and 10 and (longitude between 40 and 180 or longitude between -180 and 20)");
+
+    CityQuery query;
+    string error;
+    CHECK(CityQuery::parse("box -50 170 0 -170", query, error));
+    CHECK(query.where.kind == QueryCondition::Kind::And && query.where.children.size() == 2);
+    if (query.where.children.size() == 2)
+    {
+        const QueryCondition &longitude = query.where.children[1];
+        CHECK(longitude.kind == QueryCondition::Kind::Or && longitude.children.size() == 2);
+        for (const QueryCondition &side : longitude.children)
+            CHECK(side.kind == QueryCondition::Kind::Range && side.field == CityField::Longitude);
+    }
+}
+
+/**
+ * Runs box queries over cities on both sides of the 180th meridian and returns the
+ * names each finds, in record order.
+ */
+static vector<string> boxMatches(const CityManager &manager, const string &text)
+{
+    CityQuery query;
+    string error;
+    CHECK(CityQuery::parse(text, query, error));
+    OutputOptions output;
+    output.format = OutputFormat::Csv;
+    CapturedOutput capture;
+    manager.runQuery(query, output);
+    vector<string> names;
+    for (const string &line : splitLines(capture.text()))
+    {
+        if (line.front() == '"')
+            names.push_back(line.substr(1, line.find('"', 1) - 1));
+    }
+    return names;
+}
+
+/**
+ * Checks which cities a box across the 180th meridian selects, and that the same corners
+ * in the other order select the rest of the band instead.
+ */
+static void testBoxMatches()
+{
+    CityManager manager;
+    {
+        CapturedOutput capture;
+        manager.insertCity(makeCity("suva", "fiji", 93000, 2017, -18.1, 178.4), DuplicatePolicy::KeepLast);
+        manager.insertCity(makeCity("apia", "samoa", 37000, 2016, -13.8, -171.8), DuplicatePolicy::KeepLast);
+        manager.insertCity(makeCity("darwin", "australia", 147000, 2021, -12.5, 130.8), DuplicatePolicy::KeepLast);
+        manager.insertCity(makeCity("lima", "peru", 9750000, 2020, -12.0, -77.0), DuplicatePolicy::KeepLast);
+        manager.insertCity(makeCity("tokyo", "japan", 13960000, 2021, 35.7, 139.7), DuplicatePolicy::KeepLast);
+    }
+    CHECK((boxMatches(manager, "box -30 170 0 -170") == vector<string>{"suva", "apia"}));
+    CHECK((boxMatches(manager, "box -30 -170 0 170") == vector<string>{"darwin", "lima"}));
+    CHECK((boxMatches(manager, "box -30 178.4 0 178.4") == vector<string>{"suva"}));
+    CHECK((boxMatches(manager, "box -30 -180 40 180") == vector<string>{"suva", "apia", "darwin", "lima", "tokyo"}));
+    CHECK((boxMatches(manager, "box -30 170 0 -170 and population > 50000") == vector<string>{"suva"}));
+}
+
+int main()
+{
+    testPredicates();
+    testPrecedence();
+    testClauses();
+    testErrors();
+    testBox();
+    testBoxMatches();
+    return testResult("CityQueryTest");
+}
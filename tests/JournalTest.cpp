@@ -0,0 +1,198 @@
+#include "TestSupport.h"
+#include "Journal.h"
+#include "CityManager.h"
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/**
+ * Returns a journal entry that sets an attribute of a city.
+ */
+static JournalEntry setEntry(const string &name, const string &region, const string &attribute, const string &value)
+{
+    JournalEntry entry;
+    entry.operation = JournalOperation::Set;
+    entry.city.name = name;
+    entry.city.region = region;
+    entry.attribute = attribute;
+    entry.value = value;
+    return entry;
+}
+
+/**
+ * Checks that a record cut short by a crash is dropped with everything after it, that
+ * the intact records before it come back whole, and that new records follow them.
+ */
+static void testTornTail()
+{
+    const string path = scratchPath("torn.journal");
+    removeScratch(path);
+
+    size_t intactBytes = 0;
+    {
+        Journal journal;
+        vector<JournalEntry> entries;
+        size_t discarded = 0;
+        string error;
+        CHECK(journal.open(path, entries, discarded, error));
+        CHECK(entries.empty());
+
+        JournalEntry add;
+        add.operation = JournalOperation::Add;
+        add.city = makeCity("alpha", "north", 1200, 1999, 12.3456789012, -0.5);
+        journal.append(add);
+        journal.append(setEntry("alpha", "north", "population", "1300"));
+        CHECK(journal.commit());
+        intactBytes = readText(path).size();
+
+        JournalEntry remove;
+        remove.operation = JournalOperation::Delete;
+        remove.city.name = "alpha";
+        remove.city.region = "north";
+        journal.append(remove);
+        CHECK(journal.commit());
+    }
+
+    // Cut the last record short, as a crash in the middle of its write would
+    const string full = readText(path);
+    CHECK(full.size() > intactBytes);
+    writeText(path, full.substr(0, full.size() - 3));
+
+    {
+        Journal journal;
+        vector<JournalEntry> entries;
+        size_t discarded = 0;
+        string error;
+        CHECK(journal.open(path, entries, discarded, error));
+        CHECK(entries.size() == 2);
+        CHECK(discarded == full.size() - 3 - intactBytes);
+        CHECK(readText(path).size() == intactBytes);
+        if (entries.size() == 2)
+        {
+            CHECK(entries[0].operation == JournalOperation::Add);
+            CHECK(entries[0].city.name == "alpha");
+            CHECK(entries[0].city.history == "founded by the river");
+            CHECK(entries[0].city.latitude == 12.3456789012);
+            CHECK(entries[1].operation == JournalOperation::Set);
+            CHECK(entries[1].value == "1300");
+        }
+        journal.append(setEntry("alpha", "north", "year", "2001"));
+        CHECK(journal.commit());
+    }
+
+    {
+        Journal journal;
+        vector<JournalEntry> entries;
+        size_t discarded = 0;
+        string error;
+        CHECK(journal.open(path, entries, discarded, error));
+        CHECK(discarded == 0);
+        CHECK(entries.size() == 3);
+        if (entries.size() == 3)
+            CHECK(entries[2].attribute == "year" && entries[2].value == "2001");
+    }
+    removeScratch(path);
+}
+
+/**
+ * Checks that a record whose bytes were damaged fails its checksum and is dropped.
+ */
+static void testCorruptRecord()
+{
+    const string path = scratchPath("corrupt.journal");
+    removeScratch(path);
+    {
+        Journal journal;
+        vector<JournalEntry> entries;
+        size_t discarded = 0;
+        string error;
+        CHECK(journal.open(path, entries, discarded, error));
+        journal.append(setEntry("alpha", "north", "population", "1300"));
+        journal.append(setEntry("alpha", "north", "population", "1400"));
+        CHECK(journal.commit());
+    }
+
+    string contents = readText(path);
+    contents[contents.size() - 1] ^= 0x01;
+    writeText(path, contents);
+
+    Journal journal;
+    vector<JournalEntry> entries;
+    size_t discarded = 0;
+    string error;
+    CHECK(journal.open(path, entries, discarded, error));
+    CHECK(entries.size() == 1);
+    CHECK(discarded > 0);
+    removeScratch(path);
+}
+
+/**
+ * Checks that a manager reopening a data file replays the intact changes of a torn
+ * journal, and that a checkpoint then writes them into the data file exactly.
+ */
+static void testManagerRecovery()
+{
+    const string data = scratchPath("cities.txt");
+    removeScratch(data);
+    writeText(data, "\"alpha\",\"north\",1200,1999,\"mayor of alpha\",\"1 main street\",\"founded by the river\",10,20\n"
+                    "\"beta\",\"south\",3400,2005,\"mayor of beta\",\"2 main street\",\"a port town\",-30,140\n");
+
+    size_t intactBytes = 0;
+    {
+        CapturedOutput capture;
+        CityManager manager;
+        manager.loadFromFile(data);
+        CHECK(manager.openJournal(data));
+        CHECK(manager.setCityAttribute("alpha", "north", "latitude", "12.3456789012"));
+        CHECK(manager.setCityAttribute("beta", "south", "name", "gamma"));
+        manager.commitJournal();
+        intactBytes = readText(data + ".journal").size();
+        CHECK(manager.setCityAttribute("alpha", "north", "population", "7777"));
+        manager.commitJournal();
+    }
+    const string journal = readText(data + ".journal");
+    CHECK(journal.size() > intactBytes);
+    writeText(data + ".journal", journal.substr(0, intactBytes + 5));
+
+    {
+        CapturedOutput capture;
+        CityManager manager;
+        manager.loadFromFile(data);
+        CHECK(manager.openJournal(data));
+        const vector<string> cities = listCities(manager);
+        CHECK(cities.size() == 2);
+        if (cities.size() == 2)
+        {
+            CHECK(cities[0].rfind("City: alpha, Region: north, Population: 1200, Year: 1999,", 0) == 0);
+            CHECK(cities[1].rfind("City: gamma, Region: south, Population: 3400,", 0) == 0);
+        }
+        CHECK(capture.text().find("Recovered 2 change(s)") != string::npos);
+
+        // The checkpoint keeps every digit of the recovered coordinate
+        CHECK(manager.checkpoint());
+        CHECK(readText(data + ".journal").empty());
+        CHECK(readText(data).find(",12.3456789012,20\n") != string::npos);
+    }
+
+    {
+        CapturedOutput capture;
+        CityManager manager;
+        manager.loadFromFile(data);
+        CHECK(manager.openJournal(data));
+        CHECK(listCities(manager).size() == 2);
+
+        // Reloaded from the data file, the coordinate still has every digit
+        CHECK(manager.checkpoint());
+        CHECK(readText(data).find(",12.3456789012,20\n") != string::npos);
+    }
+    removeScratch(data);
+}
+
+int main()
+{
+    testTornTail();
+    testCorruptRecord();
+    testManagerRecovery();
+    return testResult("JournalTest");
+}
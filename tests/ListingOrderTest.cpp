@@ -0,0 +1,146 @@
+#include "TestSupport.h"
+#include "CityManager.h"
+#include <string>
+#include <vector>
+#include <functional>
+#include <random>
+
+using namespace std;
+
+// Cities in the test listing; a filter matching fewer than 1/16 of them reads its index
+const int CITY_COUNT = 400;
+
+/**
+ * Listing orders each filter is checked under, from insertion order to several keys.
+ */
+static const vector<vector<SortKey>> SORT_ORDERS = {
+    {},
+    {{"population", false}},
+    {{"population", true}},
+    {{"name", true}},
+    {{"history", false}},
+    {{"region", false}, {"population", true}},
+    {{"year", true}, {"latitude", false}},
+};
+
+/**
+ * Returns the value of a "Label: value" field of a display line.
+ */
+static string displayField(const string &line, const string &label)
+{
+    size_t start = line.find(label + ": ") + label.size() + 2;
+    return line.substr(start, line.find(',', start) - start);
+}
+
+/**
+ * Fills a manager with cities sharing many populations and years, then deletes and
+ * re-adds some so that record IDs no longer follow insertion order.
+ */
+static void addCities(CityManager &manager)
+{
+    mt19937 random(42);
+    const vector<string> regions = {"north", "south", "east", "west"};
+    vector<CityRecord> records;
+    for (int i = 0; i < CITY_COUNT; ++i)
+    {
+        const string region = i % 80 == 7 ? "island" : regions[random() % regions.size()];
+        records.push_back(makeCity("city" + to_string(random() % 1000) + "_" + to_string(i), region,
+                                   static_cast<int>(1 + random() % 100) * 1000, static_cast<int>(1980 + random() % 45),
+                                   static_cast<double>(random() % 180) - 90.0, static_cast<double>(random() % 360) - 180.0,
+                                   "history " + to_string(random() % 7)));
+        addRecord(manager, records.back());
+    }
+    for (int i = 0; i < CITY_COUNT; i += 9)
+        manager.deleteCity(records[i].name, records[i].region);
+    for (int i = CITY_COUNT - 1; i >= 0; --i)
+    {
+        if (i % 9 == 0 && i % 2 == 0)
+            addRecord(manager, records[i]);
+    }
+}
+
+/**
+ * Checks, under every listing order, that a filter lists exactly the cities of the full
+ * listing it matches, in the order the listing has them.
+ */
+static void checkFilterOrder(CityManager &manager, const function<void()> &filter,
+                             const function<bool(const string &)> &matches, size_t minimumMatches)
+{
+    for (const vector<SortKey> &keys : SORT_ORDERS)
+    {
+        vector<string> expected;
+        vector<string> listed;
+        {
+            CapturedOutput capture;
+            manager.sortCities(keys.empty() ? vector<SortKey>{{"none", false}} : keys);
+            for (const string &line : listCities(manager))
+            {
+                if (matches(line))
+                    expected.push_back(line);
+            }
+            CapturedOutput filtered;
+            filter();
+            listed = splitLines(filtered.text());
+        }
+        CHECK(expected.size() >= minimumMatches);
+        CHECK(listed == expected);
+    }
+}
+
+/**
+ * Checks a population range wide enough to be read with one pass over the listing.
+ */
+static void testWidePopulationFilter(CityManager &manager)
+{
+    checkFilterOrder(
+        manager, [&manager]() { manager.filterCitiesByPopulation(20000, 80000); },
+        [](const string &line)
+        {
+            const int population = stoi(displayField(line, "Population"));
+            return population >= 20000 && population <= 80000;
+        },
+        CITY_COUNT / 2);
+}
+
+/**
+ * Checks a population range narrow enough that its matches are gathered from the index
+ * and sorted into listing order.
+ */
+static void testNarrowPopulationFilter(CityManager &manager)
+{
+    checkFilterOrder(
+        manager, [&manager]() { manager.filterCitiesByPopulation(41000, 42000); },
+        [](const string &line)
+        {
+            const int population = stoi(displayField(line, "Population"));
+            return population >= 41000 && population <= 42000;
+        },
+        2);
+}
+
+/**
+ * Checks a region with a handful of cities, whose matches are sorted into listing order,
+ * and a large one, read with one pass over the listing.
+ */
+static void testRegionFilter(CityManager &manager)
+{
+    for (const string region : {"island", "north"})
+    {
+        checkFilterOrder(
+            manager, [&manager, &region]() { manager.filterCitiesByRegion(region); },
+            [&region](const string &line) { return displayField(line, "Region") == region; }, 2);
+    }
+}
+
+int main()
+{
+    CityManager manager;
+    {
+        CapturedOutput capture;
+        addCities(manager);
+    }
+    testWidePopulationFilter(manager);
+    testNarrowPopulationFilter(manager);
+    testRegionFilter(manager);
+    return testResult("ListingOrderTest");
+}
@@ -0,0 +1,161 @@
+#include "TestSupport.h"
+#include "Snapshot.h"
+#include "CityManager.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+/**
+ * Fills a manager with cities whose text needs quoting and whose values reach the ends
+ * of their ranges.
+ */
+static void addCities(CityManager &manager)
+{
+    addRecord(manager, makeCity("alpha", "north", 1200, 1999, 12.3456789012, -0.5));
+    addRecord(manager, makeCity("beta", "south", 40000000, 2024, -90, 180, "a \"quoted\", comma, history"));
+    addRecord(manager, makeCity("gamma", "north", 1, 1980, 90, -180, ""));
+    addRecord(manager, makeCity("delta town", "east", 5500, 2010, 0.1, 0.2));
+}
+
+/**
+ * Checks that a snapshot loads back every city with the same values, in the listing
+ * order it was saved in.
+ */
+static void testRoundTrip()
+{
+    const string path = scratchPath("round.snap");
+    removeScratch(path);
+
+    CapturedOutput capture;
+    CityManager original;
+    addCities(original);
+    original.sortCities("population", true);
+    original.saveSnapshot(path);
+    CHECK(SnapshotReader::isSnapshot(path));
+
+    SnapshotReader reader;
+    string error;
+    CHECK(reader.open(path, error));
+    CHECK(reader.cityCount() == 4);
+    CHECK(reader.regionCount() == 3);
+
+    CityManager loaded;
+    loaded.loadFromFile(path);
+    const vector<string> expected = listCities(original);
+    CHECK(expected.size() == 4);
+    CHECK(listCities(loaded) == expected);
+    CHECK(expected.size() == 4 && expected[0].rfind("City: beta, Region: south, Population: 40000000, Year: 2024,", 0) == 0);
+    removeScratch(path);
+}
+
+/**
+ * Checks that an empty manager writes a snapshot that loads as no cities.
+ */
+static void testEmpty()
+{
+    const string path = scratchPath("empty.snap");
+    removeScratch(path);
+
+    CapturedOutput capture;
+    CityManager empty;
+    empty.saveSnapshot(path);
+    SnapshotReader reader;
+    string error;
+    CHECK(reader.open(path, error));
+    CHECK(reader.cityCount() == 0);
+    removeScratch(path);
+}
+
+/**
+ * Returns the error a reader reports for a file, or an empty string if it opens.
+ */
+static string openError(const string &path)
+{
+    SnapshotReader reader;
+    string error;
+    if (reader.open(path, error))
+        return "";
+    return error;
+}
+
+/**
+ * Checks that damaged, truncated, foreign and crafted files are rejected, and that a
+ * manager given one loads nothing from it.
+ */
+static void testRejectsCorruptFiles()
+{
+    const string path = scratchPath("good.snap");
+    const string damaged = scratchPath("damaged.snap");
+    removeScratch(path);
+    removeScratch(damaged);
+    {
+        CapturedOutput capture;
+        CityManager manager;
+        addCities(manager);
+        manager.saveSnapshot(path);
+    }
+    const string contents = readText(path);
+    CHECK(contents.size() > 64);
+
+    // A flipped bit in the payload fails the checksum
+    string flipped = contents;
+    flipped[contents.size() - 2] ^= 0x10;
+    writeText(damaged, flipped);
+    CHECK(openError(damaged).find("checksum") != string::npos);
+    {
+        CapturedOutput capture;
+        CityManager manager;
+        manager.loadFromFile(damaged);
+        CHECK(listCities(manager) == vector<string>{"No cities available."});
+    }
+
+    // A file cut short no longer matches the payload size in its header
+    writeText(damaged, contents.substr(0, contents.size() - 8));
+    CHECK(openError(damaged).find("truncated or corrupt") != string::npos);
+    writeText(damaged, contents.substr(0, 40));
+    CHECK(openError(damaged).find("too short") != string::npos);
+
+    // Another version or a foreign file is refused before its payload is read
+    string version = contents;
+    version[8] = 2;
+    writeText(damaged, version);
+    CHECK(openError(damaged).find("version 2") != string::npos);
+    string foreign = contents;
+    foreign[0] = 'X';
+    writeText(damaged, foreign);
+    CHECK(!SnapshotReader::isSnapshot(damaged));
+    CHECK(openError(damaged).find("not a snapshot") != string::npos);
+
+    // A city that refers past the region table is caught even though the checksum matches
+    SnapshotData crafted;
+    crafted.population = {100};
+    crafted.year = {2000};
+    crafted.latitude = {1.0};
+    crafted.longitude = {2.0};
+    crafted.unitX = {0.0};
+    crafted.unitY = {0.0};
+    crafted.unitZ = {1.0};
+    crafted.region = {5};
+    crafted.regions = {"north"};
+    crafted.strings = {"alpha", "mayor", "address", "history"};
+    string error;
+    CHECK(crafted.write(damaged, error));
+    CHECK(openError(damaged).find("invalid string table") != string::npos);
+
+    crafted.region = {0};
+    CHECK(crafted.write(damaged, error));
+    CHECK(openError(damaged).empty());
+
+    removeScratch(path);
+    removeScratch(damaged);
+}
+
+int main()
+{
+    testRoundTrip();
+    testEmpty();
+    testRejectsCorruptFiles();
+    return testResult("SnapshotTest");
+}
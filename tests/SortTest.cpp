@@ -0,0 +1,219 @@
+#include "TestSupport.h"
+#include "NormalizedKeys.h"
+#include "CityManager.h"
+#include <string>
+#include <vector>
+#include <tuple>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <cmath>
+
+using namespace std;
+
+/**
+ * Checks that rows keyed by an integer, a real and a text field, in every combination of
+ * directions, come out of the radix sort in the order a stable comparison sort gives.
+ */
+static void testNormalizedKeys()
+{
+    mt19937 random(7);
+    const vector<double> reals = {-1e300, -2.5, -0.0, 0.0, 1e-310, 2.5, 1e300, -HUGE_VAL, HUGE_VAL};
+    const vector<string> texts = {"", "a", "ab", "abc", "b", string("a\0b", 3), string("a\0", 2), "\xff", "ba"};
+    vector<tuple<int, double, string>> rows;
+    for (int i = 0; i < 3000; ++i)
+    {
+        rows.emplace_back(static_cast<int>(random() % 7) - 3 + (i % 500 == 0 ? INT32_MIN : 0),
+                          reals[random() % reals.size()], texts[random() % texts.size()]);
+    }
+
+    for (int directions = 0; directions < 8; ++directions)
+    {
+        const bool descending[3] = {(directions & 1) != 0, (directions & 2) != 0, (directions & 4) != 0};
+        NormalizedKeys keys;
+        for (const auto &[integer, real, text] : rows)
+        {
+            keys.appendInteger(integer, descending[0]);
+            keys.appendReal(real, descending[1]);
+            keys.appendText(text, descending[2]);
+            keys.endRow();
+        }
+        vector<uint32_t> order;
+        keys.sort(order);
+
+        // -0 and 0 are equal keys, so compare reals by value rather than by bits
+        vector<uint32_t> expected(rows.size());
+        iota(expected.begin(), expected.end(), 0);
+        stable_sort(expected.begin(), expected.end(), [&rows, &descending](uint32_t a, uint32_t b)
+                    {
+                        const auto &[integerA, realA, textA] = rows[a];
+                        const auto &[integerB, realB, textB] = rows[b];
+                        if (integerA != integerB)
+                            return descending[0] ? integerB < integerA : integerA < integerB;
+                        if (realA != realB)
+                            return descending[1] ? realB < realA : realA < realB;
+                        if (textA != textB)
+                        {
+                            const bool less = lexicographical_compare(
+                                textA.begin(), textA.end(), textB.begin(), textB.end(),
+                                [](char x, char y) { return static_cast<unsigned char>(x) < static_cast<unsigned char>(y); });
+                            return descending[2] ? !less : less;
+                        }
+                        return false;
+                    });
+        CHECK(order == expected);
+    }
+}
+
+/**
+ * Checks that keys sharing a long prefix sort correctly; each byte of the prefix is one
+ * more radix pass over the same rows.
+ */
+static void testLongSharedPrefix()
+{
+    mt19937 random(11);
+    const string prefix(100000, 'p');
+    vector<string> texts;
+    NormalizedKeys keys;
+    for (int i = 0; i < 200; ++i)
+    {
+        texts.push_back(prefix + to_string(random() % 50));
+        keys.appendText(texts.back(), false);
+        keys.endRow();
+    }
+    vector<uint32_t> order;
+    keys.sort(order);
+    vector<uint32_t> expected(texts.size());
+    iota(expected.begin(), expected.end(), 0);
+    stable_sort(expected.begin(), expected.end(), [&texts](uint32_t a, uint32_t b) { return texts[a] < texts[b]; });
+    CHECK(order == expected);
+}
+
+/**
+ * Returns the names of a manager's cities in listing order.
+ */
+static vector<string> listedNames(const CityManager &manager)
+{
+    vector<string> names;
+    for (const string &line : listCities(manager))
+        names.push_back(line.substr(6, line.find(", Region: ") - 6));
+    return names;
+}
+
+/**
+ * Returns the names of records in the order sort keys give, ties in the order of the records.
+ */
+static vector<string> expectedNames(vector<CityRecord> records, const vector<SortKey> &keys)
+{
+    auto compare = [&keys](const CityRecord &a, const CityRecord &b)
+    {
+        for (const SortKey &key : keys)
+        {
+            int order = 0;
+            if (key.attribute == "name")
+                order = a.name.compare(b.name);
+            else if (key.attribute == "region")
+                order = a.region.compare(b.region);
+            else if (key.attribute == "history")
+                order = a.history.compare(b.history);
+            else if (key.attribute == "population")
+                order = a.population < b.population ? -1 : b.population < a.population ? 1 : 0;
+            else if (key.attribute == "year")
+                order = a.year < b.year ? -1 : b.year < a.year ? 1 : 0;
+            else if (key.attribute == "latitude")
+                order = a.latitude < b.latitude ? -1 : b.latitude < a.latitude ? 1 : 0;
+            if (order != 0)
+                return key.descending ? order > 0 : order < 0;
+        }
+        return false;
+    };
+    stable_sort(records.begin(), records.end(), compare);
+    vector<string> names;
+    for (const CityRecord &record : records)
+        names.push_back(record.name);
+    return names;
+}
+
+/**
+ * Checks that several sort keys list the cities in key order with ties in insertion order,
+ * and that the listing stays in that order as cities are added, deleted and changed.
+ */
+static void testMultiKeyListing()
+{
+    const vector<vector<SortKey>> orders = {
+        {{"region", false}, {"population", true}},
+        {{"year", true}, {"latitude", false}},
+        {{"history", false}, {"name", true}},
+        {{"population", false}, {"region", true}, {"year", false}},
+    };
+    for (const vector<SortKey> &keys : orders)
+    {
+        mt19937 random(3);
+        const vector<string> regions = {"north", "south", "east"};
+        vector<CityRecord> records;
+        CityManager manager;
+        CapturedOutput capture;
+        for (int i = 0; i < 300; ++i)
+        {
+            records.push_back(makeCity("city" + to_string(i), regions[random() % regions.size()],
+                                       static_cast<int>(1 + random() % 20) * 1000,
+                                       static_cast<int>(1980 + random() % 10), static_cast<double>(random() % 9),
+                                       0.0, "history " + to_string(random() % 4)));
+            manager.insertCity(records.back(), DuplicatePolicy::KeepLast);
+        }
+        CHECK(manager.sortCities(keys));
+        CHECK(listedNames(manager) == expectedNames(records, keys));
+
+        // Change the listing one city at a time, as a server session would between listings
+        for (int step = 0; step < 60; ++step)
+        {
+            CityRecord &record = records[random() % records.size()];
+            switch (step % 5)
+            {
+            case 0:
+                record.population = static_cast<int>(1 + random() % 20) * 1000;
+                manager.setCityAttribute(record.name, record.region, "population", to_string(record.population));
+                break;
+            case 1:
+                record.year = static_cast<int>(1980 + random() % 10);
+                manager.setCityAttribute(record.name, record.region, "year", to_string(record.year));
+                break;
+            case 2:
+            {
+                const string region = regions[random() % regions.size()];
+                if (manager.setCityAttribute(record.name, record.region, "region", region))
+                    record.region = region;
+                break;
+            }
+            case 3:
+                record.history = "history " + to_string(random() % 4);
+                manager.setCityAttribute(record.name, record.region, "history", record.history);
+                break;
+            case 4:
+            {
+                // A deleted city comes back at the end of insertion order
+                CityRecord readded = record;
+                manager.deleteCity(record.name, record.region);
+                records.erase(records.begin() + (&record - records.data()));
+                manager.insertCity(readded, DuplicatePolicy::KeepLast);
+                records.push_back(readded);
+                break;
+            }
+            }
+            if (step % 10 == 9)
+                CHECK(listedNames(manager) == expectedNames(records, keys));
+        }
+        const vector<string> maintained = listedNames(manager);
+        CHECK(manager.sortCities(keys));
+        CHECK(listedNames(manager) == maintained);
+        CHECK(maintained == expectedNames(records, keys));
+    }
+}
+
+int main()
+{
+    testNormalizedKeys();
+    testLongSharedPrefix();
+    testMultiKeyListing();
+    return testResult("SortTest");
+}
@@ -0,0 +1,162 @@
+#ifndef TESTSUPPORT_H
+#define TESTSUPPORT_H
+
+#include "CityManager.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+ * Minimal support for the assert-style test executables: each test file defines main,
+ * checks conditions with CHECK and returns testResult(), so ctest sees a non-zero exit
+ * status when any check failed.
+ */
+
+// Number of failed checks so far
+inline int testFailures = 0;
+
+/**
+ * Records a failed check with its location; the test carries on with the next check.
+ */
+inline void reportFailure(const char *condition, const char *file, int line)
+{
+    cerr << file << ":" << line << ": check failed: " << condition << endl;
+    testFailures++;
+}
+
+#define CHECK(condition) ((condition) ? (void)0 : reportFailure(#condition, __FILE__, __LINE__))
+
+/**
+ * Prints a summary and returns the exit status of the test executable.
+ */
+inline int testResult(const string &name)
+{
+    if (testFailures == 0)
+        cout << name << ": all checks passed" << endl;
+    else
+        cout << name << ": " << testFailures << " check(s) failed" << endl;
+    return testFailures == 0 ? 0 : 1;
+}
+
+/**
+ * Collects everything written to cout while it is in scope.
+ */
+class CapturedOutput
+{
+private:
+    ostringstream captured;
+    streambuf *original;
+
+public:
+    CapturedOutput() : original(cout.rdbuf(captured.rdbuf())) {}
+
+    ~CapturedOutput() { cout.rdbuf(original); }
+
+    CapturedOutput(const CapturedOutput &) = delete;
+    CapturedOutput &operator=(const CapturedOutput &) = delete;
+
+    /**
+     * Returns the text written so far.
+     */
+    string text() const { return captured.str(); }
+};
+
+/**
+ * Returns a path for a scratch file of the running test, unique to its process.
+ */
+inline string scratchPath(const string &name)
+{
+    return "test_" + to_string(getpid()) + "_" + name;
+}
+
+/**
+ * Removes a scratch file and the journal and temporary files a manager may leave beside it.
+ */
+inline void removeScratch(const string &path)
+{
+    remove(path.c_str());
+    remove((path + ".journal").c_str());
+    remove((path + ".tmp").c_str());
+}
+
+/**
+ * Writes text to a file, replacing it.
+ */
+inline void writeText(const string &path, const string &text)
+{
+    ofstream out(path, ios::binary | ios::trunc);
+    out << text;
+}
+
+/**
+ * Returns the contents of a file, or an empty string if it cannot be read.
+ */
+inline string readText(const string &path)
+{
+    ifstream in(path, ios::binary);
+    ostringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+/**
+ * Returns the non-empty lines of a block of text.
+ */
+inline vector<string> splitLines(const string &text)
+{
+    vector<string> lines;
+    istringstream in(text);
+    string line;
+    while (getline(in, line))
+    {
+        if (!line.empty())
+            lines.push_back(line);
+    }
+    return lines;
+}
+
+/**
+ * Returns every city of a manager in listing order, one display line each.
+ */
+inline vector<string> listCities(const CityManager &manager)
+{
+    CapturedOutput capture;
+    manager.displayCities();
+    return splitLines(capture.text());
+}
+
+/**
+ * Returns a city as a record, for building test data.
+ */
+inline CityRecord makeCity(const string &name, const string &region, int population, int year, double latitude,
+                           double longitude, const string &history = "founded by the river")
+{
+    CityRecord record;
+    record.name = name;
+    record.region = region;
+    record.population = population;
+    record.year = year;
+    record.mayorName = "mayor of " + name;
+    record.mayorAddress = "1 main street";
+    record.history = history;
+    record.latitude = latitude;
+    record.longitude = longitude;
+    return record;
+}
+
+/**
+ * Adds a city from a record.
+ */
+inline void addRecord(CityManager &manager, const CityRecord &record)
+{
+    manager.addCity(record.name, record.region, record.population, record.year, record.mayorName,
+                    record.mayorAddress, record.history, record.latitude, record.longitude);
+}
+
+#endif // TESTSUPPORT_H